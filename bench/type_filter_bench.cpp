@@ -0,0 +1,95 @@
+// Type filter kernel benchmark.
+//
+// Build:
+//   g++ -std=c++11 -O2 -Iinclude bench/type_filter_bench.cpp src/type_filter.cpp -o type_filter_bench
+//
+// Usage:
+//   ./type_filter_bench [types] [messages]
+//   ./type_filter_bench P            (filter-heavy: --type P)
+//   ./type_filter_bench AEDU 50000000
+//
+// Filters a synthetic ITCH-like stream of
+// type bytes in MoldUDP64-sized batches
+// with each kernel and prints messages/s.
+
+#include "type_filter.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <vector>
+
+static uint64_t monotonic_ns() {
+    timespec ts;
+    ::clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+// Rough add/execute/delete heavy mix
+static void make_types(std::vector<uint8_t>& types) {
+    const char mix[] = "AAAAAAAADDDDDDDEEEUUPTTSRL";
+    const size_t mix_len = sizeof(mix) - 1;
+
+    uint32_t state = 12345;
+    for (size_t i = 0; i < types.size(); i++) {
+        state = state * 1103515245u + 12345u;
+        types[i] = (uint8_t)mix[(state >> 16) % mix_len];
+    }
+}
+
+int main(int argc, char** argv) {
+    const char* filter_types = argc > 1 ? argv[1] : "P";
+    uint64_t total = argc > 2 ? std::strtoull(argv[2], 0, 10) : 20000000ULL;
+
+    bool allowed[256];
+    std::memset(allowed, 0, sizeof(allowed));
+    for (const char* t = filter_types; *t; t++) {
+        allowed[(unsigned char)*t] = true;
+    }
+
+    // ~30 messages per packet
+    const uint32_t batch = 32;
+    std::vector<uint8_t> types(1 << 20);
+    std::vector<uint8_t> pass(batch);
+    make_types(types);
+
+    const FilterKernel kernels[] = {
+        FILTER_KERNEL_SCALAR, FILTER_KERNEL_SSE42, FILTER_KERNEL_AVX2
+    };
+
+    std::printf("filter=%s messages=%llu batch=%u\n",
+                filter_types, (unsigned long long)total, (unsigned)batch);
+
+    for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++) {
+        TypeFilter filter;
+        filter.init(allowed, kernels[k]);
+
+        if (filter.kernel() != kernels[k]) {
+            std::printf("%-8s not supported\n", k == 1 ? "sse4.2" : "avx2");
+            continue;
+        }
+
+        uint64_t passed = 0;
+        uint64_t done = 0;
+        size_t pos = 0;
+        uint64_t start = monotonic_ns();
+
+        while (done < total) {
+            if (pos + batch > types.size()) {
+                pos = 0;
+            }
+            passed += filter.run(&types[pos], batch, &pass[0]);
+            pos += batch;
+            done += batch;
+        }
+
+        uint64_t elapsed = monotonic_ns() - start;
+        std::printf("%-8s %8.1f M msg/s  passed=%llu\n",
+                    filter.kernel_name(),
+                    (double)done * 1000.0 / (double)elapsed,
+                    (unsigned long long)passed);
+    }
+
+    return 0;
+}
@@ -2,29 +2,68 @@
 #define APPLICATION_H
 
 #include <cstdint>
+#include <string>
+#include <vector>
 
 class Application {
 public:
     Application();
     
+    void set_config_path(const std::string& path);
     void set_max_messages(uint64_t value);
     void set_verbose(bool value);
     void set_type_filter(char type);
+    void add_field_projection(const std::string& projection);
+    void add_filter(const std::string& expression);
+    void add_channel(const std::string& name);
     void set_start_seq(uint64_t value);
     void set_enable_recovery(bool value);
+    void set_record_path(const std::string& path);
+    void set_replay_path(const std::string& path);
+    void set_export_dir(const std::string& dir);
+    void set_shm_ring_name(const std::string& name);
+    void set_shm_read_name(const std::string& name);
+    void set_republish(bool value);
+    void set_latency(bool value);
+    void set_profile(bool value);
+    void set_trace_json_path(const std::string& path);
+    void set_replay_seq_range(uint64_t first, uint64_t last);
+    void set_replay_time_range(uint64_t from_ns, uint64_t to_ns);
 
     int run();
 
 private:
+    std::string config_path;
     uint64_t max_messages;
     bool verbose;
     bool has_type_filter;
     bool type_allowed[256];
+    std::vector<std::string> field_projections;
+    std::vector<std::string> filters;
+    std::vector<std::string> channel_names;
 
     bool has_start_seq;
     uint64_t start_seq;
 
     bool enable_recovery;
+
+    std::string record_path;
+    std::string replay_path;
+    std::string export_dir;
+    std::string shm_ring_name;
+    std::string shm_read_name;
+    bool republish;
+    bool latency;
+    bool profile;
+    std::string trace_json_path;
+
+    bool has_seq_range;
+    uint64_t range_first_seq;
+    uint64_t range_last_seq;
+
+    bool has_time_range;
+    uint64_t range_from_ns;
+    uint64_t range_to_ns;
 };
 
 #endif
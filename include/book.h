@@ -0,0 +1,69 @@
+#ifndef BOOK_H
+#define BOOK_H
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include "config.h"
+#include "field_decode.h"
+
+// One resting order.
+// Plain struct so snapshots can
+// write/mmap it as-is.
+struct BookOrder {
+    uint64_t order_number;
+    uint64_t price;
+    uint64_t quantity;
+    char orderbook_id[12];
+    char side;
+    char reserved[3];
+};
+
+// Order level state built from
+// add / execute / delete / replace
+// messages found in the spec.
+class OrderBook {
+public:
+    OrderBook();
+
+    // Resolve field offsets for
+    // every order message in the spec.
+    void init(const AppConfig& cfg);
+
+    // fields: msg decoded by decode_fields
+    void apply(const uint8_t* msg, uint16_t msg_len, const DecodedFields& fields);
+
+    // Fields apply() reads, by spec
+    // index (for --fields projection)
+    uint64_t field_mask(uint8_t msg_type) const;
+    void clear();
+
+    void insert(const BookOrder& order);
+    void copy_orders(std::vector<BookOrder>& out) const;
+    size_t order_count() const;
+
+private:
+    enum OrderAction {
+        ACTION_NONE,
+        ACTION_ADD,
+        ACTION_EXECUTE,
+        ACTION_DELETE,
+        ACTION_REPLACE
+    };
+
+    struct OrderFields {
+        OrderAction action;
+        const FieldSpec* order_number;
+        const FieldSpec* new_order_number;
+        const FieldSpec* side;
+        const FieldSpec* quantity;
+        const FieldSpec* price;
+        const FieldSpec* orderbook_id;
+        uint32_t min_length;
+    };
+
+    OrderFields fields_by_type[256];
+    std::unordered_map<uint64_t, BookOrder> orders;
+};
+
+#endif
@@ -5,6 +5,7 @@
 #include <string>
 #include <unordered_map>
 #include <vector>
+#include "decode_plan.h"
 
 enum FieldType {
     CHAR,
@@ -24,6 +25,7 @@ struct FieldSpec {
     FieldType type;
     uint32_t size;
     uint32_t offset;
+    uint32_t index;     // position in MsgSpec::fields
 };
 
 struct MsgSpec {
@@ -35,7 +37,30 @@ struct MsgSpec {
     MsgSpec() : msg_type(0), total_length(0) {}
 };
 
+// One MoldUDP64 feed. Keys left out
+// of a [CHANNEL <name>] section come
+// from [FEED_CHANNELS].
+struct ChannelConfig {
+    std::string name;
+    std::string mcast_ip;
+    uint16_t mcast_port;
+    std::string mcast_source_ip;
+    std::string interface_ip;
+    std::string mcast_rerequester_ip;
+    uint16_t mcast_rerequester_port;
+    std::string protocol_spec;
+
+    // Second line for watchdog
+    // failover (empty = same)
+    std::string alternate_interface_ip;
+    std::string alternate_source_ip;
+
+    ChannelConfig() : mcast_port(0), mcast_rerequester_port(0) {}
+};
+
 struct AppConfig {
+    // Feed settings of the channel
+    // in use (channel_name)
     std::string mcast_ip;
     uint16_t mcast_port;
 
@@ -45,20 +70,134 @@ struct AppConfig {
     std::string mcast_rerequester_ip;
     uint16_t mcast_rerequester_port;
 
+    std::string alternate_interface_ip;
+    std::string alternate_source_ip;
+
+    // No packet or heartbeat for this
+    // long: rejoin, then fail over to
+    // the alternate line (0 = off)
+    int watchdog_idle_ms;
+
     uint16_t max_recovery_message_count;
 
+    // Rerequest timing: timeout adapts
+    // to measured RTT within these bounds,
+    // request size shrinks to min on loss
+    uint16_t min_recovery_message_count;
+    int recovery_initial_timeout_ms;
+    int recovery_min_timeout_ms;
+    int recovery_max_timeout_ms;
+    int recovery_max_retries;
+    uint32_t recovery_max_requests_per_second;
+
+    // Live gap handling: wait this long
+    // for late packets, serve from cache
+    // before any rerequest
+    int reorder_window_us;
+    uint64_t recovery_cache_messages;
+    uint64_t recovery_cache_bytes;
+
+    // Book snapshot (empty path = off)
+    std::string snapshot_path;
+    uint64_t snapshot_interval_messages;
+
+    // Sparse index every N messages
+    // for --record
+    uint32_t index_interval_messages;
+
+    // --export column chunks
+    uint32_t export_chunk_rows;
+    std::string export_compress_columns;
+
+    // --shm ring size (records)
+    uint64_t shm_ring_slots;
+
+    // --republish target + local
+    // rerequest service
+    std::string republish_mcast_ip;
+    uint16_t republish_mcast_port;
+    std::string republish_interface_ip;
+    int republish_ttl;
+    int republish_mtu;
+    uint16_t republish_rerequest_port;
+    uint64_t republish_retain_messages;
+    uint64_t republish_retain_bytes;
+
+    // --latency: exchange clock minus
+    // ours, window length, kernel
+    // receive timestamps
+    int64_t latency_clock_offset_ns;
+    uint64_t latency_report_interval_ms;
+    bool latency_kernel_timestamps;
+
+    // --profile breakdown period
+    uint64_t profile_report_interval_ms;
+
+    // Timestamps from the invariant
+    // TSC (else clock_gettime), and
+    // how often it is recalibrated
+    bool clock_use_tsc;
+    uint32_t clock_calibrate_interval_ms;
+
+    // Flight recorder: events per
+    // thread ring (0 = off), where and
+    // how often it is dumped
+    uint32_t trace_ring_events;
+    std::string trace_dump_dir;
+    uint32_t trace_min_dump_interval_ms;
+    uint32_t trace_max_dump_files;
+    bool trace_dump_on_gap;
+
+    // --fields style projections
+    // ("A:OrderNumber,Price")
+    std::vector<std::string> output_fields;
+
+    // --filter style expressions,
+    // ANDed ("Price > 10000")
+    std::vector<std::string> output_filters;
+
     std::string protocol_spec;
 
+    // Every configured channel, at least
+    // one ("default" from [FEED_CHANNELS])
+    std::vector<ChannelConfig> channels;
+    std::string channel_name;
+
+    // Several channels: one epoll loop,
+    // or one thread per channel (always
+    // with recovery)
+    bool channel_threads;
+
     // Load spec
     std::unordered_map<char, MsgSpec> msg_specs;
     
     // Fast lookup by message type
     const MsgSpec* spec_by_type[256];
 
+    // In-band SequenceReset of the spec
+    // (-1 = none) and the offset of its
+    // new SequenceNumber (uint64)
+    int sequence_reset_type;
+    uint32_t sequence_reset_offset;
+
+    // msg_specs compiled to flat
+    // arrays for the decode path
+    DecodePlans plans;
+
     AppConfig();
 };
 
 bool load_config(const char* config_path);
+
+// Parse into out (spec_by_type points
+// into out, build it in place)
+bool load_config_file(const char* config_path, AppConfig* out);
+
+// Switch cfg's feed settings to a
+// channel, loading its spec if it
+// differs. False if unknown.
+bool use_channel(AppConfig* cfg, const std::string& name);
+bool select_channel(const std::string& name);
 const AppConfig& config();
 
 #endif
@@ -0,0 +1,102 @@
+#ifndef CONFIG_RELOAD_H
+#define CONFIG_RELOAD_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+#include "config.h"
+#include "predicate.h"
+
+// Config plus what the decode loop
+// compiles from it. Built off the
+// hot thread, published by one
+// pointer swap.
+struct RuntimeConfig {
+    AppConfig cfg;
+    DecodePlans plans;      // after --fields projection
+    Predicate predicate;    // empty = no --filter
+    uint64_t generation;
+
+    RuntimeConfig() : plans(), generation(0) {}
+};
+
+// 64-byte aligned heap object
+RuntimeConfig* create_runtime_config();
+void destroy_runtime_config(RuntimeConfig* rc);
+
+// Command line parts of the output
+// settings, kept across reloads.
+struct OutputInputs {
+    std::vector<std::string> projections;   // --fields
+    std::vector<std::string> filters;       // --filter
+    uint64_t keep_masks[256];               // fields the book reads
+
+    // Something holds field offsets
+    // (book, recorder, shm) or column
+    // layout (export) from startup
+    bool layout_pinned;
+    bool projection_pinned;
+
+    OutputInputs();
+};
+
+// Projection + filter for cfg, with
+// the command line ones added.
+bool compile_output(const AppConfig& cfg, const OutputInputs& inputs,
+                    DecodePlans* plans, Predicate* predicate, std::string* error);
+
+// Reloads on SIGHUP or when the config
+// or spec file is rewritten (inotify).
+// Settings that need a new socket are
+// rejected, startup-only ones are kept.
+class ConfigReloader {
+public:
+    ConfigReloader();
+    ~ConfigReloader();
+
+    // base: the running config
+    bool start(const std::string& path, const AppConfig& base, const OutputInputs& inputs);
+    void stop();
+
+    // Hot thread, between packets. Newest
+    // config if it changed, else null.
+    // The one it replaces stays valid
+    // until the next call.
+    RuntimeConfig* poll();
+
+private:
+    void watch_loop();
+    void reload();
+    bool build(RuntimeConfig* next, std::string* error);
+    void watch_files(const std::string& spec_path);
+    void reclaim();
+
+    std::string config_path;
+    const AppConfig* base;
+    OutputInputs inputs;
+
+    int inotify_fd;
+    std::vector<int> watches;
+    std::vector<std::string> watched_files;
+
+    // Reload thread only
+    uint64_t generation;
+    std::vector<RuntimeConfig*> published;
+
+    // RCU: newest published, and what
+    // the hot thread holds (hazards)
+    std::atomic<RuntimeConfig*> latest;
+    std::atomic<RuntimeConfig*> in_use;
+    std::atomic<RuntimeConfig*> previous;
+
+    // Hot thread only
+    RuntimeConfig* current;
+    bool holding_previous;
+
+    std::thread watcher;
+    std::atomic<bool> running;
+};
+
+#endif
@@ -0,0 +1,81 @@
+#ifndef DECODE_PLAN_H
+#define DECODE_PLAN_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Flat decode metadata compiled from
+// the spec at load. Decoding a message
+// reads its TypePlan and the line(s)
+// holding its fields, nothing else.
+const int FIELD_PLAN_MAX_FIELDS = 64;
+const int FIELD_PLAN_MAX_BYTES = 240;
+const int DECODE_PLAN_MAX_FIELDS = 4096;
+const uint16_t PLAN_NONE = 0xFFFF;
+
+// Byte shuffles that turn a message's
+// fields into host order u64 values,
+// one per field (string/binary = 0).
+
+// 16 byte window -> 2 values
+struct FieldShuffle {
+    uint16_t src_offset;
+    uint16_t dst_field;
+    uint8_t mask[16];
+};
+
+// 64 byte message -> 8 values
+struct FieldPermute {
+    uint64_t lane_mask;
+    uint16_t dst_field;
+    uint8_t index[64];
+};
+
+struct FieldPlan {
+    uint16_t shuffle_count;
+    FieldShuffle shuffles[FIELD_PLAN_MAX_FIELDS];
+
+    uint16_t permute_count;     // 0 if message > 64 bytes
+    FieldPermute permutes[FIELD_PLAN_MAX_FIELDS / 8];
+};
+
+// One field, 8 per cache line
+struct PlanField {
+    uint16_t offset;
+    uint16_t size;
+    uint8_t type;       // FieldType
+    uint8_t width;      // value bytes, 0 = string/binary
+    uint16_t name;      // into DecodePlans::names
+};
+
+// One message type, 2 per cache line.
+// Masks cover the first 64 fields:
+// output = printed/exported (--fields),
+// decode = output + fields the book uses
+struct TypePlan {
+    uint16_t first_field;   // into DecodePlans::fields, line aligned
+    uint16_t field_count;
+    uint16_t total_length;
+    uint16_t required_len;  // bytes all fields need
+    uint16_t name;
+    uint16_t vector_plan;   // into DecodePlans::vectors or PLAN_NONE
+    uint8_t defined;
+    uint8_t projected;      // output_mask is a subset
+    uint8_t reserved[2];
+    uint64_t output_mask;
+    uint64_t decode_mask;
+};
+
+struct DecodePlans {
+    alignas(64) PlanField fields[DECODE_PLAN_MAX_FIELDS];
+    alignas(64) TypePlan types[256];
+    uint32_t field_total;
+
+    std::vector<FieldPlan> vectors;
+
+    // Interned field/message names
+    std::vector<std::string> names;
+};
+
+#endif
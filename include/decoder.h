@@ -4,6 +4,7 @@
 #include <cstdint>
 #include <string>
 #include "config.h"
+#include "field_decode.h"
 
 struct MoldHeader {
     std::string session;
@@ -18,11 +19,97 @@ bool next_mold_message(const uint8_t* packet,
                        uint16_t* remaining, const uint8_t** msg,
                        uint16_t* msg_len);
 
-bool decode_itch_message(const uint8_t* msg,
-                         uint16_t msg_len,
-                         const AppConfig& cfg,
-                         const std::string& session,
-                         uint64_t seq,
-                         uint16_t packet_msg_count, bool verbose);
+// Message boundaries of one packet,
+// found in a single pass. Types sit in
+// their own array so filters/counters
+// can compare them in bulk.
+const uint16_t MOLD_BATCH_CAPACITY = 1024;
+
+struct MoldMessageRef {
+    uint64_t sequence;
+    uint16_t offset;    // message body within packet
+    uint16_t length;
+    uint32_t reserved;
+};
+
+struct MoldBatch {
+    uint16_t count;
+    MoldMessageRef refs[MOLD_BATCH_CAPACITY];
+    uint8_t types[MOLD_BATCH_CAPACITY];   // 0 for empty messages
+};
+
+// Fill batch with up to MOLD_BATCH_CAPACITY
+// messages from *offset; first_seq is the
+// sequence of that message. Advances
+// *offset / *remaining like next_mold_message.
+// Returns messages found, fewer than asked
+// when the packet is truncated.
+uint16_t scan_mold_messages(const uint8_t* packet, int packet_len,
+                            uint64_t first_seq, int* offset,
+                            uint16_t* remaining, MoldBatch* batch);
+
+// Exchange time of each message.
+// Tracks TimestampSeconds (T) so
+// TimestampNanoseconds within the
+// second can be made absolute.
+class ExchangeClock {
+public:
+    ExchangeClock();
+
+    // Field offsets from cfg (again
+    // after a reload), second kept
+    void init(const AppConfig& cfg);
+
+    // Returns epoch ns, 0 if unknown.
+    uint64_t update(const uint8_t* msg, uint16_t msg_len);
+
+    void set_seconds(uint64_t seconds);
+
+    // New session: unknown until its
+    // first T message
+    void reset();
+
+    // "YYYY-MM-DD HH:MM:SS.nnnnnnnnn" UTC,
+    // "" for 0. Date and time are
+    // formatted once per second, only
+    // the nanoseconds per call.
+    const char* format(uint64_t epoch_ns);
+
+private:
+    // size 0 = type has no such field
+    struct TimeField {
+        uint32_t offset;
+        uint32_t size;
+        FieldType type;
+    };
+
+    TimeField seconds_field[256];
+    TimeField nanos_field[256];
+    uint64_t current_seconds;
+
+    uint64_t text_seconds;
+    char text[32];
+};
+
+// Read a numeric/char field as unsigned 64-bit.
+// Returns 0 for string/binary fields.
+uint64_t read_field_unsigned(const uint8_t* field_data, FieldType type);
+
+// Copy msg to out with every decoded
+// numeric field in host endianness.
+// Returns bytes written (<= capacity).
+uint16_t normalize_message(const uint8_t* msg, uint16_t msg_len,
+                           const DecodedFields* fields, uint8_t* out, uint16_t capacity);
+
+// Print one message from its decoded
+// fields, with the exchange time
+// after the packet count (0 = none).
+bool print_itch_message(const uint8_t* msg,
+                        uint16_t msg_len,
+                        const DecodedFields& fields,
+                        const std::string& session,
+                        uint64_t seq,
+                        uint16_t packet_msg_count,
+                        const char* exchange_time, bool verbose);
 
 #endif
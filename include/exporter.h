@@ -0,0 +1,93 @@
+#ifndef EXPORTER_H
+#define EXPORTER_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "config.h"
+#include "field_decode.h"
+
+// Column file, one per message type
+// (<dir>/<MsgName>.col, host endianness):
+//
+// [ColumnFileHeader]
+// [ColumnDesc + name] x column_count
+// then chunks:
+// [ColumnChunkHeader]
+// [u8 encoding][u8 pad x3][u32 bytes][data] x column_count
+//
+// Column 0 is the Mold sequence (uint64),
+// column 1 the exchange time (uint64
+// epoch ns, 0 if unknown), the rest
+// follow the spec fields.
+struct ColumnFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t column_count;
+    char msg_type;
+    char reserved[7];
+};
+
+struct ColumnDesc {
+    uint8_t type;       // FieldType
+    uint8_t reserved;
+    uint16_t name_len;
+    uint32_t size;      // bytes per value
+};
+
+struct ColumnChunkHeader {
+    char magic[4];
+    uint32_t row_count;
+};
+
+enum ColumnEncoding {
+    ENCODING_PLAIN = 0,        // fixed width values
+    ENCODING_DELTA_VARINT = 1  // zigzag delta, LEB128
+};
+
+class ColumnExporter {
+public:
+    ColumnExporter();
+    ~ColumnExporter();
+
+    // compress_columns: names to delta
+    // encode, "*" for all integer columns
+    // plans: --fields projection
+    // decides the columns written
+    bool open(const std::string& dir, const AppConfig& cfg, const DecodePlans& plans,
+              uint32_t chunk_rows, const std::string& compress_columns);
+    void close();
+
+    void append(const uint8_t* msg, uint16_t msg_len, uint64_t seq, uint64_t exchange_ns,
+                const DecodedFields& fields);
+
+private:
+    struct ColumnBuilder {
+        FieldType type;
+        uint32_t field_index;
+        uint32_t offset;
+        uint32_t size;
+        bool compress;
+        std::vector<uint8_t> values;
+    };
+
+    struct TypeWriter {
+        const MsgSpec* spec;
+        const TypePlan* plan;
+        FILE* file;
+        uint32_t rows;
+        std::vector<ColumnBuilder> columns;
+    };
+
+    bool open_type(TypeWriter& writer);
+    void flush_chunk(TypeWriter& writer);
+
+    std::string dir;
+    uint32_t chunk_rows;
+    std::string compress_columns;
+    TypeWriter writers[256];
+    std::vector<uint8_t> encode_buffer;
+};
+
+#endif
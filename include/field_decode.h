@@ -0,0 +1,68 @@
+#ifndef FIELD_DECODE_H
+#define FIELD_DECODE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "config.h"
+
+enum FieldKernel {
+    FIELD_KERNEL_SCALAR,
+    FIELD_KERNEL_SSSE3,
+    FIELD_KERNEL_AVX2,
+    FIELD_KERNEL_AVX512
+};
+
+// Host order value of the decoded
+// fields of one message, indexed like
+// the spec fields. Strings/binary and
+// fields outside the type's decode_mask
+// are not set; take strings' bytes
+// from the message.
+struct DecodedFields {
+    const DecodePlans* plans;
+    const TypePlan* type;   // 0 if type unknown
+    uint16_t count;         // leading fields inside the message
+    uint64_t values[FIELD_PLAN_MAX_FIELDS + 8];
+};
+
+// Compile cfg->msg_specs into cfg->plans.
+// False if the spec is too large.
+bool compile_decode_plans(AppConfig* cfg);
+
+// Restrict output to the listed fields,
+// "<type>:<name>[,<name>...]" each.
+// keep_masks (256, or 0): fields still
+// decoded for internal users.
+bool project_decode_plans(DecodePlans* plans, const std::vector<std::string>& projections,
+                          const uint64_t* keep_masks, std::string* error);
+
+// Decode all fields in one go with the
+// kernel picked at startup. Returns count.
+uint16_t decode_fields(const uint8_t* msg, uint16_t msg_len,
+                       const DecodePlans& plans, DecodedFields* out);
+
+inline uint64_t field_value(const DecodedFields& fields, const FieldSpec* field) {
+    return fields.values[field->index];
+}
+
+inline const PlanField* plan_fields(const DecodePlans& plans, const TypePlan* type) {
+    return &plans.fields[type->first_field];
+}
+
+inline bool field_output(const TypePlan* type, uint32_t index) {
+    return index >= 64 || ((type->output_mask >> index) & 1) != 0;
+}
+
+inline const char* plan_name(const DecodePlans& plans, uint16_t name) {
+    return plans.names[name].c_str();
+}
+
+// Best kernel the CPU supports is
+// chosen at startup; forcing one the
+// CPU lacks returns false.
+bool set_field_kernel(FieldKernel kernel);
+FieldKernel field_kernel();
+const char* field_kernel_name();
+
+#endif
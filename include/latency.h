@@ -0,0 +1,95 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <cstdint>
+#include <string>
+
+// Log-linear buckets: 8 per power of
+// two, value within 12.5%
+const int LATENCY_BUCKETS = 496;
+
+class LatencyHistogram {
+public:
+    LatencyHistogram();
+
+    void record(uint64_t ns);
+    void clear();
+
+    uint64_t count() const;
+    uint64_t min() const;
+    uint64_t max() const;
+
+    // Upper bound of the bucket
+    // holding fraction p (0..1)
+    uint64_t percentile(double p) const;
+
+private:
+    uint64_t buckets[LATENCY_BUCKETS];
+    uint64_t total;
+    uint64_t min_ns;
+    uint64_t max_ns;
+};
+
+struct LatencySettings {
+    // Exchange clock minus ours, taken
+    // off the exchange time first
+    int64_t clock_offset_ns;
+
+    // Print + restart the window this
+    // often (0 = only at stop)
+    uint64_t report_interval_ns;
+
+    // Receive -> decode (live only,
+    // a recording has no decode time)
+    bool measure_decode;
+
+    LatencySettings()
+    : clock_offset_ns(0),
+      report_interval_ns(0),
+      measure_decode(true) {}
+};
+
+// One way latency of one channel, all
+// messages and per message type:
+//  Wire:   exchange time -> receive
+//  Decode: receive -> delivered
+class LatencyStats {
+public:
+    LatencyStats();
+    ~LatencyStats();
+
+    void init(const std::string& name, const LatencySettings& settings);
+
+    // Config reload, from the next message
+    void set_clock_offset(int64_t clock_offset_ns);
+
+    // After a message is delivered.
+    // exchange_ns 0 = no exchange time
+    void record(uint8_t msg_type, uint64_t exchange_ns, uint64_t receive_ns);
+
+    // Between packets: report once
+    // the interval has passed
+    void tick(uint64_t now_ns);
+
+    // Print the window and restart it
+    void report();
+
+private:
+    struct Stage {
+        LatencyHistogram all;
+        LatencyHistogram* by_type[256];
+        uint64_t early;     // before the exchange time (clock skew)
+    };
+
+    void record_stage(Stage& stage, uint8_t msg_type, int64_t ns);
+    void print_stage(const char* stage_name, Stage& stage);
+
+    std::string name;
+    LatencySettings settings;
+    Stage wire;
+    Stage decode;
+    uint64_t window_start_ns;
+    uint64_t next_report_ns;
+};
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef MESSAGE_CACHE_H
+#define MESSAGE_CACHE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Recent messages of one session,
+// indexed by sequence number.
+// Bounded by message count (slots)
+// and bytes (arena), oldest evicted
+// first. Not thread safe.
+class MessageCache {
+public:
+    MessageCache();
+
+    // max_messages rounded up to power of 2
+    void init(uint64_t max_messages, uint64_t max_bytes);
+
+    // Drops everything if session changes.
+    void store(const std::string& session, uint64_t seq,
+               const uint8_t* msg, uint16_t msg_len);
+
+    bool get(uint64_t seq, const uint8_t** msg, uint16_t* msg_len) const;
+    bool contains(uint64_t seq) const;
+
+    const std::string& session() const;
+
+    // O(1), entries written before
+    // it no longer count
+    void clear();
+
+private:
+    struct Entry {
+        uint64_t seq;
+        uint64_t arena_pos;
+        uint16_t msg_len;
+        bool valid;
+    };
+
+    std::string cache_session;
+    std::vector<Entry> entries;
+    std::vector<uint8_t> arena;
+    uint64_t mask;
+
+    // Monotonic byte position, the
+    // ring offset is pos % arena size
+    uint64_t write_pos;
+
+    // write_pos at the last clear()
+    uint64_t valid_from;
+};
+
+#endif
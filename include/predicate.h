@@ -0,0 +1,118 @@
+#ifndef PREDICATE_H
+#define PREDICATE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "config.h"
+
+// Message filter on field values, e.g.
+//   Price > 10000 && Quantity >= 500
+//   BuySellIndicator == 'B' || !(Group == "G001")
+// Compiled per message type into a short
+// bytecode over the raw big-endian bytes.
+// A comparison on a field the message
+// type does not have is false.
+class Predicate {
+public:
+    Predicate();
+
+    // Several expressions are ANDed.
+    bool compile(const std::vector<std::string>& expressions, const AppConfig& cfg,
+                 std::string* error);
+
+    bool empty() const;
+
+    bool match(const uint8_t* msg, uint16_t msg_len);
+
+    // Per comparison evaluated/passed
+    void print_stats() const;
+
+private:
+    enum Opcode {
+        OP_COMPARE,
+        OP_JUMP_FALSE,
+        OP_JUMP_TRUE,
+        OP_NOT,
+        OP_CONST        // field missing / literal out of range
+    };
+
+    enum Compare {
+        CMP_EQ,
+        CMP_NE,
+        CMP_LT,
+        CMP_LE,
+        CMP_GT,
+        CMP_GE
+    };
+
+    enum LiteralKind {
+        LIT_NUMBER,
+        LIT_CHAR,
+        LIT_TEXT
+    };
+
+    enum ValueKind {
+        VALUE_UNSIGNED,
+        VALUE_SIGNED,
+        VALUE_TEXT
+    };
+
+    struct Instr {
+        uint8_t opcode;
+        uint8_t compare;
+        uint8_t kind;
+        uint8_t width;
+        uint16_t offset;
+        uint16_t end;           // offset + field size
+        uint32_t target;        // jump target / text pool offset
+        uint32_t node;          // counter index
+        uint64_t literal;       // host order, raw bytes for ==/!=
+    };
+
+    struct Node {
+        int kind;               // 0 compare, 1 and, 2 or, 3 not
+        int left;
+        int right;
+        std::string field;
+        uint8_t compare;
+        int literal;
+        int64_t number;
+        std::string text;
+        std::string source;
+        int counter;
+    };
+
+    struct Counter {
+        std::string source;
+        uint64_t evaluated;
+        uint64_t passed;
+    };
+
+    void skip_spaces();
+    bool accept(const char* token);
+    int parse_or(std::vector<Node>& nodes);
+    int parse_and(std::vector<Node>& nodes);
+    int parse_unary(std::vector<Node>& nodes);
+    int parse_compare(std::vector<Node>& nodes);
+
+    bool emit(const std::vector<Node>& nodes, int index, const MsgSpec* spec, std::string* error);
+    void emit_const(const Node& node, bool value);
+    bool compare(const Instr& instr, const uint8_t* msg) const;
+
+    // Parser state
+    std::string input;
+    size_t pos;
+    std::string parse_error;
+
+    std::vector<Instr> code;
+    uint32_t program_first[256];
+    uint32_t program_count[256];
+    std::vector<uint8_t> text_pool;
+
+    std::vector<Counter> counters;
+    uint64_t evaluated;
+    uint64_t passed;
+};
+
+#endif
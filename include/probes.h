@@ -0,0 +1,111 @@
+#ifndef PROBES_H
+#define PROBES_H
+
+// USDT tracepoints, provider "itch":
+//   bpftrace -l 'usdt:./itch:itch:*'
+// A nop plus an ELF note each. Nothing
+// runs until a tracer attaches. Uses
+// <sys/sdt.h> when installed, else the
+// same note format written here (no
+// systemtap-sdt-dev needed to build).
+//
+//   packet_receive(buffer, bytes)
+//   packet_batch(mmsghdr*, packets)
+//   mold_header(seq, count, bytes)
+//   message(seq, type, length)
+//   packet_decoded(seq, delivered)
+//   sequence_check(action, expected,
+//                  seq, count)
+//     action: 0 deliver, 1 recover,
+//     2 skip (PacketAction)
+//   rerequest_send(seq, count)
+//   rerequest_reply(buffer, bytes)
+//   rerequest_timeout(wait_us)
+//
+// Sample scripts in tools/bpftrace.
+
+#if defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define ITCH_HAVE_SDT_H 1
+#endif
+#endif
+
+#if defined(ITCH_HAVE_SDT_H)
+
+#define ITCH_PROBE1(name, a1) DTRACE_PROBE1(itch, name, a1)
+#define ITCH_PROBE2(name, a1, a2) DTRACE_PROBE2(itch, name, a1, a2)
+#define ITCH_PROBE3(name, a1, a2, a3) DTRACE_PROBE3(itch, name, a1, a2, a3)
+#define ITCH_PROBE4(name, a1, a2, a3, a4) DTRACE_PROBE4(itch, name, a1, a2, a3, a4)
+
+#elif defined(__x86_64__) && defined(__GNUC__)
+
+// Argument spec "<size>@<operand>",
+// negative size = signed. %n prints
+// the constant negated.
+template <typename T>
+struct ProbeArgSize {
+    static const int value = (T(-1) < T(0) ? 1 : -1) * (int)sizeof(T);
+};
+
+template <typename T>
+struct ProbeArgSize<T*> {
+    static const int value = -(int)sizeof(T*);
+};
+
+#define ITCH_PROBE_ARG(n, x) [s##n] "n"(ProbeArgSize<__typeof__(x)>::value), [a##n] "nor"(x)
+
+// stapsdt note: probe address,
+// .stapsdt.base (for prelink), no
+// semaphore, provider, name, args
+#define ITCH_PROBE_ASM(name, args)                                          \
+    "990: nop\n"                                                            \
+    ".pushsection .note.stapsdt,\"?\",\"note\"\n"                           \
+    ".balign 4\n"                                                           \
+    ".4byte 992f-991f, 994f-993f, 3\n"                                      \
+    "991: .asciz \"stapsdt\"\n"                                             \
+    "992: .balign 4\n"                                                      \
+    "993: .8byte 990b\n"                                                    \
+    ".8byte _.stapsdt.base\n"                                               \
+    ".8byte 0\n"                                                            \
+    ".asciz \"itch\"\n"                                                     \
+    ".asciz \"" #name "\"\n"                                                \
+    ".asciz \"" args "\"\n"                                                 \
+    "994: .balign 4\n"                                                      \
+    ".popsection\n"                                                         \
+    ".ifndef _.stapsdt.base\n"                                              \
+    ".pushsection .stapsdt.base,\"aG\",\"progbits\",.stapsdt.base,comdat\n" \
+    ".weak _.stapsdt.base\n"                                                \
+    ".hidden _.stapsdt.base\n"                                              \
+    "_.stapsdt.base: .space 1\n"                                            \
+    ".size _.stapsdt.base, 1\n"                                             \
+    ".popsection\n"                                                         \
+    ".endif\n"
+
+#define ITCH_PROBE1(name, a1)                                               \
+    __asm__ __volatile__(ITCH_PROBE_ASM(name, "%n[s1]@%[a1]")               \
+                         :: ITCH_PROBE_ARG(1, a1))
+#define ITCH_PROBE2(name, a1, a2)                                           \
+    __asm__ __volatile__(ITCH_PROBE_ASM(name, "%n[s1]@%[a1] %n[s2]@%[a2]")  \
+                         :: ITCH_PROBE_ARG(1, a1), ITCH_PROBE_ARG(2, a2))
+#define ITCH_PROBE3(name, a1, a2, a3)                                       \
+    __asm__ __volatile__(ITCH_PROBE_ASM(name, "%n[s1]@%[a1] %n[s2]@%[a2] "  \
+                                              "%n[s3]@%[a3]")               \
+                         :: ITCH_PROBE_ARG(1, a1), ITCH_PROBE_ARG(2, a2),   \
+                            ITCH_PROBE_ARG(3, a3))
+#define ITCH_PROBE4(name, a1, a2, a3, a4)                                   \
+    __asm__ __volatile__(ITCH_PROBE_ASM(name, "%n[s1]@%[a1] %n[s2]@%[a2] "  \
+                                              "%n[s3]@%[a3] %n[s4]@%[a4]")  \
+                         :: ITCH_PROBE_ARG(1, a1), ITCH_PROBE_ARG(2, a2),   \
+                            ITCH_PROBE_ARG(3, a3), ITCH_PROBE_ARG(4, a4))
+
+#else
+
+#define ITCH_PROBE1(name, a1) do { (void)(a1); } while (0)
+#define ITCH_PROBE2(name, a1, a2) do { (void)(a1); (void)(a2); } while (0)
+#define ITCH_PROBE3(name, a1, a2, a3) do { (void)(a1); (void)(a2); (void)(a3); } while (0)
+#define ITCH_PROBE4(name, a1, a2, a3, a4) do { (void)(a1); (void)(a2); (void)(a3); (void)(a4); } while (0)
+
+#endif
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <cstdint>
+#include <string>
+
+// Per-packet path, in order
+enum ProfileStage {
+    STAGE_RECV,         // socket / recording read
+    STAGE_HEADER,       // mold header, sequence check
+    STAGE_SPLIT,        // message boundaries
+    STAGE_FILTER,       // type + value filter
+    STAGE_DECODE,       // exchange time, field decode
+    STAGE_OUTPUT,       // text / export / shm / record / republish
+    STAGE_BOOK,
+    STAGE_FLUSH,        // end of packet: republish flush, snapshot
+    PROFILE_STAGES
+};
+
+// TSC cycles, ns without an
+// invariant TSC
+uint64_t profile_now();
+
+// --profile: time spent per stage by
+// one decode context (one per thread,
+// one per channel with epoll)
+class StageProfile {
+public:
+    StageProfile();
+
+    void init(const std::string& name, uint64_t report_interval_ns);
+
+    // Adds now - start to stage, returns
+    // now (start of the next stage)
+    uint64_t add(ProfileStage stage, uint64_t start);
+
+    void count(uint64_t packets, uint64_t messages);
+
+    // Between packets: report once
+    // the interval has passed
+    void tick();
+
+    // Print the window and restart it
+    void report();
+
+private:
+    std::string name;
+    bool tsc;
+    uint64_t report_interval_ns;
+    uint64_t window_start_ns;
+    uint64_t next_report_ns;
+
+    uint64_t cycles[PROFILE_STAGES];
+    uint64_t packets;
+    uint64_t messages;
+};
+
+#endif
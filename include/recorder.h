@@ -0,0 +1,116 @@
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "config.h"
+#include "decoder.h"
+
+// Recording file (host endianness):
+// [RecordFileHeader]
+// then per packet:
+// [RecordPacketHeader][MoldUDP64 packet bytes]
+struct RecordFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+};
+
+struct RecordPacketHeader {
+    uint32_t packet_len;
+    uint32_t reserved;
+    uint64_t receive_ns;
+};
+
+// Index file (<record>.idx):
+// [IndexFileHeader][IndexEntry x N]
+// One entry every interval messages,
+// pointing at the packet holding it.
+struct IndexFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t interval;
+};
+
+struct IndexEntry {
+    uint64_t sequence;
+    uint64_t file_offset;
+    uint64_t timestamp_ns;
+};
+
+// Writes delivered messages as MoldUDP64
+// packets + sparse index. Messages come
+// in delivery (sequence) order, after
+// reordering and gap-fill, so a replay
+// has the gaps recovery closed filled.
+class Recorder {
+public:
+    Recorder();
+    ~Recorder();
+
+    bool open(const std::string& path, uint32_t index_interval, const AppConfig& cfg);
+
+    // Writes the packet being built
+    void close();
+
+    // Consecutive messages of a session
+    // share a packet, stamped with the
+    // receive time of its first message
+    void write_message(const std::string& session, uint64_t seq,
+                       const uint8_t* msg, uint16_t msg_len, uint64_t receive_ns);
+
+    // End of an input packet or a
+    // run of cached messages
+    void flush_packet();
+
+private:
+    void write_packet(const uint8_t* packet, int packet_len, uint64_t receive_ns);
+
+    ExchangeClock clock;
+    FILE* data_file;
+    FILE* index_file;
+    uint64_t data_offset;
+    uint32_t interval;
+    uint64_t next_index_seq;
+    bool has_index_seq;
+
+    // Packet being built
+    std::vector<uint8_t> pending;
+    uint16_t pending_count;
+    uint64_t pending_first_seq;
+    uint64_t pending_receive_ns;
+};
+
+// Reads a recording from an offset.
+class RecordReader {
+public:
+    RecordReader();
+    ~RecordReader();
+
+    bool open(const std::string& path);
+    void close();
+
+    bool seek(uint64_t file_offset);
+
+    // Returns packet length, 0 at end, -1 on error.
+    int next_packet(uint8_t* buffer, int capacity, uint64_t* receive_ns);
+
+private:
+    FILE* file;
+};
+
+std::string index_path_for(const std::string& record_path);
+
+// Load <record>.idx, rebuild it by
+// scanning the recording if missing.
+bool load_index(const std::string& record_path, const AppConfig& cfg,
+                uint32_t interval, std::vector<IndexEntry>& out);
+
+// Offset of last entry at or before
+// sequence / timestamp (0 = file start).
+const IndexEntry* find_by_sequence(const std::vector<IndexEntry>& index, uint64_t sequence);
+const IndexEntry* find_by_timestamp(const std::vector<IndexEntry>& index, uint64_t timestamp_ns);
+
+#endif
@@ -5,23 +5,92 @@
 #include <string>
 #include <netinet/in.h>
 
+// Limits for adaptive timing
+// and request sizing.
+struct RecoveryTuning {
+    int initial_timeout_us;     // before first RTT sample
+    int min_timeout_us;
+    int max_timeout_us;
+    uint32_t max_requests_per_second;  // 0 = no limit
+    uint16_t min_request_count;
+    uint16_t max_request_count;
+
+    RecoveryTuning()
+    : initial_timeout_us(1000 * 1000),
+      min_timeout_us(2 * 1000),
+      max_timeout_us(2000 * 1000),
+      max_requests_per_second(0),
+      min_request_count(100),
+      max_request_count(5000) {}
+};
+
+struct RecoveryStats {
+    uint64_t requests;
+    uint64_t timeouts;
+    uint64_t reply_packets;
+    uint64_t rtt_samples;
+    uint64_t rtt_total_us;
+    uint64_t rtt_min_us;
+    uint64_t rtt_max_us;
+    uint64_t last_rtt_us;
+
+    RecoveryStats()
+    : requests(0), timeouts(0), reply_packets(0), rtt_samples(0),
+      rtt_total_us(0), rtt_min_us(0), rtt_max_us(0), last_rtt_us(0) {}
+};
+
 class Rerequester {
 public:
     Rerequester();
     ~Rerequester();
 
-    // Open UDP Socket for 
+    // Open UDP Socket for
     // sending rerequest + receive unicast reply
-    bool open(const std::string& ip, uint16_t port, int receive_buffer_bytesm, int timeout_ms);
+    bool open(const std::string& ip, uint16_t port, int receive_buffer_bytes);
     void close();
+
+    void set_tuning(const RecoveryTuning& value);
+
+    // Paced to max_requests_per_second.
     bool send_request(const char session[10], uint64_t start_seq, uint16_t count);
+
+    // Wait for one reply packet, up to the
+    // adaptive timeout. Returns bytes,
+    // 0 on timeout, -1 on error.
     int receive_packet(uint8_t* buffer, int capacity);
 
+    // Messages to ask for next, shrinks
+    // on loss and grows back on success.
+    uint16_t request_size(uint64_t remaining) const;
+    void chunk_done(uint16_t requested, uint64_t received);
+
+    int timeout_us() const;
+    const RecoveryStats& stats() const;
+    void reset_stats();
+
 private:
+    int rto_us() const;
+
     int fd;
     sockaddr_in dst_addr;
-};
+    RecoveryTuning tuning;
 
-#endif
+    // RTT = request to first reply,
+    // smoothed like TCP (srtt/rttvar).
+    // interarrival = gap between replies
+    bool has_rtt;
+    int64_t srtt_us;
+    int64_t rttvar_us;
+    int64_t interarrival_us;
+    int backoff;
+
+    uint64_t sent_at_us;
+    uint64_t last_reply_us;
+    bool awaiting_first_reply;
+    uint64_t next_send_us;
 
+    uint16_t request_count;
+    RecoveryStats recovery_stats;
+};
 
+#endif
@@ -0,0 +1,95 @@
+#ifndef REPUBLISHER_H
+#define REPUBLISHER_H
+
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <netinet/in.h>
+#include "message_cache.h"
+
+struct RepublishSettings {
+    std::string mcast_ip;
+    uint16_t mcast_port;
+    std::string interface_ip;
+    int ttl;
+    int mtu;
+
+    // Local rerequest service
+    // (0 = no service)
+    uint16_t rerequest_port;
+
+    uint64_t retain_messages;
+    uint64_t retain_bytes;
+
+    RepublishSettings()
+    : mcast_port(0),
+      ttl(1),
+      mtu(1500),
+      rerequest_port(0),
+      retain_messages(1 << 20),
+      retain_bytes(64 * 1024 * 1024) {}
+};
+
+// Re-sends the recovered, in-order
+// stream as MoldUDP64 on an internal
+// group, with original session and
+// sequence numbers, and answers
+// rerequests from retained messages.
+class Republisher {
+public:
+    Republisher();
+    ~Republisher();
+
+    bool open(const RepublishSettings& settings);
+    void close();
+
+    // Messages must come in sequence
+    // order; older ones are dropped.
+    void publish(const std::string& session, uint64_t seq,
+                 const uint8_t* msg, uint16_t msg_len);
+
+    // Send the packet being built.
+    void flush();
+
+    // Forward a heartbeat with the
+    // next sequence we will send.
+    // end_of_session: count 0xFFFF
+    void heartbeat(const std::string& session, bool end_of_session);
+
+    // In-band sequence reset: continue
+    // at next, retained messages are
+    // from the old numbering
+    void sequence_reset(uint64_t next);
+
+private:
+    void send_packet(const uint8_t* packet, int packet_len, const sockaddr_in& dst);
+    void serve_loop();
+    void answer_request(const uint8_t* request, int request_len, const sockaddr_in& from);
+
+    int send_fd;
+    int request_fd;
+    sockaddr_in group_addr;
+    int max_payload;
+
+    // Packet being built
+    uint8_t packet[64 * 1024];
+    int packet_len;
+    uint16_t packet_count;
+    uint64_t packet_first_seq;
+
+    char session[10];
+    bool has_next;
+    uint64_t next_seq;
+
+    // Retained messages, shared with
+    // the rerequest thread
+    std::mutex cache_lock;
+    MessageCache cache;
+
+    std::thread server;
+    std::atomic<bool> running;
+};
+
+#endif
@@ -0,0 +1,88 @@
+#ifndef SESSION_TRACKER_H
+#define SESSION_TRACKER_H
+
+#include <cstdint>
+#include <string>
+#include "decoder.h"
+
+// MoldUDP64 message_count values
+// with no messages behind them
+const uint16_t MOLD_HEARTBEAT = 0;
+const uint16_t MOLD_END_OF_SESSION = 0xFFFF;
+
+enum SessionState {
+    SESSION_JOINED,         // socket up, no packet yet
+    SESSION_LIVE,
+    SESSION_RECOVERING,     // gap-fill running
+    SESSION_ENDED           // end-of-session seen
+};
+
+enum PacketAction {
+    PACKET_DELIVER,         // decode it
+    PACKET_RECOVER,         // gap-fill expected()..header seq first
+    PACKET_SKIP             // stale heartbeat / duplicate / ended session
+};
+
+struct SessionCounters {
+    uint64_t heartbeats;
+    uint64_t gaps;
+    uint64_t tail_gaps;         // seen on heartbeat / end of session
+    uint64_t duplicates;        // whole packet seen before
+    uint64_t overlaps;          // part seen, new suffix delivered
+    uint64_t session_changes;
+    uint64_t after_end;         // packets of an ended session
+
+    SessionCounters()
+    : heartbeats(0), gaps(0), tail_gaps(0), duplicates(0),
+      overlaps(0), session_changes(0), after_end(0) {}
+};
+
+// Sequence state of one channel.
+// Heartbeats and end-of-session
+// carry the next sequence, so a lost
+// tail shows up without new data.
+class SessionTracker {
+public:
+    SessionTracker();
+
+    // Warm restart: position
+    // already applied
+    void resume(const std::string& session, uint64_t next_seq);
+
+    // One header. Prints GAP DETECT,
+    // SESSION_CHANGE, END OF SESSION.
+    PacketAction on_packet(const MoldHeader& header);
+
+    // Gap-fill done up to next_seq
+    void recovered(uint64_t next_seq);
+
+    // In-band sequence reset seen by
+    // the decoder, same session
+    void rebase(uint64_t next_seq);
+
+    SessionState state() const;
+    const char* state_name() const;
+    const std::string& session() const;
+    uint64_t expected() const;
+    const SessionCounters& counters() const;
+
+private:
+    void enter(const MoldHeader& header);
+    PacketAction check_packet(const MoldHeader& header);
+
+    SessionState current;
+    std::string current_session;
+    uint64_t expected_seq;
+
+    // Tail gap found by end-of-session:
+    // ended once it is filled
+    bool end_after_recovery;
+
+    SessionCounters stats;
+};
+
+// Messages in the packet (0 for
+// heartbeat / end of session)
+uint16_t mold_data_count(const MoldHeader& header);
+
+#endif
@@ -0,0 +1,114 @@
+#ifndef SHM_RING_H
+#define SHM_RING_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include "config.h"
+#include "field_decode.h"
+
+// Fixed size normalized message.
+// data holds the message with every
+// numeric field at its spec offset,
+// converted to host endianness.
+struct NormalizedRecord {
+    uint64_t sequence;
+    uint64_t receive_ns;
+    uint64_t exchange_ns;   // epoch ns, 0 if unknown
+    char session[10];
+    char msg_type;
+    uint8_t truncated;
+    uint16_t msg_len;
+    uint16_t reserved;
+    uint8_t data[80];
+};
+
+// Slot: seq is odd while written,
+// 2 * n + 2 once record n is ready.
+struct ShmRingSlot {
+    std::atomic<uint64_t> seq;
+    NormalizedRecord record;
+};
+
+struct ShmRingHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t slot_size;
+    uint64_t slot_count;
+    uint32_t writer_pid;
+    char reserved[36];
+
+    // Next record number to write
+    std::atomic<uint64_t> write_index;
+    char pad[56];
+};
+
+// Single producer side.
+class ShmRingWriter {
+public:
+    ShmRingWriter();
+    ~ShmRingWriter();
+
+    // slot_count rounded up to power of 2
+    bool open(const std::string& name, uint64_t slot_count, const AppConfig& cfg);
+    void close();
+
+    void publish(const std::string& session, uint64_t seq, uint64_t receive_ns, uint64_t exchange_ns,
+                 const uint8_t* msg, uint16_t msg_len, const DecodedFields& fields);
+
+private:
+    const AppConfig* cfg;
+    std::string name;
+    ShmRingHeader* header;
+    ShmRingSlot* slots;
+    size_t mapped_bytes;
+    uint64_t mask;
+    uint64_t next_index;
+};
+
+enum ShmReadResult {
+    SHM_READ_OK,
+    SHM_READ_EMPTY,
+    SHM_READ_LAPPED
+};
+
+// Lock-free reader, any number of
+// processes can attach.
+class ShmRingReader {
+public:
+    ShmRingReader();
+    ~ShmRingReader();
+
+    // Starts at the current write
+    // position (new records only)
+    bool open(const std::string& name);
+    void close();
+
+    // Back to the oldest record still
+    // held, after attaching to a new ring
+    void rewind();
+
+    // Writer process is gone, or the
+    // name now holds a new ring (writer
+    // restarted). Re-open to follow it.
+    bool stale() const;
+
+    // On LAPPED, skipped holds records
+    // lost and the reader moves to the
+    // oldest record still in the ring.
+    ShmReadResult read(NormalizedRecord* out, uint64_t* skipped);
+
+private:
+    std::string name;
+    ShmRingHeader* header;
+    ShmRingSlot* slots;
+    size_t mapped_bytes;
+    uint64_t mask;
+    uint64_t next_index;
+
+    // Segment this reader mapped
+    uint64_t device;
+    uint64_t inode;
+};
+
+#endif
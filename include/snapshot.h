@@ -0,0 +1,67 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "book.h"
+
+// On-disk layout (host endianness):
+// [SnapshotHeader][BookOrder x order_count]
+// Fixed size records, so the file
+// can be mmap'ed and read in place.
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+    char session[10];
+    char reserved[6];
+    uint64_t next_sequence;
+    uint64_t decoded_count;
+    uint64_t created_ns;
+    uint64_t order_count;
+};
+
+struct Snapshot {
+    std::string session;
+    uint64_t next_sequence;
+    uint64_t decoded_count;
+    std::vector<BookOrder> orders;
+
+    Snapshot() : next_sequence(0), decoded_count(0) {}
+};
+
+// Load latest snapshot file.
+// Returns false if missing or invalid.
+bool load_snapshot(const std::string& path, Snapshot* out);
+
+// Writes snapshots on a background thread.
+// submit() only hands the data over,
+// a newer submit replaces a pending one.
+class SnapshotWriter {
+public:
+    SnapshotWriter();
+    ~SnapshotWriter();
+
+    bool start(const std::string& path);
+    void submit(Snapshot& snapshot);
+
+    // Write pending snapshot and stop thread.
+    void stop();
+
+private:
+    void writer_loop();
+
+    std::string path;
+    std::thread writer;
+    std::mutex lock;
+    std::condition_variable wake;
+    bool running;
+    bool has_pending;
+    Snapshot pending;
+};
+
+#endif
@@ -16,6 +16,11 @@ public:
     // Receive one datagram into buffer.
     // Returns bytes received, or -1 on error
     int receive_bytes(uint8_t* buffer, int buffer_capacity);
+
+    // Wait up to timeout_us for one datagram.
+    // Returns bytes received, 0 on timeout,
+    // or -1 on error
+    int receive_bytes_timeout(uint8_t* buffer, int buffer_capacity, int timeout_us);
     
     // Receive up to message_count datagrams using recvmmsg().
     // Returns packets received, or -1 on error.
@@ -27,10 +32,31 @@ public:
     // Returns true on success.
     bool set_receive_buffer(int receive_buffer_bytes);
 
+    // Set SO_RCVTIMEO: receive_bytes()
+    // returns -1 (EAGAIN) after timeout_ms
+    // without a datagram. 0 = block.
+    bool set_receive_timeout(int timeout_ms);
+
+    // Kernel receive time (SO_TIMESTAMPNS)
+    // on every datagram, kept across
+    // reconnects. False if not supported.
+    bool set_receive_timestamps(bool on);
+
+    // Epoch ns of the last datagram
+    // received, 0 when timestamps are off
+    uint64_t last_receive_ns() const;
+
     void close();
 
+    // For epoll, -1 when closed
+    int handle() const;
+
 private:
+    int receive_into(uint8_t* buffer, int buffer_capacity, int flags);
+
     int fd;
+    bool timestamps;
+    uint64_t receive_ns;
 };
 
 #endif
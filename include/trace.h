@@ -0,0 +1,85 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <cstdint>
+#include <string>
+
+// Flight recorder: every thread writes
+// compact events into its own ring,
+// no locks. The rings go to a file on
+// a gap, a stall or SIGUSR1 (also on a
+// crash), --trace-json converts it for
+// chrome://tracing / Perfetto.
+
+enum TraceEventType {
+    TRACE_PACKET = 1,       // seq, count = mold count, ts = receive
+    TRACE_GAP,              // seq = expected, count = missing
+    TRACE_REQUEST,          // seq, count, arg = attempt
+    TRACE_REPLY,            // seq, count = messages decoded
+    TRACE_REQUEST_TIMEOUT,  // seq, count, arg = attempt
+    TRACE_DECODE,           // seq, count = messages, ts = start, arg = ns taken
+    TRACE_STALL             // seq = expected, arg = idle ms
+};
+
+// 32 bytes, two per cache line
+struct TraceEvent {
+    uint64_t ts_ns;         // realtime
+    uint64_t seq;
+    uint32_t count;
+    uint32_t arg;
+    uint16_t type;
+    uint16_t channel;       // trace_channel() id
+    uint32_t reserved;
+};
+
+struct TraceSettings {
+    std::string dump_dir;
+    uint32_t ring_events;           // per thread, 0 = off
+    uint32_t min_dump_interval_ms;  // gap / stall dumps
+    uint32_t max_dump_files;        // newest kept, 0 = all
+    bool dump_on_gap;
+
+    TraceSettings()
+    : dump_dir("."),
+      ring_events(16384),
+      min_dump_interval_ms(1000),
+      max_dump_files(16),
+      dump_on_gap(true) {}
+};
+
+// Once, before the threads start.
+// Hooks SIGUSR1 and fatal signals,
+// starts the dump writer thread.
+void trace_init(const TraceSettings& settings);
+
+// Id carried by events, the name
+// goes into the dump
+uint16_t trace_channel(const std::string& name);
+
+// Names the calling thread's ring
+// (before its first event)
+void trace_thread(const std::string& name);
+
+// ts_ns 0 = now
+void trace_event(uint16_t type, uint16_t channel, uint64_t seq, uint32_t count,
+                 uint32_t arg, uint64_t ts_ns);
+
+enum TraceDumpReason {
+    TRACE_DUMP_GAP,         // unless dump_on_gap = 0
+    TRACE_DUMP_STALL,       // recovery gave up, feed idle
+    TRACE_DUMP_SIGNAL,      // SIGUSR1
+    TRACE_DUMP_CRASH
+};
+
+// Gap / stall: all rings to a new file
+// in dump_dir, written by the dump
+// writer thread. Held to one per
+// min_dump_interval_ms, the oldest
+// beyond max_dump_files is removed.
+bool trace_dump(TraceDumpReason reason);
+
+// --trace-json: dump file to
+// Chrome trace JSON on stdout
+int trace_to_json(const std::string& path);
+
+#endif
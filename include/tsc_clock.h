@@ -0,0 +1,53 @@
+#ifndef TSC_CLOCK_H
+#define TSC_CLOCK_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+// Hot path clock. Reads the invariant
+// TSC and scales it with fixed-point
+// math once calibrated, clock_gettime
+// before that or without one.
+uint64_t clock_realtime_ns();
+uint64_t clock_monotonic_ns();
+
+// Raw counter for cycle counts,
+// 0 when the TSC is not in use
+uint64_t tsc_cycles();
+uint64_t tsc_cycles_to_ns(uint64_t cycles);
+
+// "tsc" or "clock_gettime"
+const char* clock_source_name();
+
+// Calibrates the TSC against
+// CLOCK_MONOTONIC / CLOCK_REALTIME and
+// keeps it in step on its own thread.
+// One per process.
+class ClockCalibrator {
+public:
+    ClockCalibrator();
+    ~ClockCalibrator();
+
+    // Blocks ~10 ms for the first
+    // estimate. False: no invariant
+    // TSC, clock_gettime stays.
+    bool start(uint32_t interval_ms);
+    void stop();
+
+    // Measured TSC rate
+    double tsc_ghz() const;
+
+private:
+    void calibrate_loop();
+
+    uint32_t interval_ms;
+    std::thread worker;
+    std::mutex wake_mutex;
+    std::condition_variable wake;
+    std::atomic<bool> running;
+};
+
+#endif
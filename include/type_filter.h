@@ -0,0 +1,50 @@
+#ifndef TYPE_FILTER_H
+#define TYPE_FILTER_H
+
+#include <cstdint>
+
+enum FilterKernel {
+    FILTER_KERNEL_AUTO,
+    FILTER_KERNEL_SCALAR,
+    FILTER_KERNEL_SSE42,
+    FILTER_KERNEL_AVX2
+};
+
+// Message type filter + per-type
+// counters over a batch of type bytes.
+// The kernel is picked once from CPUID.
+class TypeFilter {
+public:
+    TypeFilter();
+
+    // allowed: 256 flags, 0 = pass all.
+    // Falls back to scalar if the CPU
+    // lacks the requested kernel.
+    void init(const bool* allowed, FilterKernel requested);
+
+    // pass[i] = 1 if types[i] is allowed,
+    // counts every type. Returns passed.
+    uint32_t run(const uint8_t* types, uint32_t count, uint8_t* pass);
+
+    // Single message (cache/recovery path)
+    bool pass_one(uint8_t type);
+
+    uint64_t count(uint8_t type) const;
+    void reset_counts();
+
+    FilterKernel kernel() const;
+    const char* kernel_name() const;
+
+private:
+    FilterKernel active;
+    bool pass_all;
+    bool allowed[256];
+
+    // Allowed types for vector compares
+    uint8_t set[16];
+    int set_size;
+
+    uint64_t counts[256];
+};
+
+#endif
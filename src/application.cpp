@@ -3,20 +3,52 @@
 #include "socket.h"
 #include "decoder.h"
 #include "recovery.h"
+#include "book.h"
+#include "snapshot.h"
+#include "recorder.h"
+#include "exporter.h"
+#include "shm_ring.h"
+#include "republisher.h"
+#include "message_cache.h"
+#include "type_filter.h"
+#include "predicate.h"
+#include "config_reload.h"
+#include "session_tracker.h"
+#include "latency.h"
+#include "tsc_clock.h"
+#include "trace.h"
+#include "probes.h"
+#include "profile.h"
 
 #include <cstdio>
 #include <cstdint>
 #include <string>
 #include <cstring>
 #include <cerrno>
+#include <csignal>
+#include <vector>
+#include <thread>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/epoll.h>
 
 Application::Application()
-: max_messages(0),
+: config_path("config/config.ini"),
+  max_messages(0),
   verbose(false),
   has_type_filter(false),
   has_start_seq(false),
   start_seq(0),
-  enable_recovery(false) {
+  enable_recovery(false),
+  republish(false),
+  latency(false),
+  profile(false),
+  has_seq_range(false),
+  range_first_seq(0),
+  range_last_seq(0),
+  has_time_range(false),
+  range_from_ns(0),
+  range_to_ns(0) {
     std::memset(type_allowed, 0, sizeof(type_allowed));
 }
 
@@ -24,259 +56,2104 @@ void Application::set_max_messages(uint64_t value) {
     max_messages = value;
 }
 
+void Application::set_config_path(const std::string& path) {
+    config_path = path;
+}
+
 void Application::set_verbose(bool value) {
     verbose = value;
 }
 
-void Application::set_type_filter(char type) {
-    has_type_filter = true;
-    type_allowed[(unsigned char)type] = true;
-}
+void Application::set_type_filter(char type) {
+    has_type_filter = true;
+    type_allowed[(unsigned char)type] = true;
+}
+
+void Application::add_field_projection(const std::string& projection) {
+    field_projections.push_back(projection);
+}
+
+void Application::add_filter(const std::string& expression) {
+    filters.push_back(expression);
+}
+
+void Application::add_channel(const std::string& name) {
+    channel_names.push_back(name);
+}
+
+void Application::set_start_seq(uint64_t value) {
+    has_start_seq = true;
+    start_seq = value;
+}
+
+void Application::set_enable_recovery(bool value) {
+    enable_recovery = value;
+}
+
+void Application::set_record_path(const std::string& path) {
+    record_path = path;
+}
+
+void Application::set_replay_path(const std::string& path) {
+    replay_path = path;
+}
+
+void Application::set_export_dir(const std::string& dir) {
+    export_dir = dir;
+}
+
+void Application::set_shm_ring_name(const std::string& name) {
+    shm_ring_name = name;
+}
+
+void Application::set_shm_read_name(const std::string& name) {
+    shm_read_name = name;
+}
+
+void Application::set_republish(bool value) {
+    republish = value;
+}
+
+void Application::set_latency(bool value) {
+    latency = value;
+}
+
+void Application::set_profile(bool value) {
+    profile = value;
+}
+
+void Application::set_trace_json_path(const std::string& path) {
+    trace_json_path = path;
+}
+
+void Application::set_replay_seq_range(uint64_t first, uint64_t last) {
+    has_seq_range = true;
+    range_first_seq = first;
+    range_last_seq = last;
+}
+
+void Application::set_replay_time_range(uint64_t from_ns, uint64_t to_ns) {
+    has_time_range = true;
+    range_from_ns = from_ns;
+    range_to_ns = to_ns;
+}
+
+static uint64_t monotonic_us() {
+    return clock_monotonic_ns() / 1000;
+}
+
+// Ctrl+C / SIGTERM: the live and
+// download loops finish the packet at
+// hand and stop through finish_run
+static volatile sig_atomic_t stop_requested = 0;
+
+// Longest a live loop waits before it
+// looks at stop_requested again (the
+// signal can land on any thread)
+static const int STOP_CHECK_MS = 200;
+
+static void on_stop_signal(int) {
+    stop_requested = 1;
+}
+
+// No SA_RESTART: a blocked recv()
+// on this thread returns EINTR
+static void install_stop_handler() {
+    struct sigaction action;
+    std::memset(&action, 0, sizeof(action));
+    action.sa_handler = on_stop_signal;
+    sigemptyset(&action.sa_mask);
+    ::sigaction(SIGINT, &action, 0);
+    ::sigaction(SIGTERM, &action, 0);
+}
+
+// State shared by the live, download
+// and gap-fill decode paths.
+struct DecodeContext {
+    const AppConfig* cfg;
+    const DecodePlans* plans;
+    TypeFilter* type_filter;
+
+    // Field value filter on the raw
+    // bytes (null = none)
+    Predicate* predicate;
+    bool verbose;
+    bool lock_output;
+    uint64_t max_messages;
+    uint64_t decoded_count;
+
+    // Last applied position. Below it
+    // in the same session is already
+    // delivered and never decoded again
+    std::string session;
+    uint64_t next_seq;
+    uint64_t duplicate_count;
+
+    // In-band SequenceReset messages
+    // applied (re-based next_seq)
+    uint64_t sequence_resets;
+
+    // Book + periodic snapshot
+    // (null when snapshot is off)
+    OrderBook* book;
+    SnapshotWriter* snapshot_writer;
+    uint64_t next_snapshot_count;
+    uint64_t applied_base;
+    Snapshot snapshot_buffer;
+
+    // A range was skipped unrecovered:
+    // the book is wrong from here on,
+    // no more snapshots of it
+    bool book_dirty;
+
+    // Packet recording (null when off),
+    // exchange time of every message
+    Recorder* recorder;
+    ExchangeClock* clock;
+
+    // Column export replaces
+    // text output when set
+    ColumnExporter* exporter;
+    ShmRingWriter* shm_ring;
+
+    // Gap-free re-send of the stream
+    Republisher* republisher;
+
+    // --latency, and the receive time
+    // of the packet being decoded when
+    // it counts (live, not gap-fill)
+    LatencyStats* latency;
+    uint64_t latency_receive_ns;
+
+    // Flight recorder channel id
+    uint16_t trace_channel;
+
+    // --profile (null when off)
+    StageProfile* profile;
+
+    // Replay slice, inclusive
+    bool has_seq_slice;
+    uint64_t slice_first_seq;
+    uint64_t slice_last_seq;
+    bool has_time_slice;
+    uint64_t slice_from_ns;
+    uint64_t slice_to_ns;
+
+    // Message boundaries of the
+    // packet being decoded
+    MoldBatch batch;
+    uint8_t batch_pass[MOLD_BATCH_CAPACITY];
+
+    // Fields of the message
+    // being delivered
+    DecodedFields fields;
+
+    DecodeContext()
+    : cfg(0),
+      plans(0),
+      type_filter(0),
+      predicate(0),
+      verbose(false),
+      lock_output(false),
+      max_messages(0),
+      decoded_count(0),
+      next_seq(0),
+      duplicate_count(0),
+      sequence_resets(0),
+      book(0),
+      snapshot_writer(0),
+      next_snapshot_count(0),
+      applied_base(0),
+      book_dirty(false),
+      recorder(0),
+      clock(0),
+      exporter(0),
+      shm_ring(0),
+      republisher(0),
+      latency(0),
+      latency_receive_ns(0),
+      trace_channel(0),
+      profile(0),
+      has_seq_slice(false),
+      slice_first_seq(0),
+      slice_last_seq(0),
+      has_time_slice(false),
+      slice_from_ns(0),
+      slice_to_ns(0) {}
+};
+
+// --profile stage boundaries, no
+// counter read when it is off
+static uint64_t stage_start(const DecodeContext& ctx) {
+    return ctx.profile ? profile_now() : 0;
+}
+
+static uint64_t stage_end(DecodeContext& ctx, ProfileStage stage, uint64_t start) {
+    return ctx.profile ? ctx.profile->add(stage, start) : 0;
+}
+
+// Copy book + position and hand it
+// to the writer thread.
+static void submit_snapshot(DecodeContext& ctx) {
+    if (!ctx.book || !ctx.snapshot_writer || ctx.session.empty() || ctx.book_dirty) {
+        return;
+    }
+
+    ctx.book->copy_orders(ctx.snapshot_buffer.orders);
+    ctx.snapshot_buffer.session = ctx.session;
+    ctx.snapshot_buffer.next_sequence = ctx.next_seq;
+    ctx.snapshot_buffer.decoded_count = ctx.applied_base + ctx.decoded_count;
+    ctx.snapshot_writer->submit(ctx.snapshot_buffer);
+}
+
+// Messages [seq, seq + count) never
+// reached the book. The last good
+// snapshot stays on disk, a warm
+// restart from it asks for them again.
+static void mark_book_dirty(DecodeContext& ctx, uint64_t seq, uint64_t count) {
+    if (!ctx.book || ctx.book_dirty) {
+        return;
+    }
+    ctx.book_dirty = true;
+    std::printf(">> WARN: BOOK INCOMPLETE: Sequence=%llu, Count=%llu not recovered, snapshots off\n",
+                (unsigned long long)seq, (unsigned long long)count);
+}
+
+// Final snapshot on a clean stop,
+// waits for the writer to finish.
+static void finish_snapshot(DecodeContext& ctx) {
+    if (!ctx.snapshot_writer) {
+        return;
+    }
+
+    submit_snapshot(ctx);
+    ctx.snapshot_writer->stop();
+}
+
+// Messages seen per type (-v)
+static void print_type_counts(const DecodeContext& ctx) {
+    if (!ctx.verbose) {
+        return;
+    }
+
+    std::printf(">> TYPE COUNTS:");
+    for (int t = 0; t < 256; t++) {
+        uint64_t n = ctx.type_filter->count((uint8_t)t);
+        if (n != 0) {
+            if (t >= 0x20 && t < 0x7F) {
+                std::printf(" %c=%llu", (char)t, (unsigned long long)n);
+            } else {
+                std::printf(" 0x%02X=%llu", t, (unsigned long long)n);
+            }
+        }
+    }
+    std::printf("\n");
+}
+
+static void finish_run(DecodeContext& ctx) {
+    if (ctx.duplicate_count != 0) {
+        std::printf(">> DUPLICATES SKIPPED: Messages=%llu\n", (unsigned long long)ctx.duplicate_count);
+    }
+    if (ctx.sequence_resets != 0) {
+        std::printf(">> SEQUENCE RESETS: Count=%llu\n", (unsigned long long)ctx.sequence_resets);
+    }
+    print_type_counts(ctx);
+    if (ctx.predicate) {
+        ctx.predicate->print_stats();
+    }
+    if (ctx.latency) {
+        ctx.latency->report();
+    }
+    if (ctx.profile) {
+        ctx.profile->report();
+    }
+    finish_snapshot(ctx);
+}
+
+// Load latest snapshot into the book.
+// Returns true if a snapshot was applied.
+static bool warm_start(DecodeContext& ctx, const std::string& path) {
+    Snapshot snapshot;
+    if (!load_snapshot(path, &snapshot)) {
+        return false;
+    }
+
+    for (size_t i = 0; i < snapshot.orders.size(); i++) {
+        ctx.book->insert(snapshot.orders[i]);
+    }
+
+    ctx.session = snapshot.session;
+    ctx.next_seq = snapshot.next_sequence;
+    ctx.applied_base = snapshot.decoded_count;
+
+    std::printf(">> INFO: SNAPSHOT_LOADED Session=%.*s NextSequence=%llu Orders=%llu\n",
+                (int)snapshot.session.size(), snapshot.session.c_str(),
+                (unsigned long long)snapshot.next_sequence,
+                (unsigned long long)snapshot.orders.size());
+    return true;
+}
+
+// Connect to multicast feed, read first valid Mold header
+// return session id for:
+// -s : get session for rerequest packet
+// -g : recovery mode
+static bool get_session_id(const AppConfig& cfg, char session[10],
+                           std::string& session_value) {
+
+    std::memset(session, ' ', 10);
+    session_value.clear();
+
+    Socket sock;
+    if (!sock.connect_socket(cfg.mcast_ip, cfg.mcast_port, cfg.interface_ip, cfg.mcast_source_ip)) {
+        std::printf("Failed to connect multicast socket\n");
+        return false;
+    }
+
+    sock.set_receive_buffer(4 * 1024 * 1024);
+    const int udp_packet_capacity = 64 * 1024;
+    uint8_t buffer[udp_packet_capacity];
+
+    while (!stop_requested) {
+        int bytes = sock.receive_bytes(buffer, udp_packet_capacity);
+        if (bytes <= 0) {
+            continue;
+        }
+
+        MoldHeader header;
+        if (!parse_mold_header(buffer, bytes, &header)) {
+            continue;
+        }
+
+        session_value = header.session;
+
+        std::memset(session, ' ', 10);
+        size_t session_len = header.session.size();
+        if (session_len > 10) {
+            session_len = 10;
+        }
+
+        std::memcpy(session, header.session.data(), session_len);
+
+        sock.close();
+        return true;
+    }
+    return false;
+}
+
+// Receive time for binary outputs,
+// skipped when nothing uses it.
+static uint64_t packet_receive_ns(const DecodeContext& ctx) {
+    if (ctx.recorder || ctx.shm_ring || ctx.latency) {
+        return clock_realtime_ns();
+    }
+    return 0;
+}
+
+// Book, position and second from an
+// old session are no longer valid
+static void enter_session(DecodeContext& ctx, const std::string& session) {
+    if (session != ctx.session) {
+        if (!ctx.session.empty()) {
+            if (ctx.book) {
+                ctx.book->clear();
+            }
+            if (ctx.clock) {
+                ctx.clock->reset();
+            }
+        }
+        ctx.session = session;
+        ctx.next_seq = 0;
+    }
+}
+
+// SequenceReset delivered: the next
+// message is new_seq. Old numbering
+// held downstream is dropped.
+static void apply_sequence_reset(DecodeContext& ctx, const std::string& session,
+                                 uint64_t seq, uint64_t new_seq) {
+    ctx.next_seq = new_seq;
+    ctx.sequence_resets++;
+
+    if (ctx.republisher) {
+        ctx.republisher->sequence_reset(new_seq);
+    }
+
+    std::printf(">> SEQUENCE RESET: Session=%s, Sequence=%llu, NewSequence=%llu\n",
+                session.c_str(), (unsigned long long)seq, (unsigned long long)new_seq);
+}
+
+// Deliver one message to every output.
+// Returns false once the run should stop
+// (-n reached or end of replay slice).
+static bool deliver_message(DecodeContext& ctx, const std::string& session, uint64_t seq,
+                            const uint8_t* msg, uint16_t msg_len,
+                            uint16_t packet_msg_count, uint64_t receive_ns,
+                            bool allow_print) {
+
+    uint64_t stage = stage_start(ctx);
+
+    uint64_t ts = 0;
+    if (ctx.clock) {
+        ts = ctx.clock->update(msg, msg_len);
+    }
+
+    // Replay slice: skip before,
+    // stop once past the end
+    if (ctx.has_seq_slice) {
+        if (seq < ctx.slice_first_seq) {
+            return true;
+        }
+        if (seq > ctx.slice_last_seq) {
+            return false;
+        }
+    }
+
+    if (ctx.has_time_slice) {
+        if (ts < ctx.slice_from_ns) {
+            return true;
+        }
+        if (ts > ctx.slice_to_ns) {
+            return false;
+        }
+    }
+
+    // Decode fields once for
+    // every consumer below
+    DecodedFields& fields = ctx.fields;
+    if (allow_print || ctx.book) {
+        decode_fields(msg, msg_len, *ctx.plans, &fields);
+    }
+    stage = stage_end(ctx, STAGE_DECODE, stage);
+
+    // Recorded as delivered: in order,
+    // gaps filled, duplicates trimmed
+    if (ctx.recorder) {
+        ctx.recorder->write_message(session, seq, msg, msg_len, receive_ns);
+    }
+
+    // Binary outputs replace
+    // the text output
+    if (allow_print) {
+        bool print_text = true;
+
+        if (ctx.exporter) {
+            ctx.exporter->append(msg, msg_len, seq, ts, fields);
+            print_text = false;
+        }
+
+        if (ctx.shm_ring) {
+            ctx.shm_ring->publish(session, seq, receive_ns, ts, msg, msg_len, fields);
+            print_text = false;
+        }
+
+        if (print_text) {
+            // One line is several printf
+            // calls; keep channel threads
+            // from mixing them
+            if (ctx.lock_output) {
+                flockfile(stdout);
+            }
+            const char* exchange_time = ctx.clock ? ctx.clock->format(ts) : 0;
+            print_itch_message(msg, msg_len, fields, session, seq, packet_msg_count,
+                               exchange_time, ctx.verbose);
+            if (ctx.lock_output) {
+                funlockfile(stdout);
+            }
+        }
+    }
+
+    stage = stage_end(ctx, STAGE_OUTPUT, stage);
+
+    // Book sees every message,
+    // not only printed ones
+    if (ctx.book) {
+        ctx.book->apply(msg, msg_len, fields);
+        stage = stage_end(ctx, STAGE_BOOK, stage);
+    }
+
+    if (ctx.republisher) {
+        ctx.republisher->publish(session, seq, msg, msg_len);
+        stage_end(ctx, STAGE_OUTPUT, stage);
+    }
+
+    ctx.next_seq = seq + 1;
+    ctx.decoded_count++;
+
+    if (ctx.latency && ctx.latency_receive_ns != 0 && msg_len != 0) {
+        ctx.latency->record(msg[0], ts, ctx.latency_receive_ns);
+    }
+
+    const AppConfig& cfg = *ctx.cfg;
+    if (msg_len >= cfg.sequence_reset_offset + 8 && msg[0] == cfg.sequence_reset_type) {
+        apply_sequence_reset(ctx, session, seq,
+                             read_field_unsigned(msg + cfg.sequence_reset_offset, UINT64));
+    }
+
+    // Stop after N total messages
+    // on -n
+    if (ctx.max_messages != 0 && ctx.decoded_count >= ctx.max_messages) {
+        return false;
+    }
+    return true;
+}
+
+// Packet level outputs, after a
+// packet or a run of cached messages.
+static void finish_packet(DecodeContext& ctx) {
+    if (ctx.recorder) {
+        ctx.recorder->flush_packet();
+    }
+
+    // One input packet -> send what
+    // we have, keeps added latency low
+    if (ctx.republisher) {
+        ctx.republisher->flush();
+    }
+
+    if (ctx.snapshot_writer && ctx.cfg->snapshot_interval_messages != 0 &&
+        ctx.decoded_count >= ctx.next_snapshot_count) {
+        submit_snapshot(ctx);
+        ctx.next_snapshot_count = ctx.decoded_count + ctx.cfg->snapshot_interval_messages;
+    }
+}
+
+// Heartbeat or end of session from the
+// feed: passed on to --republish with
+// the next sequence it will send
+static void forward_control(DecodeContext& ctx, const MoldHeader& header) {
+    if (!ctx.republisher || mold_data_count(header) != 0) {
+        return;
+    }
+    ctx.republisher->heartbeat(header.session, header.message_count == MOLD_END_OF_SESSION);
+}
+
+// Purpose:
+// Decode a full MoldUDP packet (header + payload (all messages))
+// Used mode:
+// - Live, replay(download) / live + recovery (-g)
+//
+// Funtions:
+// Calls parse_mold_header() to parse Mold header(session, startseq, msgcount)
+// Splits the packet into a MoldBatch (scan_mold_messages), skips the
+// part already delivered, runs the type filter on the batch
+// Calls deliver_message() for each message left, finish_packet() at the end
+// Returns messages decoded
+static uint16_t decode_packet_messages(const uint8_t* buffer, int bytes, uint64_t receive_ns,
+                                      DecodeContext& ctx, bool& stop_now) {
+
+    stop_now = false;
+    uint64_t stage = stage_start(ctx);
+
+    MoldHeader header;
+    if (!parse_mold_header(buffer, bytes, &header)) {
+        return 0;
+    }
+
+    enter_session(ctx, header.session);
+    stage = stage_end(ctx, STAGE_HEADER, stage);
+
+    int offset = 10 + 8 + 2;
+    uint16_t remaining = mold_data_count(header);
+    uint64_t seq = header.sequence_number;
+    uint64_t decoded_before = ctx.decoded_count;
+
+    // Split the packet first, then
+    // deliver from the batch
+    while (remaining > 0 && !stop_now) {
+        MoldBatch& batch = ctx.batch;
+        uint16_t found = scan_mold_messages(buffer, bytes, seq, &offset, &remaining, &batch);
+        if (found == 0) {
+            break;
+        }
+        seq += found;
+
+        // Overlap with what was delivered
+        // (A/B copy, recovery reply): only
+        // the new suffix goes on
+        uint16_t first = 0;
+        while (first < found && batch.refs[first].sequence < ctx.next_seq) {
+            first++;
+        }
+        ctx.duplicate_count += first;
+        stage = stage_end(ctx, STAGE_SPLIT, stage);
+        if (first == found) {
+            continue;
+        }
+
+        // Print filter by message type,
+        // whole batch at once
+        ctx.type_filter->run(batch.types + first, found - first, ctx.batch_pass + first);
+        stage = stage_end(ctx, STAGE_FILTER, stage);
+
+        uint64_t resets = ctx.sequence_resets;
+
+        for (uint16_t i = first; i < found; i++) {
+            const MoldMessageRef& ref = batch.refs[i];
+            ITCH_PROBE3(message, ref.sequence, batch.types[i], ref.length);
+
+            // Value filter before any decode,
+            // only on what the type let through
+            bool allow_print = ctx.batch_pass[i] != 0;
+            if (allow_print && ctx.predicate) {
+                allow_print = ctx.predicate->match(buffer + ref.offset, ref.length);
+                stage_end(ctx, STAGE_FILTER, stage);
+            }
+
+            if (!deliver_message(ctx, header.session, ref.sequence, buffer + ref.offset, ref.length,
+                                 (uint16_t)header.message_count, receive_ns, allow_print)) {
+                stop_now = true;
+                break;
+            }
+            stage = stage_start(ctx);
+
+            // Rest of the packet follows
+            // the new numbering
+            if (ctx.sequence_resets != resets) {
+                resets = ctx.sequence_resets;
+                for (uint16_t j = i + 1; j < found; j++) {
+                    batch.refs[j].sequence = ctx.next_seq + (j - i - 1);
+                }
+                seq = ctx.next_seq + (found - i - 1);
+            }
+        }
+    }
+
+    stage = stage_start(ctx);
+    finish_packet(ctx);
+    forward_control(ctx, header);
+    stage_end(ctx, STAGE_FLUSH, stage);
+
+    uint16_t decoded = (uint16_t)(ctx.decoded_count - decoded_before);
+    ITCH_PROBE2(packet_decoded, header.sequence_number, decoded);
+    return decoded;
+}
+
+// Rerequester limits from config
+static RecoveryTuning recovery_tuning(const AppConfig& cfg) {
+    RecoveryTuning tuning;
+    tuning.initial_timeout_us = cfg.recovery_initial_timeout_ms * 1000;
+    tuning.min_timeout_us = cfg.recovery_min_timeout_ms * 1000;
+    tuning.max_timeout_us = cfg.recovery_max_timeout_ms * 1000;
+    tuning.max_requests_per_second = cfg.recovery_max_requests_per_second;
+    tuning.min_request_count = cfg.min_recovery_message_count;
+    tuning.max_request_count = cfg.max_recovery_message_count;
+    return tuning;
+}
+
+// --latency settings from config
+static LatencySettings latency_settings(const AppConfig& cfg, bool measure_decode) {
+    LatencySettings settings;
+    settings.clock_offset_ns = cfg.latency_clock_offset_ns;
+    settings.report_interval_ns = cfg.latency_report_interval_ms * 1000000ULL;
+    settings.measure_decode = measure_decode;
+    return settings;
+}
+
+static void print_recovery_stats(const Rerequester& rr, uint64_t recovered, uint64_t elapsed_us) {
+    const RecoveryStats& stats = rr.stats();
+
+    uint64_t rtt_avg = 0;
+    if (stats.rtt_samples != 0) {
+        rtt_avg = stats.rtt_total_us / stats.rtt_samples;
+    }
+
+    uint64_t rate = 0;
+    if (elapsed_us != 0) {
+        rate = recovered * 1000000ULL / elapsed_us;
+    }
+
+    std::printf(">> RECOVERY STATS: Requests=%llu, Timeouts=%llu, RTT(us) Last=%llu Avg=%llu Min=%llu Max=%llu, "
+                "Timeout(us)=%d, RequestSize=%u, Throughput=%llu msg/s\n",
+                (unsigned long long)stats.requests,
+                (unsigned long long)stats.timeouts,
+                (unsigned long long)stats.last_rtt_us,
+                (unsigned long long)rtt_avg,
+                (unsigned long long)stats.rtt_min_us,
+                (unsigned long long)stats.rtt_max_us,
+                rr.timeout_us(),
+                (unsigned)rr.request_size(0xFFFF),
+                (unsigned long long)rate);
+}
+
+// Request one chunk from start_seq and
+// decode replies until it is complete or
+// replies stop. A chunk with no reply at
+// all is re-sent up to max_retries times.
+// Returns false if the request can't be sent.
+static bool request_chunk(Rerequester& rr, const char session[10],
+                          uint64_t start_seq, uint64_t remaining,
+                          DecodeContext& ctx, uint64_t& got, bool& stop_now) {
+
+    const int udp_packet_capacity = 64 * 1024;
+    uint8_t rxbuf[udp_packet_capacity];
+
+    got = 0;
+
+    for (int attempt = 0; attempt <= ctx.cfg->recovery_max_retries; attempt++) {
+        uint16_t req_count = rr.request_size(remaining);
+
+        if (!rr.send_request(session, start_seq, req_count)) {
+            std::printf(">> ERROR : Recovery Request Send  Failed Sequence=%llu, Count=%u\n",
+                        (unsigned long long)start_seq, (unsigned)req_count);
+            return false;
+        }
+        trace_event(TRACE_REQUEST, ctx.trace_channel, start_seq, req_count, (uint32_t)attempt + 1, 0);
+
+        while (got < (uint64_t)req_count) {
+            int recv_bytes = rr.receive_packet(rxbuf, udp_packet_capacity);
+            if (recv_bytes == 0) {
+                break;
+            }
+            if (recv_bytes < 0) {
+                std::printf("Recovery recv error errno=%d\n", errno);
+                break;
+            }
+
+            uint64_t receive_ns = packet_receive_ns(ctx);
+            uint16_t processed = decode_packet_messages(rxbuf, recv_bytes, receive_ns, ctx, stop_now);
+            got += (uint64_t)processed;
+
+            MoldHeader reply;
+            if (parse_mold_header(rxbuf, recv_bytes, &reply)) {
+                trace_event(TRACE_REPLY, ctx.trace_channel, reply.sequence_number, processed, 0, receive_ns);
+            }
+
+            if (stop_now) {
+                return true;
+            }
+        }
+
+        rr.chunk_done(req_count, got);
+
+        if (got != 0) {
+            return true;
+        }
+
+        std::printf("Recovery timeout seq=%llu req=%u attempt=%d timeout_us=%d\n",
+                    (unsigned long long)start_seq,
+                    (unsigned)req_count,
+                    attempt + 1,
+                    rr.timeout_us());
+        trace_event(TRACE_REQUEST_TIMEOUT, ctx.trace_channel, start_seq, req_count, (uint32_t)attempt + 1, 0);
+    }
+
+    // Retries used up: what led
+    // here goes to a dump
+    trace_event(TRACE_STALL, ctx.trace_channel, start_seq, 0, 0, 0);
+    trace_dump(TRACE_DUMP_STALL);
+    return true;
+}
+
+// Gap-fill (Recover)
+static uint64_t gap_fill(Rerequester& rr, const char session[10],
+                         uint64_t start_seq, uint64_t gap_count,
+                         DecodeContext& ctx, bool& stop_now) {
+
+    uint64_t recovered = 0;
+    uint64_t current_seq = start_seq;
+    uint64_t remaining = gap_count;
+
+    while (remaining > 0) {
+        uint64_t got_in_chunk = 0;
+
+        if (!request_chunk(rr, session, current_seq, remaining, ctx, got_in_chunk, stop_now)) {
+            break;
+        }
+
+        recovered += got_in_chunk;
+
+        if (stop_now || got_in_chunk == 0) {
+            break;
+        }
+
+        current_seq += got_in_chunk;
+
+        if (got_in_chunk >= remaining) {
+            remaining = 0;
+        } else {
+            remaining -= got_in_chunk;
+        }
+    }
+
+    return recovered;
+}
+
+// Hold a packet's messages in the cache.
+// Returns how many of them fill
+// [gap_from, gap_to) for the first time.
+static uint64_t cache_packet(MessageCache& cache, const uint8_t* buffer, int bytes,
+                             const MoldHeader& header, uint64_t gap_from, uint64_t gap_to) {
+
+    int offset = 10 + 8 + 2;
+    uint16_t remaining = (uint16_t)header.message_count;
+    uint16_t index = 0;
+    const uint8_t* msg = 0;
+    uint16_t msg_len = 0;
+    uint64_t filled = 0;
+
+    while (next_mold_message(buffer, bytes, &offset, &remaining, &msg, &msg_len)) {
+        uint64_t seq = header.sequence_number + (uint64_t)index;
+        index++;
+
+        if (seq >= gap_from && seq < gap_to && !cache.contains(seq)) {
+            filled++;
+        }
+        cache.store(header.session, seq, msg, msg_len);
+    }
+
+    return filled;
+}
+
+// Gap seen on a live packet:
+// 1. hold it, wait up to the reorder window
+//    for late packets (also held)
+// 2. deliver everything in order from the
+//    cache, rerequest only the sub-ranges
+//    still missing
+// Returns the next expected sequence
+// (re-based if a reset came in the gap).
+static uint64_t recover_gap(Socket& sock, Rerequester& rr, MessageCache& cache,
+                            const uint8_t* packet, int packet_len, const MoldHeader& header,
+                            uint64_t expected_seq, DecodeContext& ctx, bool& stop_now) {
+
+    stop_now = false;
+
+    uint64_t gap_from = expected_seq;
+    uint64_t gap_to = header.sequence_number;
+    uint64_t held_end = header.sequence_number + (uint64_t)header.message_count;
+    uint64_t receive_ns = packet_receive_ns(ctx);
+
+    uint64_t missing = gap_to - gap_from;
+    missing -= cache_packet(cache, packet, packet_len, header, gap_from, gap_to);
+
+    // Waiting only helps if the
+    // gap fits in the cache
+    int window_us = ctx.cfg->reorder_window_us;
+    if (window_us > 0 && missing > 0 && missing < ctx.cfg->recovery_cache_messages) {
+        const int late_capacity = 64 * 1024;
+        uint8_t late[late_capacity];
+        uint64_t deadline = monotonic_us() + (uint64_t)window_us;
+
+        while (missing > 0) {
+            uint64_t now = monotonic_us();
+            if (now >= deadline) {
+                break;
+            }
+
+            int bytes = sock.receive_bytes_timeout(late, late_capacity, (int)(deadline - now));
+            if (bytes == 0) {
+                break;
+            }
+            if (bytes < 0) {
+                continue;
+            }
+
+            MoldHeader late_header;
+            if (!parse_mold_header(late, bytes, &late_header) ||
+                late_header.session != header.session ||
+                late_header.message_count == 0 ||
+                late_header.message_count == 0xFFFF) {
+                continue;
+            }
+
+            missing -= cache_packet(cache, late, bytes, late_header, gap_from, gap_to);
+
+            uint64_t late_end = late_header.sequence_number + late_header.message_count;
+            if (late_end > held_end) {
+                held_end = late_end;
+            }
+        }
+    }
+
+    char session[10];
+    std::memset(session, ' ', 10);
+    size_t session_length = header.session.size();
+    if (session_length > 10) {
+        session_length = 10;
+    }
+    std::memcpy(session, header.session.data(), session_length);
+
+    uint64_t from_cache = 0;
+    uint64_t recovered = 0;
+    uint64_t seq = gap_from;
+    uint64_t started_us = monotonic_us();
+    rr.reset_stats();
+
+    enter_session(ctx, header.session);
+    uint64_t resets = ctx.sequence_resets;
+
+    // A reset inside the gap ends it:
+    // the rest is old numbering
+    while (seq < held_end && ctx.sequence_resets == resets) {
+        const uint8_t* msg = 0;
+        uint16_t msg_len = 0;
+
+        // A reply ran past its range:
+        // that part is already delivered
+        if (seq < ctx.next_seq) {
+            ctx.duplicate_count += (held_end < ctx.next_seq ? held_end : ctx.next_seq) - seq;
+            seq = ctx.next_seq;
+            continue;
+        }
+
+        if (cache.get(seq, &msg, &msg_len)) {
+            if (seq < gap_to) {
+                from_cache++;
+            }
+
+            bool allow_print = ctx.type_filter->pass_one(msg_len != 0 ? msg[0] : 0);
+            if (allow_print && ctx.predicate) {
+                allow_print = ctx.predicate->match(msg, msg_len);
+            }
+
+            if (!deliver_message(ctx, header.session, seq, msg, msg_len,
+                                 (uint16_t)header.message_count, receive_ns, allow_print)) {
+                stop_now = true;
+                break;
+            }
+            seq++;
+            continue;
+        }
+
+        // Missing sub-range [seq, run_end)
+        uint64_t run_end = seq + 1;
+        while (run_end < held_end && !cache.contains(run_end)) {
+            run_end++;
+        }
+
+        finish_packet(ctx);
+        std::printf(">> Start recovering ... SequenceNumber=%llu, Count=%llu\n",
+                    (unsigned long long)seq, (unsigned long long)(run_end - seq));
+
+        recovered += gap_fill(rr, session, seq, run_end - seq, ctx, stop_now);
+        if (stop_now) {
+            break;
+        }
+
+        // Best-effort: move past what
+        // the rerequester could not give
+        if (ctx.next_seq < run_end && ctx.sequence_resets == resets) {
+            uint64_t from = ctx.next_seq > seq ? ctx.next_seq : seq;
+            mark_book_dirty(ctx, from, run_end - from);
+        }
+        seq = run_end;
+    }
+
+    finish_packet(ctx);
+
+    std::printf(">> RECOVERED: SequenceNumber=%llu, TotalRecovered=%llu, FromCache=%llu\n",
+                (unsigned long long)gap_from,
+                (unsigned long long)(recovered + from_cache),
+                (unsigned long long)from_cache);
+
+    if (rr.stats().requests != 0) {
+        print_recovery_stats(rr, recovered, monotonic_us() - started_us);
+    }
+
+    if (ctx.sequence_resets != resets) {
+        return ctx.next_seq;
+    }
+    return held_end;
+}
+
+// Replay a recording, seeking via the
+// sparse index to the requested
+// sequence or time slice.
+static int replay_recording(const std::string& path, DecodeContext& ctx) {
+    std::vector<IndexEntry> index;
+    if (!load_index(path, *ctx.cfg, ctx.cfg->index_interval_messages, index)) {
+        std::printf("Error: failed to read recording %s\n", path.c_str());
+        return 1;
+    }
+
+    const IndexEntry* start = 0;
+    if (ctx.has_seq_slice) {
+        start = find_by_sequence(index, ctx.slice_first_seq);
+    }
+    else if (ctx.has_time_slice) {
+        start = find_by_timestamp(index, ctx.slice_from_ns);
+    }
+
+    RecordReader reader;
+    if (!reader.open(path)) {
+        std::printf("Error: failed to open recording %s\n", path.c_str());
+        return 1;
+    }
+
+    if (start) {
+        reader.seek(start->file_offset);
+
+        // Seconds state is lost by the seek,
+        // entry time carries it
+        if (ctx.clock) {
+            ctx.clock->set_seconds(start->timestamp_ns / 1000000000ULL);
+        }
+
+        std::printf(">> INFO: Seek Sequence=%llu Offset=%llu\n",
+                    (unsigned long long)start->sequence,
+                    (unsigned long long)start->file_offset);
+    }
+
+    const int buffer_capacity = 64 * 1024;
+    std::vector<uint8_t> buffer(buffer_capacity);
+    uint64_t started_us = monotonic_us();
+
+    while (1) {
+        uint64_t stage = stage_start(ctx);
+        uint64_t receive_ns = 0;
+        int bytes = reader.next_packet(&buffer[0], buffer_capacity, &receive_ns);
+        if (bytes == 0) {
+            break;
+        }
+        if (bytes < 0) {
+            std::printf("Error: corrupt recording %s\n", path.c_str());
+            return 1;
+        }
+        stage_end(ctx, STAGE_RECV, stage);
+        uint64_t decoded_before = ctx.decoded_count;
+
+        // Recorded receive time
+        ctx.latency_receive_ns = receive_ns;
+
+        bool stop_now = false;
+        decode_packet_messages(&buffer[0], bytes, receive_ns, ctx, stop_now);
+
+        if (ctx.profile) {
+            ctx.profile->count(1, ctx.decoded_count - decoded_before);
+            ctx.profile->tick();
+        }
+
+        if (stop_now) {
+            break;
+        }
+    }
+    ctx.latency_receive_ns = 0;
+
+    uint64_t elapsed_us = monotonic_us() - started_us;
+    uint64_t rate = 0;
+    if (elapsed_us != 0) {
+        rate = ctx.decoded_count * 1000000ULL / elapsed_us;
+    }
+
+    print_type_counts(ctx);
+    if (ctx.predicate) {
+        ctx.predicate->print_stats();
+    }
+    if (ctx.latency) {
+        ctx.latency->report();
+    }
+    if (ctx.profile) {
+        ctx.profile->report();
+    }
+    std::printf(">> REPLAY DONE: Total Decoded=%llu, Elapsed(us)=%llu, Rate=%llu msg/s\n",
+                (unsigned long long)ctx.decoded_count,
+                (unsigned long long)elapsed_us,
+                (unsigned long long)rate);
+    return 0;
+}
+
+// Print one normalized record,
+// numeric fields already host order.
+static void print_normalized(const NormalizedRecord& record, const AppConfig& cfg) {
+    std::printf(">> {'%.*s', %llu, %llu, %llu",
+                (int)sizeof(record.session), record.session,
+                (unsigned long long)record.sequence,
+                (unsigned long long)record.receive_ns,
+                (unsigned long long)record.exchange_ns);
+
+    const TypePlan& type = cfg.plans.types[(unsigned char)record.msg_type];
+    if (!type.defined) {
+        std::printf(", 'Unknown(type=%c)'}\n", record.msg_type);
+        return;
+    }
+
+    const PlanField* plan = plan_fields(cfg.plans, &type);
+
+    for (uint16_t i = 0; i < type.field_count; i++) {
+        const PlanField& field = plan[i];
+        if (field.offset + field.size > sizeof(record.data) || field.offset + field.size > record.msg_len) {
+            break;
+        }
+
+        const uint8_t* data = record.data + field.offset;
+
+        switch ((FieldType)field.type) {
+            case UINT16: { uint16_t v; std::memcpy(&v, data, 2); std::printf(", '%u'", (unsigned)v); break; }
+            case UINT32: { uint32_t v; std::memcpy(&v, data, 4); std::printf(", '%u'", (unsigned)v); break; }
+            case UINT64: { uint64_t v; std::memcpy(&v, data, 8); std::printf(", '%llu'", (unsigned long long)v); break; }
+            case INT16:  { int16_t v;  std::memcpy(&v, data, 2); std::printf(", '%d'", (int)v); break; }
+            case INT32:  { int32_t v;  std::memcpy(&v, data, 4); std::printf(", '%d'", (int)v); break; }
+            case INT64:  { int64_t v;  std::memcpy(&v, data, 8); std::printf(", '%lld'", (long long)v); break; }
+            case UINT8:  std::printf(", '%u'", (unsigned)data[0]); break;
+            case CHAR:   std::printf(", '%c'", (char)data[0]); break;
+            default:     std::printf(", '%.*s'", (int)field.size, (const char*)data); break;
+        }
+    }
+    std::printf("}\n");
+}
+
+// Consume a --shm ring published
+// by another instance.
+static int read_shm_ring(const std::string& name, const AppConfig& cfg, uint64_t max_messages) {
+    ShmRingReader reader;
+    if (!reader.open(name)) {
+        std::printf("Error: failed to attach shm ring %s\n", name.c_str());
+        return 1;
+    }
+
+    std::printf("Attached shm ring %s (Ctrl+C to stop)\n", name.c_str());
+
+    // Spin briefly for low latency, then
+    // sleep. An idle ring is checked for
+    // a stopped or restarted writer.
+    const int empty_spins = 1000;
+    const int empty_sleep_us = 1000;
+    const uint64_t writer_check_us = 100000;
+
+    uint64_t read_count = 0;
+    NormalizedRecord record;
+    int empty_polls = 0;
+    uint64_t next_check_us = monotonic_us() + writer_check_us;
+
+    while (max_messages == 0 || read_count < max_messages) {
+        uint64_t skipped = 0;
+        ShmReadResult result = reader.read(&record, &skipped);
+
+        if (result == SHM_READ_EMPTY) {
+            if (empty_polls < empty_spins) {
+                empty_polls++;
+                sched_yield();
+                continue;
+            }
+            ::usleep(empty_sleep_us);
+
+            uint64_t now_us = monotonic_us();
+            if (now_us < next_check_us) {
+                continue;
+            }
+            next_check_us = now_us + writer_check_us;
+
+            if (!reader.stale()) {
+                continue;
+            }
+
+            // Follow the name: the ring a
+            // restarted writer creates is
+            // read from its oldest record.
+            // A crashed writer's ring stays
+            // under the name until then.
+            std::printf(">> SHM RING GONE: %s, waiting for a writer\n", name.c_str());
+            while (!reader.open(name) || reader.stale()) {
+                ::usleep((useconds_t)writer_check_us);
+            }
+            reader.rewind();
+            std::printf("Attached shm ring %s\n", name.c_str());
+            continue;
+        }
+        empty_polls = 0;
+
+        if (result == SHM_READ_LAPPED) {
+            std::printf(">> LAPPED: Skipped=%llu\n", (unsigned long long)skipped);
+            continue;
+        }
+
+        print_normalized(record, cfg);
+        read_count++;
+    }
+
+    return 0;
+}
+
+// Idle watchdog actions and the time
+// from detection to the next packet
+struct WatchdogCounters {
+    uint64_t idle_events;
+    uint64_t rejoins;
+    uint64_t failovers;
+    uint64_t recoveries;
+    uint64_t recover_total_us;
+    uint64_t recover_max_us;
+
+    WatchdogCounters()
+    : idle_events(0), rejoins(0), failovers(0), recoveries(0),
+      recover_total_us(0), recover_max_us(0) {}
+};
+
+// One live feed: socket, sequence
+// tracking and recovery state.
+struct LiveChannel {
+    ChannelConfig config;
+    DecodeContext* ctx;
+    bool enable_recovery;
+
+    Socket sock;
+    Rerequester rr;
+    bool rr_open;
+
+    // Late / out of order packets held
+    // while a gap is open
+    MessageCache retransmit_cache;
+
+    // Joined/Live/Recovering/Ended
+    SessionTracker tracker;
+
+    uint64_t packets;
+    uint64_t gap_messages;
+
+    // Idle watchdog
+    uint64_t last_packet_us;
+    uint64_t idle_detected_us;  // 0 = feed flowing
+    int idle_actions;
+    bool on_alternate;
+    WatchdogCounters watchdog;
+
+    LiveChannel()
+    : ctx(0),
+      enable_recovery(false),
+      rr_open(false),
+      packets(0),
+      gap_messages(0),
+      last_packet_us(0),
+      idle_detected_us(0),
+      idle_actions(0),
+      on_alternate(false) {}
+};
+
+// Join on the primary or the
+// alternate interface / source
+static bool join_channel(LiveChannel& ch, bool alternate) {
+    const ChannelConfig& c = ch.config;
+
+    const std::string& interface_ip = (alternate && !c.alternate_interface_ip.empty())
+                                      ? c.alternate_interface_ip : c.interface_ip;
+    const std::string& source_ip = (alternate && !c.alternate_source_ip.empty())
+                                   ? c.alternate_source_ip : c.mcast_source_ip;
+
+    if (!ch.sock.connect_socket(c.mcast_ip, c.mcast_port, interface_ip, source_ip)) {
+        return false;
+    }
+    ch.sock.set_receive_buffer(4 * 1024 * 1024);
+    ch.sock.set_receive_timeout(STOP_CHECK_MS);
+    return true;
+}
+
+// Join the group, open rerequester
+// only if enable_recovery
+static bool open_channel(LiveChannel& ch) {
+    const AppConfig& cfg = *ch.ctx->cfg;
+    ch.ctx->trace_channel = trace_channel(ch.config.name);
+
+    // Receive time from the kernel,
+    // not when we got to the packet
+    if (ch.ctx->latency && cfg.latency_kernel_timestamps &&
+        !ch.sock.set_receive_timestamps(true)) {
+        std::printf(">> WARN: SO_TIMESTAMPNS unavailable, receive time taken after recv\n");
+    }
+
+    if (!join_channel(ch, false)) {
+        std::printf("Failed to connect socket\n");
+        return false;
+    }
+    ch.last_packet_us = monotonic_us();
+
+    if (!ch.enable_recovery) {
+        return true;
+    }
+
+    if (ch.config.mcast_rerequester_ip.empty() || ch.config.mcast_rerequester_port == 0) {
+        std::printf("Error: rerequester IP/Port not set in the config\n");
+        ch.sock.close();
+        return false;
+    }
+
+    int receive_buffer_bytes = 4 * 1024 * 1024;
+
+    if (!ch.rr.open(ch.config.mcast_rerequester_ip, ch.config.mcast_rerequester_port,
+                    receive_buffer_bytes)) {
+        std::printf("Error: failed to open rerequester socket\n");
+        ch.sock.close();
+        return false;
+    }
+    ch.rr.set_tuning(recovery_tuning(cfg));
+    ch.rr_open = true;
+
+    ch.retransmit_cache.init(cfg.recovery_cache_messages, cfg.recovery_cache_bytes);
+    return true;
+}
+
+static void close_channel(LiveChannel& ch) {
+    if (ch.rr_open) {
+        ch.rr.close();
+        ch.rr_open = false;
+    }
+    ch.sock.close();
+}
+
+// No packet or heartbeat for the idle
+// period. First a re-join on a fresh
+// socket, then each further period the
+// other line if one is configured. A
+// gap is filled from the next packet.
+// Returns true if the socket changed.
+static bool channel_watchdog(LiveChannel& ch, uint64_t now_us) {
+    int idle_ms = ch.ctx->cfg->watchdog_idle_ms;
+
+    // Ended session is quiet on purpose
+    if (idle_ms <= 0 || ch.tracker.state() == SESSION_ENDED) {
+        return false;
+    }
+    if (now_us - ch.last_packet_us < (uint64_t)idle_ms * 1000) {
+        return false;
+    }
+
+    if (ch.idle_detected_us == 0) {
+        ch.idle_detected_us = now_us;
+        ch.watchdog.idle_events++;
+        std::printf(">> WATCHDOG: Channel=%s idle for %d ms, State=%s, ExpectedSequence=%llu\n",
+                    ch.config.name.c_str(), idle_ms, ch.tracker.state_name(),
+                    (unsigned long long)ch.tracker.expected());
+
+        trace_event(TRACE_STALL, ch.ctx->trace_channel, ch.tracker.expected(), 0, (uint32_t)idle_ms, 0);
+        trace_dump(TRACE_DUMP_STALL);
+    }
+
+    const ChannelConfig& c = ch.config;
+    bool has_alternate = !c.alternate_interface_ip.empty() || !c.alternate_source_ip.empty();
+    bool failover = has_alternate && ch.idle_actions > 0;
+    bool alternate = failover ? !ch.on_alternate : ch.on_alternate;
+
+    // Next action one period from now
+    ch.idle_actions++;
+    ch.last_packet_us = now_us;
+
+    if (!join_channel(ch, alternate)) {
+        std::printf(">> WATCHDOG: Channel=%s %s failed, retry in %d ms\n",
+                    c.name.c_str(), failover ? "failover" : "re-join", idle_ms);
+        return true;
+    }
+    ch.on_alternate = alternate;
+
+    if (failover) {
+        ch.watchdog.failovers++;
+    } else {
+        ch.watchdog.rejoins++;
+    }
+    std::printf(">> WATCHDOG: Channel=%s %s on %s line\n", c.name.c_str(),
+                failover ? "failover" : "re-join", alternate ? "alternate" : "primary");
+    return true;
+}
+
+// Packet arrived: close out an
+// idle period if one was open
+static void channel_alive(LiveChannel& ch) {
+    uint64_t now_us = monotonic_us();
+    ch.last_packet_us = now_us;
+
+    if (ch.idle_detected_us == 0) {
+        return;
+    }
+
+    uint64_t recover_us = now_us - ch.idle_detected_us;
+    WatchdogCounters& wd = ch.watchdog;
+    wd.recoveries++;
+    wd.recover_total_us += recover_us;
+    if (recover_us > wd.recover_max_us) {
+        wd.recover_max_us = recover_us;
+    }
+
+    std::printf(">> WATCHDOG RECOVERED: Channel=%s, DetectToRecover(us)=%llu, Actions=%d, Line=%s\n",
+                ch.config.name.c_str(), (unsigned long long)recover_us, ch.idle_actions,
+                ch.on_alternate ? "alternate" : "primary");
+
+    ch.idle_detected_us = 0;
+    ch.idle_actions = 0;
+}
+
+// Blocking receive, woken each idle
+// period to run the watchdog when on,
+// and at least every STOP_CHECK_MS
+static int channel_receive(LiveChannel& ch, uint8_t* buffer, int buffer_capacity) {
+    int idle_ms = ch.ctx->cfg->watchdog_idle_ms;
+    if (idle_ms <= 0) {
+        return ch.sock.receive_bytes(buffer, buffer_capacity);
+    }
+
+    uint64_t now_us = monotonic_us();
+    channel_watchdog(ch, now_us);
+
+    uint64_t deadline_us = ch.last_packet_us + (uint64_t)idle_ms * 1000;
+    int wait_us = deadline_us > now_us ? (int)(deadline_us - now_us) : 1000;
+    if (wait_us > STOP_CHECK_MS * 1000) {
+        wait_us = STOP_CHECK_MS * 1000;
+    }
+
+    // Re-join failed, nothing to poll
+    if (ch.sock.handle() < 0) {
+        ::usleep(wait_us);
+        return 0;
+    }
+    return ch.sock.receive_bytes_timeout(buffer, buffer_capacity, wait_us);
+}
+
+static void print_watchdog_stats(const LiveChannel& ch) {
+    const WatchdogCounters& wd = ch.watchdog;
+    if (wd.idle_events == 0) {
+        return;
+    }
+
+    std::printf(">> WATCHDOG STATS: Channel=%s, IdleEvents=%llu, Rejoins=%llu, Failovers=%llu, "
+                "Recovered=%llu, DetectToRecover(us) Avg=%llu Max=%llu\n",
+                ch.config.name.c_str(),
+                (unsigned long long)wd.idle_events,
+                (unsigned long long)wd.rejoins,
+                (unsigned long long)wd.failovers,
+                (unsigned long long)wd.recoveries,
+                (unsigned long long)(wd.recoveries ? wd.recover_total_us / wd.recoveries : 0),
+                (unsigned long long)wd.recover_max_us);
+}
+
+// Decoder applied a SequenceReset:
+// re-base the tracker, held messages
+// are from the old numbering
+static void channel_sequence_reset(LiveChannel& ch, uint64_t resets_before) {
+    if (!ch.rr_open || ch.ctx->sequence_resets == resets_before) {
+        return;
+    }
+    ch.tracker.rebase(ch.ctx->next_seq);
+    ch.retransmit_cache.clear();
+}
+
+// Packet done: counts for --profile
+// and its periodic table
+static void channel_profile(DecodeContext& ctx, uint64_t decoded_before) {
+    if (!ctx.profile) {
+        return;
+    }
+    ctx.profile->count(1, ctx.decoded_count - decoded_before);
+    ctx.profile->tick();
+}
+
+// One packet off the channel socket:
+// gap check, gap-fill, decode. Returns
+// false once the channel should stop.
+static bool channel_packet(LiveChannel& ch, const uint8_t* buffer, int bytes) {
+    DecodeContext& ctx = *ch.ctx;
+
+    if (ctx.cfg->watchdog_idle_ms > 0) {
+        channel_alive(ch);
+    }
+
+    uint64_t stage = stage_start(ctx);
+    uint64_t receive_ns = ch.sock.last_receive_ns();
+    if (receive_ns == 0) {
+        receive_ns = packet_receive_ns(ctx);
+    }
+    ch.packets++;
+
+    MoldHeader header;
+    if (!parse_mold_header(buffer, bytes, &header)) {
+        return true;
+    }
+    trace_event(TRACE_PACKET, ctx.trace_channel, header.sequence_number, header.message_count, 0, receive_ns);
+    stage = stage_end(ctx, STAGE_HEADER, stage);
+
+    uint64_t resets = ctx.sequence_resets;
+    uint64_t decoded_before = ctx.decoded_count;
+
+    // Gap/Duplicate/SessionChange,
+    // heartbeat tail gap, end of session
+    if (ch.rr_open) {
+        PacketAction action = ch.tracker.on_packet(header);
+        stage_end(ctx, STAGE_HEADER, stage);
+
+        if (action == PACKET_SKIP) {
+            channel_profile(ctx, decoded_before);
+            return true;
+        }
+
+        // Gap-fill, this packet is
+        // delivered by recover_gap
+        if (action == PACKET_RECOVER) {
+            uint64_t gap_from = ch.tracker.expected();
+            ch.gap_messages += header.sequence_number - gap_from;
+            trace_event(TRACE_GAP, ctx.trace_channel, gap_from,
+                        (uint32_t)(header.sequence_number - gap_from), 0, 0);
+
+            MoldHeader held = header;
+            held.message_count = mold_data_count(header);
+
+            bool gap_stop_now = false;
+            uint64_t next_seq = recover_gap(ch.sock, ch.rr, ch.retransmit_cache, buffer, bytes, held,
+                                            gap_from, ctx, gap_stop_now);
+            ch.tracker.recovered(next_seq);
+            channel_sequence_reset(ch, resets);
+
+            // Gap seen on a heartbeat or
+            // end of session: passed on once
+            // the gap is filled
+            forward_control(ctx, header);
+
+            // Dumped after the gap-fill,
+            // so its requests are in it
+            trace_dump(TRACE_DUMP_GAP);
+            channel_profile(ctx, decoded_before);
+            return !gap_stop_now;
+        }
+    }
+
+    // Decode the packet's message
+    bool stop_now = false;
+    uint64_t decode_start_ns = clock_realtime_ns();
+    ctx.latency_receive_ns = receive_ns;
+    uint16_t decoded = decode_packet_messages(buffer, bytes, receive_ns, ctx, stop_now);
+    ctx.latency_receive_ns = 0;
+    trace_event(TRACE_DECODE, ctx.trace_channel, header.sequence_number, decoded,
+                (uint32_t)(clock_realtime_ns() - decode_start_ns), decode_start_ns);
+    channel_sequence_reset(ch, resets);
+
+    if (ctx.latency) {
+        ctx.latency->tick(receive_ns);
+    }
+    channel_profile(ctx, decoded_before);
+
+    return !stop_now;
+}
+
+// Own decode state of one channel
+// when several share the process
+struct ChannelWorker {
+    LiveChannel live;
+    DecodeContext ctx;
+    TypeFilter type_filter;
+    Predicate predicate;
+    ExchangeClock clock;
+    LatencyStats latency;
+    StageProfile profile;
+    bool stopped;
+    std::thread thread;
+
+    ChannelWorker() : stopped(false) {}
+};
+
+static void channel_thread(ChannelWorker* worker) {
+    const int buffer_capacity = 64 * 1024;
+    uint8_t buffer[buffer_capacity];
+
+    trace_thread(worker->live.config.name);
+
+    while (!worker->stopped && !stop_requested) {
+        uint64_t stage = stage_start(worker->ctx);
+        int bytes = channel_receive(worker->live, buffer, buffer_capacity);
+        if (bytes <= 0) {
+            continue;
+        }
+        stage_end(worker->ctx, STAGE_RECV, stage);
+        worker->stopped = !channel_packet(worker->live, buffer, bytes);
+    }
+}
+
+// Time to the first watchdog
+// deadline, -1 when none is on
+static int watchdog_wait_ms(const std::vector<ChannelWorker*>& workers, uint64_t now_us) {
+    int wait_ms = -1;
+
+    for (size_t i = 0; i < workers.size(); i++) {
+        const LiveChannel& live = workers[i]->live;
+        int idle_ms = live.ctx->cfg->watchdog_idle_ms;
+        if (workers[i]->stopped || idle_ms <= 0) {
+            continue;
+        }
+
+        uint64_t deadline_us = live.last_packet_us + (uint64_t)idle_ms * 1000;
+        int left_ms = deadline_us > now_us ? (int)((deadline_us - now_us + 999) / 1000) : 1;
+        if (wait_ms < 0 || left_ms < wait_ms) {
+            wait_ms = left_ms;
+        }
+    }
+    return wait_ms;
+}
+
+// All channels on one thread, live
+// decode only: run_channels picks
+// threads when gap-fill is on.
+static void channel_epoll_loop(std::vector<ChannelWorker*>& workers) {
+    int ep = ::epoll_create1(EPOLL_CLOEXEC);
+    if (ep < 0) {
+        std::printf("Error: epoll_create1 failed: %s\n", std::strerror(errno));
+        return;
+    }
+
+    for (size_t i = 0; i < workers.size(); i++) {
+        epoll_event event;
+        std::memset(&event, 0, sizeof(event));
+        event.events = EPOLLIN;
+        event.data.ptr = workers[i];
+        ::epoll_ctl(ep, EPOLL_CTL_ADD, workers[i]->live.sock.handle(), &event);
+    }
+
+    const int buffer_capacity = 64 * 1024;
+    uint8_t buffer[buffer_capacity];
+    epoll_event events[64];
+    size_t active = workers.size();
+
+    while (active > 0 && !stop_requested) {
+        int wait_ms = watchdog_wait_ms(workers, monotonic_us());
+        if (wait_ms < 0 || wait_ms > STOP_CHECK_MS) {
+            wait_ms = STOP_CHECK_MS;
+        }
+
+        int ready = ::epoll_wait(ep, events, 64, wait_ms);
+        if (ready < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            std::printf("Error: epoll_wait failed: %s\n", std::strerror(errno));
+            break;
+        }
 
-void Application::set_start_seq(uint64_t value) {
-    has_start_seq = true;
-    start_seq = value;
-}
+        // Idle channels re-join, the new
+        // socket replaces the closed one
+        uint64_t now_us = monotonic_us();
+        for (size_t i = 0; i < workers.size(); i++) {
+            ChannelWorker* worker = workers[i];
+            if (worker->stopped || !channel_watchdog(worker->live, now_us)) {
+                continue;
+            }
+            if (worker->live.sock.handle() >= 0) {
+                epoll_event event;
+                std::memset(&event, 0, sizeof(event));
+                event.events = EPOLLIN;
+                event.data.ptr = worker;
+                ::epoll_ctl(ep, EPOLL_CTL_ADD, worker->live.sock.handle(), &event);
+            }
+        }
 
-void Application::set_enable_recovery(bool value) {
-    enable_recovery = value;
-}
+        for (int i = 0; i < ready; i++) {
+            ChannelWorker* worker = (ChannelWorker*)events[i].data.ptr;
+            if (worker->stopped) {
+                continue;
+            }
 
-static void check_sequence_gap(const MoldHeader& header,
-                               std::string& current_session,
-                               bool& joined, uint64_t& expected_seq) {
+            uint64_t stage = stage_start(worker->ctx);
+            int bytes = worker->live.sock.receive_bytes(buffer, buffer_capacity);
+            if (bytes <= 0) {
+                continue;
+            }
+            stage_end(worker->ctx, STAGE_RECV, stage);
 
-    if (!joined) {
-        current_session = header.session;
-        expected_seq = header.sequence_number;
-        joined = true;
-        return;
+            if (!channel_packet(worker->live, buffer, bytes)) {
+                worker->stopped = true;
+                ::epoll_ctl(ep, EPOLL_CTL_DEL, worker->live.sock.handle(), 0);
+                active--;
+            }
+        }
     }
 
-    if (header.session != current_session) {
-        std::printf(">> INFO: SESSION_CHANGE SequenceNum=%llu\n",
-                    (unsigned long long)header.sequence_number);
+    ::close(ep);
+}
 
-        current_session = header.session;
-        expected_seq = header.sequence_number;
-        return;
+// Live mode over several channels. Each
+// channel decodes with its own spec,
+// specs shared by path are loaded once.
+static int run_channels(const AppConfig& cfg, const std::vector<ChannelConfig>& channels,
+                        const TypeFilter& type_filter, const OutputInputs& output_inputs,
+                        bool verbose, uint64_t max_messages, bool enable_recovery,
+                        bool latency, bool profile) {
+
+    std::vector<std::string> spec_paths;
+    std::vector<RuntimeConfig*> specs;
+    std::vector<ChannelWorker*> workers;
+    int rc = 0;
+
+    // A gap-fill blocks the loop it runs
+    // on: with recovery each channel gets
+    // its own thread, so the others keep
+    // decoding and watching for idle
+    bool channel_threads = cfg.channel_threads;
+    if (enable_recovery && !channel_threads) {
+        std::printf(">> WARN: io_model=epoll with -g, using io_model=thread\n");
+        channel_threads = true;
     }
 
-    if (header.sequence_number > expected_seq) {
-        uint64_t gap_count = header.sequence_number - expected_seq;
-        std::printf(">> GAP DETECT: ExpectedSequence=%llu, Received=%llu, TotalMissing=%llu\n",
-                    (unsigned long long)expected_seq,
-                    (unsigned long long)header.sequence_number,
-                    (unsigned long long)gap_count);
-        return;
-    }
+    for (size_t i = 0; i < channels.size() && rc == 0; i++) {
+        const ChannelConfig& channel = channels[i];
 
-    if (header.sequence_number < expected_seq) {
-        std::printf(">> DUPLICATE: ExpectedSequence=%llu Received=%llu, Ignoring...\n",
-                    (unsigned long long)expected_seq,
-                    (unsigned long long)header.sequence_number);
-        return;
-    }
-}
+        // Spec + compiled output
+        // once per protocol_spec
+        size_t spec_index = 0;
+        while (spec_index < spec_paths.size() && spec_paths[spec_index] != channel.protocol_spec) {
+            spec_index++;
+        }
 
-// Connect to multicast feed, read first valid Mold header
-// return session id for:
-// -s : get session for rerequest packet
-// -g : recovery mode
-static bool get_session_id(const AppConfig& cfg, char session[10],
-                           std::string& session_value) {
+        if (spec_index == spec_paths.size()) {
+            RuntimeConfig* spec = create_runtime_config();
+            std::string error;
+            bool ok = spec != 0;
+
+            // Same spec as cfg: the copy's
+            // tables still point into cfg
+            if (ok) {
+                spec->cfg = cfg;
+                ok = use_channel(&spec->cfg, channel.name);
+                error = "failed to load spec " + channel.protocol_spec;
+            }
+            if (ok) {
+                ok = compile_output(spec->cfg, output_inputs, &spec->plans, &spec->predicate, &error);
+            }
+            if (!ok) {
+                std::printf("Error: channel %s: %s\n", channel.name.c_str(), error.c_str());
+                destroy_runtime_config(spec);
+                rc = 1;
+                break;
+            }
 
-    std::memset(session, ' ', 10);
-    session_value.clear();
+            spec_paths.push_back(channel.protocol_spec);
+            specs.push_back(spec);
+        }
+        const RuntimeConfig* spec = specs[spec_index];
 
-    Socket sock;
-    if (!sock.connect_socket(cfg.mcast_ip, cfg.mcast_port, cfg.interface_ip, cfg.mcast_source_ip)) {
-        std::printf("Failed to connect multicast socket\n");
-        return false;
-    }
+        ChannelWorker* worker = new ChannelWorker();
+        workers.push_back(worker);
 
-    sock.set_receive_buffer(4 * 1024 * 1024);
-    const int udp_packet_capacity = 64 * 1024;
-    uint8_t buffer[udp_packet_capacity];
+        worker->type_filter = type_filter;
+        worker->predicate = spec->predicate;
 
-    while (1) {
-        int bytes = sock.receive_bytes(buffer, udp_packet_capacity);
-        if (bytes <= 0) {
-            continue;
+        DecodeContext& ctx = worker->ctx;
+        ctx.cfg = &spec->cfg;
+        ctx.plans = &spec->plans;
+        ctx.type_filter = &worker->type_filter;
+        ctx.predicate = worker->predicate.empty() ? 0 : &worker->predicate;
+
+        worker->clock.init(spec->cfg);
+        ctx.clock = &worker->clock;
+
+        if (latency) {
+            worker->latency.init(channel.name, latency_settings(spec->cfg, true));
+            ctx.latency = &worker->latency;
         }
+        if (profile) {
+            worker->profile.init(channel.name, spec->cfg.profile_report_interval_ms * 1000000ULL);
+            ctx.profile = &worker->profile;
+        }
+        ctx.verbose = verbose;
+        ctx.max_messages = max_messages;
+        ctx.lock_output = channel_threads;
 
-        MoldHeader header;
-        if (!parse_mold_header(buffer, bytes, &header)) {
-            continue;
+        worker->live.config = channel;
+        worker->live.ctx = &ctx;
+        worker->live.enable_recovery = enable_recovery;
+
+        std::printf(">> CHANNEL %s: %s:%u spec=%s\n", channel.name.c_str(), channel.mcast_ip.c_str(),
+                    (unsigned)channel.mcast_port, channel.protocol_spec.c_str());
+
+        if (!open_channel(worker->live)) {
+            rc = 1;
         }
+    }
 
-        session_value = header.session;
+    if (rc == 0) {
+        if (enable_recovery) {
+            std::printf("Recovery live mode enabled\n");
+        }
+        std::printf("Listening on %u channels, io_model=%s... (Ctrl+C to stop)\n",
+                    (unsigned)workers.size(), channel_threads ? "thread" : "epoll");
 
-        std::memset(session, ' ', 10);
-        size_t session_len = header.session.size();
-        if (session_len > 10) {
-            session_len = 10;
+        if (channel_threads) {
+            for (size_t i = 0; i < workers.size(); i++) {
+                workers[i]->thread = std::thread(channel_thread, workers[i]);
+            }
+            for (size_t i = 0; i < workers.size(); i++) {
+                workers[i]->thread.join();
+            }
+        } else {
+            channel_epoll_loop(workers);
         }
 
-        std::memcpy(session, header.session.data(), session_len);
+        for (size_t i = 0; i < workers.size(); i++) {
+            const LiveChannel& live = workers[i]->live;
+            const SessionCounters& session = live.tracker.counters();
+            std::printf(">> STOP: Channel=%s, State=%s, Packets=%llu, Total Decoded=%llu, "
+                        "Heartbeats=%llu, Gaps=%llu, TailGaps=%llu, GapMessages=%llu, Resets=%llu\n",
+                        live.config.name.c_str(),
+                        live.tracker.state_name(),
+                        (unsigned long long)live.packets,
+                        (unsigned long long)workers[i]->ctx.decoded_count,
+                        (unsigned long long)session.heartbeats,
+                        (unsigned long long)session.gaps,
+                        (unsigned long long)session.tail_gaps,
+                        (unsigned long long)live.gap_messages,
+                        (unsigned long long)workers[i]->ctx.sequence_resets);
+            print_watchdog_stats(live);
+            finish_run(workers[i]->ctx);
+        }
+    }
 
-        sock.close();
-        return true;
+    for (size_t i = 0; i < workers.size(); i++) {
+        close_channel(workers[i]->live);
+        delete workers[i];
     }
+    for (size_t i = 0; i < specs.size(); i++) {
+        destroy_runtime_config(specs[i]);
+    }
+    return rc;
 }
 
-// Purpose:
-// Wrapper to decode a full MoldUDP packet (header + payload (all messages))
-// Used mode:
-// - Live, replay(download) / live + recovery (-g)
-//
-// Funtions:
-// Calls parse_mold_header() to parse Mold header(session, startseq, msgcount)
-// Iterates each MoldMessage in the packet
-// Computes per-message seq = header.seqnum + msgcount
-// Calls decode_itch_message() for each message
-static uint16_t decode_packet_messages(const uint8_t* buffer, int bytes,
-                                      const AppConfig& cfg, bool has_type_filter,
-                                      const bool type_allowed[256],
-                                      uint64_t& decoded_count,
-                                      uint64_t max_messages_limit, bool& stop_now, bool verbose) {
+// Switch the decode path to a
+// reloaded config. Filter counters
+// start over with the new filter.
+static void apply_reload(DecodeContext& ctx, RuntimeConfig& next, Rerequester* rr) {
+    if (ctx.predicate) {
+        ctx.predicate->print_stats();
+    }
 
-    stop_now = false;
+    ctx.cfg = &next.cfg;
+    ctx.plans = &next.plans;
+    ctx.predicate = next.predicate.empty() ? 0 : &next.predicate;
 
-    MoldHeader header;
-    if (!parse_mold_header(buffer, bytes, &header)) {
-        return 0;
+    // Time fields may have moved,
+    // the current second stays
+    if (ctx.clock) {
+        ctx.clock->init(next.cfg);
+    }
+    if (ctx.latency) {
+        ctx.latency->set_clock_offset(next.cfg.latency_clock_offset_ns);
     }
 
-    int offset = 10 + 8 + 2;
-    uint16_t remaining = (uint16_t)header.message_count;
-    uint16_t index = 0;
-    const uint8_t* msg = 0;
-    uint16_t msg_len = 0;
-    uint16_t processed = 0;
-
-    while (next_mold_message(buffer, bytes, &offset, &remaining, &msg, &msg_len)) {
-        uint64_t seq = header.sequence_number + (uint64_t)index;
-        index++;
+    if (rr) {
+        rr->set_tuning(recovery_tuning(next.cfg));
+    }
 
-        // Print filter by message type.
-        bool allow_print = true;
-        if (has_type_filter) {
-            allow_print = type_allowed[(unsigned char)msg[0]];
-        }
+    std::printf(">> CONFIG RELOADED: Generation=%llu\n", (unsigned long long)next.generation);
+}
 
-        if (allow_print) {
-            decode_itch_message(msg, msg_len, cfg, header.session, seq, (uint16_t)header.message_count, verbose);
-        }
+int Application::run() {
+    if (!trace_json_path.empty()) {
+        return trace_to_json(trace_json_path);
+    }
 
-        decoded_count++;
-        processed++;
+    if (!load_config(config_path.c_str())) {
+        std::printf("Failed to load config: %s\n", config_path.c_str());
+        return 1;
+    }
 
-        // Stop after N total messages
-        // on -n
-        if (max_messages_limit != 0 && decoded_count >= max_messages_limit) {
-            stop_now = true;
-            return processed;
+    // --channel picks feeds, all
+    // configured ones by default
+    std::vector<ChannelConfig> channels;
+    for (size_t i = 0; i < config().channels.size(); i++) {
+        const ChannelConfig& channel = config().channels[i];
+        bool wanted = channel_names.empty();
+        for (size_t j = 0; j < channel_names.size(); j++) {
+            wanted = wanted || channel_names[j] == channel.name;
+        }
+        if (wanted) {
+            channels.push_back(channel);
         }
     }
-    return processed;
-}
 
-// Gap-fill (Recover)
-static uint64_t gap_fill(Rerequester& rr, const char session[10],
-                         uint64_t start_seq, uint64_t gap_count,
-                         uint16_t max_per_request, const AppConfig& cfg,
-                         bool has_type_filter, const bool type_allowed[256],
-                         uint64_t& decoded_count, uint64_t max_messages,
-                         bool& stop_now, bool verbose) {
+    if (channels.size() < channel_names.size() || channels.empty()) {
+        std::printf("Error: unknown channel in --channel (see [CHANNEL <name>] in %s)\n",
+                    config_path.c_str());
+        return 1;
+    }
 
-    const int udp_packet_capacity = 64 * 1024;
-    uint8_t rxbuf[udp_packet_capacity];
-    
-    uint64_t recovered = 0;
-    uint64_t current_seq = start_seq;
-    uint64_t remaining = gap_count;
+    if (channels.size() == 1 && !select_channel(channels[0].name)) {
+        std::printf("Failed to load spec for channel %s\n", channels[0].name.c_str());
+        return 1;
+    }
 
-    while (remaining > 0) {
-        uint16_t req_count = max_per_request;
+    // Everything but live decode
+    // follows one feed
+    bool multi_channel = channels.size() > 1;
+    if (multi_channel && (has_start_seq || !replay_path.empty() || !record_path.empty() ||
+                          !export_dir.empty() || !shm_ring_name.empty() ||
+                          !shm_read_name.empty() || republish ||
+                          (enable_recovery && !config().snapshot_path.empty()))) {
+        std::printf("Error: -s, --replay, --record, --export, --shm, --republish and snapshots "
+                    "need one channel (--channel <name>)\n");
+        return 1;
+    }
+
+    const AppConfig& cfg = config();
+    if (verbose) {
+        std::printf("verbose on\n");
+    }
 
-        if (remaining < (uint64_t)max_per_request) {
-            req_count = (uint16_t)remaining;
+    // Hot path timestamps, stays on
+    // clock_gettime if it fails
+    ClockCalibrator calibrator;
+    if (cfg.clock_use_tsc) {
+        calibrator.start(cfg.clock_calibrate_interval_ms);
+    }
+    if (verbose) {
+        std::printf("Clock source=%s", clock_source_name());
+        if (calibrator.tsc_ghz() > 0.0) {
+            std::printf(" (%.3f GHz)", calibrator.tsc_ghz());
         }
+        std::printf("\n");
+    }
 
-        if (!rr.send_request(session, current_seq, req_count)) {
-            std::printf("Recovery send_request failed seq=%llu count=%u\n",
-                        (unsigned long long)current_seq,
-                        (unsigned)req_count);
+    // Flight recorder, dumped on
+    // gap / stall / SIGUSR1
+    TraceSettings trace_settings;
+    trace_settings.ring_events = cfg.trace_ring_events;
+    trace_settings.dump_dir = cfg.trace_dump_dir;
+    trace_settings.min_dump_interval_ms = cfg.trace_min_dump_interval_ms;
+    trace_settings.max_dump_files = cfg.trace_max_dump_files;
+    trace_settings.dump_on_gap = cfg.trace_dump_on_gap;
+    trace_init(trace_settings);
+    trace_thread("main");
+
+    DecodeContext ctx;
+    ctx.cfg = &cfg;
+    ctx.trace_channel = trace_channel(channels[0].name);
+    TypeFilter type_filter;
+    type_filter.init(has_type_filter ? type_allowed : 0, FILTER_KERNEL_AUTO);
+    ctx.type_filter = &type_filter;
+    if (verbose) {
+        std::printf("Type filter kernel=%s, Field decode kernel=%s\n",
+                    type_filter.kernel_name(), field_kernel_name());
+    }
+    ctx.verbose = verbose;
+    ctx.max_messages = max_messages;
 
-            break;
+    // Book snapshot + warm restart
+    // only where the tail can be
+    // recovered (-s / -g)
+    OrderBook book;
+    SnapshotWriter snapshot_writer;
+    bool warm_started = false;
+
+    if (!cfg.snapshot_path.empty() && (has_start_seq || enable_recovery)) {
+        book.init(cfg);
+        ctx.book = &book;
+
+        warm_started = warm_start(ctx, cfg.snapshot_path);
+
+        if (snapshot_writer.start(cfg.snapshot_path)) {
+            ctx.snapshot_writer = &snapshot_writer;
+            ctx.next_snapshot_count = cfg.snapshot_interval_messages;
         }
+    }
 
-        uint64_t got_in_chunk = 0;
-        int timeouts = 0;
+    // --fields projection, compiled
+    // into a copy of the plans (the
+    // book keeps the fields it reads),
+    // --filter per type against the
+    // field offsets
+    OutputInputs output_inputs;
+    output_inputs.projections = field_projections;
+    output_inputs.filters = filters;
+    for (int t = 0; t < 256; t++) {
+        output_inputs.keep_masks[t] = ctx.book ? book.field_mask((uint8_t)t) : 0;
+    }
 
-        while (got_in_chunk < (uint64_t)req_count) {
-            int recv_bytes = rr.receive_packet(rxbuf, udp_packet_capacity);
-            if (recv_bytes <= 0) {
-                if (errno == EAGAIN || errno == EWOULDBLOCK) {
-                    timeouts++;
-                    if (timeouts >= 3) {
-                        if (got_in_chunk == 0) {
-                            std::printf("Recovery timeout seq=%llu got=%llu req=%u\n",
-                                        (unsigned long long)current_seq,
-                                        (unsigned long long)got_in_chunk,
-                                        (unsigned)req_count);
-                        }
-                        break;
-                    }
-                    continue;
-                }
-                std::printf("Recovery recv error errno=%d\n", errno);
-                break;
-            }
+    DecodePlans plans;
+    Predicate predicate;
+    std::string output_error;
+    if (!compile_output(cfg, output_inputs, &plans, &predicate, &output_error)) {
+        std::printf("Error: %s\n", output_error.c_str());
+        return 1;
+    }
+    ctx.plans = &plans;
+    if (!predicate.empty()) {
+        ctx.predicate = &predicate;
+    }
 
-            bool local_stop = false;
-            uint16_t processed = decode_packet_messages(rxbuf, recv_bytes, cfg, has_type_filter,
-                                                       type_allowed, decoded_count, max_messages,
-                                                       local_stop, verbose);
+    // Exchange time of every message,
+    // also for the index and time slices
+    ExchangeClock clock;
+    clock.init(cfg);
+    ctx.clock = &clock;
+
+    // A recording has receive but
+    // no decode time to compare
+    LatencyStats latency_stats;
+    if (latency) {
+        latency_stats.init(cfg.channel_name, latency_settings(cfg, replay_path.empty()));
+        ctx.latency = &latency_stats;
+    }
 
-            got_in_chunk += (uint64_t)processed;
+    StageProfile stage_profile;
+    if (profile) {
+        stage_profile.init(cfg.channel_name, cfg.profile_report_interval_ms * 1000000ULL);
+        ctx.profile = &stage_profile;
+    }
 
-            if (local_stop) {
-                stop_now = true;
-                return recovered + got_in_chunk;
-            }
+    // Export mode --export <dir>
+    // works with every input below
+    ColumnExporter exporter;
+    if (!export_dir.empty()) {
+        if (!exporter.open(export_dir, cfg, plans, cfg.export_chunk_rows, cfg.export_compress_columns)) {
+            std::printf("Error: failed to open export dir %s\n", export_dir.c_str());
+            return 1;
         }
+        ctx.exporter = &exporter;
+    }
 
-        if (got_in_chunk == 0) {
-            break;
+    // Ring consumer --shm-read <name>
+    if (!shm_read_name.empty()) {
+        return read_shm_ring(shm_read_name, cfg, max_messages);
+    }
+
+    // Ring publisher --shm <name>
+    ShmRingWriter shm_ring;
+    if (!shm_ring_name.empty()) {
+        if (!shm_ring.open(shm_ring_name, cfg.shm_ring_slots, cfg)) {
+            std::printf("Error: failed to create shm ring %s\n", shm_ring_name.c_str());
+            return 1;
         }
+        ctx.shm_ring = &shm_ring;
+    }
 
-        recovered += got_in_chunk;
-        current_seq += got_in_chunk;
+    // Republish mode --republish
+    Republisher republisher;
+    if (republish) {
+        if (!enable_recovery && !has_start_seq && replay_path.empty()) {
+            std::printf(">> WARN: --republish without -g, gaps are passed on\n");
+        }
 
-        if (got_in_chunk >= remaining) {
-            remaining = 0;
-        } else {
-            remaining -= got_in_chunk;
+        RepublishSettings settings;
+        settings.mcast_ip = cfg.republish_mcast_ip;
+        settings.mcast_port = cfg.republish_mcast_port;
+        settings.interface_ip = cfg.republish_interface_ip;
+        settings.ttl = cfg.republish_ttl;
+        settings.mtu = cfg.republish_mtu;
+        settings.rerequest_port = cfg.republish_rerequest_port;
+        settings.retain_messages = cfg.republish_retain_messages;
+        settings.retain_bytes = cfg.republish_retain_bytes;
+
+        if (!republisher.open(settings)) {
+            std::printf("Error: failed to open republisher (check [REPUBLISH_SETTINGS])\n");
+            return 1;
         }
+        ctx.republisher = &republisher;
     }
 
-    return recovered;
-}
-
-int Application::run() {
-    const char* config_path = "config/config.ini";
-    if (!load_config(config_path)) {
-        std::printf("Failed to load config: %s\n", config_path);
-        return 1;
+    // Replay mode --replay <file>
+    if (!replay_path.empty()) {
+        ctx.has_seq_slice = has_seq_range;
+        ctx.slice_first_seq = range_first_seq;
+        ctx.slice_last_seq = range_last_seq;
+        ctx.has_time_slice = has_time_range;
+        ctx.slice_from_ns = range_from_ns;
+        ctx.slice_to_ns = range_to_ns;
+        return replay_recording(replay_path, ctx);
     }
 
-    const AppConfig& cfg = config();
-    if (verbose) {
-        std::printf("verbose on\n");
+    // Record mode --record <file>
+    Recorder recorder;
+    if (!record_path.empty()) {
+        if (!recorder.open(record_path, cfg.index_interval_messages, cfg)) {
+            std::printf("Error: failed to open recording %s\n", record_path.c_str());
+            return 1;
+        }
+        ctx.recorder = &recorder;
     }
 
+    // Live and download stop cleanly
+    // on Ctrl+C / SIGTERM from here on
+    install_stop_handler();
+
     // Download mode -s <startseq>
     if (has_start_seq) {
         if (cfg.mcast_rerequester_ip.empty() || cfg.mcast_rerequester_port == 0) {
@@ -294,107 +2171,75 @@ int Application::run() {
             return 1;
         }
 
-        const int udp_packet_capacity = 64 * 1024;
-
         // Open rerequester Socket
         // Send request + receive reply
         // packets on same socket.
         Rerequester rr;
         int receive_buffer_bytes = 4 * 1024 * 1024;
-        int timeout_ms = 1000;
 
         if (!rr.open(cfg.mcast_rerequester_ip, cfg.mcast_rerequester_port,
-                     receive_buffer_bytes, timeout_ms)) {
+                     receive_buffer_bytes)) {
             std::printf("Error: failed to open rerequester socket\n");
             return 1;
         }
 
-        // Request reply
-        // in chunks
-        // configured in config with 
-        // max_recovery_message_count
-        uint16_t max_per_request = cfg.max_recovery_message_count;
-        if (max_per_request == 0) {
-            max_per_request = 5000;
-        }
+        // Request reply in chunks, sized
+        // between min/max_recovery_message_count
+        // from the observed loss
+        rr.set_tuning(recovery_tuning(cfg));
 
-        uint64_t decoded_count = 0;
         uint64_t current_seq = start_seq;
 
+        // Resume from snapshot if it is
+        // ahead of -s. Behind -s too: the
+        // book needs the messages between.
+        if (warm_started && session_value == ctx.session && ctx.next_seq != start_seq) {
+            current_seq = ctx.next_seq;
+            std::printf(">> INFO: Resume from snapshot Sequence=%llu%s\n",
+                        (unsigned long long)current_seq,
+                        current_seq < start_seq ? " (behind -s)" : "");
+        }
+
         // If -n is provided => bounded download
         // If -n is not provided => download all (until stalled / Ctrl+C)
         bool bounded_download = (max_messages != 0);
-        uint64_t remaining = max_messages;
-
-        uint8_t rxbuf[udp_packet_capacity];
-
-        while (!bounded_download || remaining > 0) {
-            uint16_t req_count = max_per_request;
-            if (bounded_download) {
-                req_count = (remaining > (uint64_t)max_per_request)
-                            ? max_per_request
-                            : (uint16_t)remaining;
-            }
-
-            // Send rerequest for 
-            // [current_seq ... current_seq + req_count -1]
-            if (!rr.send_request(session, current_seq, req_count)) {
-                std::printf(">> ERROR : Recovery Request Send  Failed Sequence=%llu, Count=%u\n",
-                            (unsigned long long)current_seq, (unsigned)req_count);
-                rr.close();
-                return 1;
-            }
+        uint64_t remaining = bounded_download ? max_messages : UINT64_MAX;
+        uint64_t started_us = monotonic_us();
+        uint64_t downloaded = 0;
 
+        while (remaining > 0 && !stop_requested) {
             std::printf(">> INFO : Requesting... Sequence Number=%llu, Total Message=%u\n",
-                        (unsigned long long)current_seq, (unsigned)req_count);
+                        (unsigned long long)current_seq, (unsigned)rr.request_size(remaining));
 
             // Receive reply packets
             // until enough message decode
             // for this chunk
             uint64_t got_in_chunk = 0;
-            int timeouts = 0;
-
-            while (got_in_chunk < (uint64_t)req_count) {
-                int n = rr.receive_packet(rxbuf, udp_packet_capacity);
-                if (n <= 0) {
-                    // Timeout is expected sometimes
-                    // allow a few then stop this chunk
-                    if (errno == EAGAIN || errno == EWOULDBLOCK) {
-                        timeouts++;
-                        if (timeouts >= 3) {
-                            if (got_in_chunk == 0) {
-                                std::printf("Recovery timeout seq=%llu got=%llu req=%u\n",
-                                            (unsigned long long)current_seq,
-                                            (unsigned long long)got_in_chunk,
-                                            (unsigned)req_count);
-                            }
-                            break;
-                        }
-                        continue;
-                    }
-                    std::printf("Recovery recv error errno=%d\n", errno);
-                    break;
-                }
+            bool stop_now = false;
 
-                bool stop_now = false;
-                uint16_t processed = decode_packet_messages(rxbuf, n, cfg, has_type_filter, type_allowed,
-                                                           decoded_count, max_messages, stop_now, verbose);
+            if (!request_chunk(rr, session, current_seq, remaining, ctx, got_in_chunk, stop_now)) {
+                rr.close();
+                return 1;
+            }
 
-                got_in_chunk += (uint64_t)processed;
+            downloaded += got_in_chunk;
 
-                if (stop_now) {
-                    std::printf(">> STOP : Total Decoded Messages=%llu\n", (unsigned long long)decoded_count);
-                    rr.close();
-                    return 0;
-                }
+            if (stop_now) {
+                std::printf(">> STOP : Total Decoded Messages=%llu\n", (unsigned long long)ctx.decoded_count);
+                print_recovery_stats(rr, downloaded, monotonic_us() - started_us);
+                finish_run(ctx);
+                rr.close();
+                return 0;
             }
 
             // If nothing arrived
+            // after all retries
             if (got_in_chunk == 0) {
-                std::printf("Recovery stalled seq=%llu req=%u\n",
-                            (unsigned long long)current_seq,
-                            (unsigned)req_count);
+                std::printf("Recovery stalled seq=%llu\n",
+                            (unsigned long long)current_seq);
 
+                print_recovery_stats(rr, downloaded, monotonic_us() - started_us);
+                finish_run(ctx);
                 rr.close();
 
                 // Unbounded (-s without -n): treat stall as end of download (exit OK)
@@ -407,142 +2252,93 @@ int Application::run() {
             // all valid messages (best-effort)
             current_seq += got_in_chunk;
 
-            if (bounded_download) {
-                if (got_in_chunk >= remaining) {
-                    remaining = 0;
-                } else {
-                    remaining -= got_in_chunk;
-                }
+            if (got_in_chunk >= remaining) {
+                remaining = 0;
+            } else {
+                remaining -= got_in_chunk;
             }
         }
 
-        std::printf("Recovery done decoded_count=%llu\n", (unsigned long long)decoded_count);
+        print_recovery_stats(rr, downloaded, monotonic_us() - started_us);
+        std::printf("Recovery done decoded_count=%llu\n", (unsigned long long)ctx.decoded_count);
+        finish_run(ctx);
         rr.close();
+        exporter.close();
+        recorder.close();
+        shm_ring.close();
         return 0;
     }
 
     // Live Mode
 
-    Socket sock;
-
-    if (!sock.connect_socket(cfg.mcast_ip, cfg.mcast_port, cfg.interface_ip, cfg.mcast_source_ip)) {
-        std::printf("Failed to connect socket\n");
-        return 1;
+    if (multi_channel) {
+        return run_channels(cfg, channels, type_filter, output_inputs,
+                            verbose, max_messages, enable_recovery, latency, profile);
     }
 
-    sock.set_receive_buffer(4 * 1024 * 1024);
-    const int buffer_capacity = 64 * 1024;
-    uint8_t buffer[buffer_capacity];
-    std::string current_session;
-    bool joined = false;
-    uint64_t expected_seq = 0;
-    uint64_t decoded_count = 0;
-
-    // Open rerequester 
-    // only if enable_recovery
-    Rerequester rr;
-    bool rr_open = false;
+    LiveChannel channel;
+    channel.config = channels[0];
+    channel.ctx = &ctx;
+    channel.enable_recovery = enable_recovery;
 
-    uint16_t max_per_request = cfg.max_recovery_message_count;
-    if (max_per_request == 0) {
-        max_per_request = 5000;
+    if (!open_channel(channel)) {
+        return 1;
+    }
+    if (channel.rr_open) {
+        std::printf("Recovery live mode enabled\n");
     }
 
-    if (enable_recovery) {
-        if (cfg.mcast_rerequester_ip.empty() || cfg.mcast_rerequester_port == 0) {
-            std::printf("Error: rerequester IP/Port not set in the config\n");
-            sock.close();
-            return 1;
-        }
-
-        int receive_buffer_bytes = 4 * 1024 * 1024;
-        int timeout_ms = 1000;
-
-        if (!rr.open(cfg.mcast_rerequester_ip, cfg.mcast_rerequester_port,
-                     receive_buffer_bytes, timeout_ms)) {
+    // Warm restart: treat the snapshot
+    // position as already received, so
+    // the first live packet gap-fills
+    // only the tail
+    if (warm_started && enable_recovery) {
+        channel.tracker.resume(ctx.session, ctx.next_seq);
+    }
 
-            std::printf("Error: failed to open rerequester socket\n");
-            sock.close();
-            return 1;
-        }
+    // Reload on SIGHUP / file change,
+    // swapped in between packets
+    output_inputs.layout_pinned = ctx.book || ctx.recorder || ctx.exporter || ctx.shm_ring;
+    output_inputs.projection_pinned = ctx.exporter != 0;
 
-        rr_open = true;
-        std::printf("Recovery live mode enabled\n");
+    ConfigReloader reloader;
+    if (!reloader.start(config_path, cfg, output_inputs)) {
+        std::printf(">> WARN: config reload disabled\n");
     }
 
     std::printf("Listening... (Ctrl+C to stop)\n");
 
-    while (1) {
-        int bytes = sock.receive_bytes(buffer, buffer_capacity);
-        if (bytes <= 0) {
-            continue;
-        }
+    const int buffer_capacity = 64 * 1024;
+    uint8_t buffer[buffer_capacity];
 
-        MoldHeader header;
-        if (!parse_mold_header(buffer, bytes, &header)) {
+    while (!stop_requested) {
+        uint64_t stage = stage_start(ctx);
+        int bytes = channel_receive(channel, buffer, buffer_capacity);
+        if (bytes <= 0) {
             continue;
         }
+        stage_end(ctx, STAGE_RECV, stage);
 
-        // Gap/Duplicate/SessionChange
-        if (enable_recovery) {
-            check_sequence_gap(header, current_session, joined, expected_seq);
-        }
-
-        // Gap-fill
-        if (enable_recovery && rr_open && joined &&
-            header.session == current_session &&
-            header.sequence_number > expected_seq) {
-
-            uint64_t gap_start = expected_seq;
-            uint64_t gap_count = header.sequence_number - expected_seq;
-
-            // use sessionId from current
-            // live packet
-            char session[10];
-            std::memset(session, ' ', 10);
-
-            size_t session_length = header.session.size();
-            if (session_length > 10) {
-                session_length = 10;
-            }
-
-            std::memcpy(session, header.session.data(), session_length);
-            std::printf(">> Start recovering ...\n");
-
-            bool gap_stop_now = false;
-            uint64_t recovered_count = gap_fill(rr, session, gap_start, gap_count,
-                max_per_request, cfg,
-                has_type_filter, type_allowed,
-                decoded_count, max_messages,
-                gap_stop_now, verbose);
-
-            std::printf(">> RECOVERED: SequenceNumber=%llu, TotalRecovered=%llu\n",
-                        (unsigned long long)gap_start,
-                        (unsigned long long)recovered_count);
-
-            if (gap_stop_now) {
-                std::printf(">> STOP: Total Decoded=%llu\n", (unsigned long long)decoded_count);
-                rr.close();
-                sock.close();
-                return 0;
-            }
+        RuntimeConfig* reloaded = reloader.poll();
+        if (reloaded) {
+            apply_reload(ctx, *reloaded, channel.rr_open ? &channel.rr : 0);
         }
 
-        // Decode the packet's message
-        bool stop_now = false;
-        decode_packet_messages(buffer, bytes, cfg, has_type_filter, type_allowed,
-                       decoded_count, max_messages, stop_now, verbose);
-
-        // Expected next packet startseq
-        expected_seq = header.sequence_number + (uint64_t)header.message_count;
-
-        if (stop_now) {
-            std::printf(">> STOP: Total Decoded=%llu\n", (unsigned long long)decoded_count);
-            sock.close();
-            return 0;
+        if (!channel_packet(channel, buffer, bytes)) {
+            break;
         }
     }
 
-    sock.close();
+    // -n reached or Ctrl+C: open export
+    // chunks and the buffered recording
+    // + index are written out on close,
+    // the shm segment is unlinked
+    std::printf(">> STOP: Total Decoded=%llu\n", (unsigned long long)ctx.decoded_count);
+    print_watchdog_stats(channel);
+    finish_run(ctx);
+    close_channel(channel);
+    exporter.close();
+    recorder.close();
+    shm_ring.close();
     return 0;
 }
@@ -0,0 +1,194 @@
+#include "book.h"
+
+#include <cstring>
+
+static const FieldSpec* find_field(const MsgSpec& spec, const char* name) {
+    for (size_t i = 0; i < spec.fields.size(); i++) {
+        if (spec.fields[i].name == name) {
+            return &spec.fields[i];
+        }
+    }
+    return 0;
+}
+
+static bool is_numeric(const FieldSpec* field) {
+    return field && field->type != STRING && field->type != BINARY;
+}
+
+
+OrderBook::OrderBook() {
+    std::memset(fields_by_type, 0, sizeof(fields_by_type));
+}
+
+void OrderBook::init(const AppConfig& cfg) {
+    std::memset(fields_by_type, 0, sizeof(fields_by_type));
+
+    for (int t = 0; t < 256; t++) {
+        const MsgSpec* spec = cfg.spec_by_type[t];
+        if (!spec) {
+            continue;
+        }
+
+        OrderFields& of = fields_by_type[t];
+        const FieldSpec* order_number = find_field(*spec, "OrderNumber");
+        const FieldSpec* original = find_field(*spec, "OriginalOrderNumber");
+        const FieldSpec* new_number = find_field(*spec, "NewOrderNumber");
+        const FieldSpec* side = find_field(*spec, "BuySellIndicator");
+        const FieldSpec* quantity = find_field(*spec, "Quantity");
+        const FieldSpec* executed = find_field(*spec, "ExecutedQuantity");
+        const FieldSpec* price = find_field(*spec, "Price");
+
+        // Classify by the fields
+        // the message carries
+        if (is_numeric(original) && is_numeric(new_number) &&
+            is_numeric(quantity) && is_numeric(price)) {
+            of.action = ACTION_REPLACE;
+            of.order_number = original;
+            of.new_order_number = new_number;
+            of.quantity = quantity;
+            of.price = price;
+        }
+        else if (is_numeric(order_number) && side &&
+                 is_numeric(quantity) && is_numeric(price)) {
+            of.action = ACTION_ADD;
+            of.order_number = order_number;
+            of.side = side;
+            of.quantity = quantity;
+            of.price = price;
+            of.orderbook_id = find_field(*spec, "OrderbookId");
+        }
+        else if (is_numeric(order_number) && is_numeric(executed)) {
+            of.action = ACTION_EXECUTE;
+            of.order_number = order_number;
+            of.quantity = executed;
+        }
+        else if (is_numeric(order_number) && !quantity && !price) {
+            of.action = ACTION_DELETE;
+            of.order_number = order_number;
+        }
+        else {
+            continue;
+        }
+
+        of.min_length = spec->total_length;
+    }
+}
+
+void OrderBook::apply(const uint8_t* msg, uint16_t msg_len, const DecodedFields& fields) {
+    if (!msg || msg_len == 0) {
+        return;
+    }
+
+    const OrderFields& of = fields_by_type[msg[0]];
+    if (of.action == ACTION_NONE || msg_len < of.min_length) {
+        return;
+    }
+
+    uint64_t order_number = field_value(fields, of.order_number);
+
+    switch (of.action) {
+        case ACTION_ADD: {
+            BookOrder order;
+            std::memset(&order, 0, sizeof(order));
+            order.order_number = order_number;
+            order.price = field_value(fields, of.price);
+            order.quantity = field_value(fields, of.quantity);
+            order.side = (char)msg[of.side->offset];
+
+            if (of.orderbook_id) {
+                uint32_t id_len = of.orderbook_id->size;
+                if (id_len > sizeof(order.orderbook_id)) {
+                    id_len = sizeof(order.orderbook_id);
+                }
+                std::memcpy(order.orderbook_id, msg + of.orderbook_id->offset, id_len);
+            }
+
+            orders[order_number] = order;
+            return;
+        }
+
+        case ACTION_EXECUTE: {
+            std::unordered_map<uint64_t, BookOrder>::iterator it = orders.find(order_number);
+            if (it == orders.end()) {
+                return;
+            }
+
+            uint64_t executed = field_value(fields, of.quantity);
+            if (executed >= it->second.quantity) {
+                orders.erase(it);
+            } else {
+                it->second.quantity -= executed;
+            }
+            return;
+        }
+
+        case ACTION_DELETE:
+            orders.erase(order_number);
+            return;
+
+        case ACTION_REPLACE: {
+            std::unordered_map<uint64_t, BookOrder>::iterator it = orders.find(order_number);
+            if (it == orders.end()) {
+                return;
+            }
+
+            // Replace keeps side/book,
+            // takes new number, qty, price
+            BookOrder order = it->second;
+            orders.erase(it);
+
+            order.order_number = field_value(fields, of.new_order_number);
+            order.quantity = field_value(fields, of.quantity);
+            order.price = field_value(fields, of.price);
+            orders[order.order_number] = order;
+            return;
+        }
+
+        case ACTION_NONE:
+        default:
+            return;
+    }
+}
+
+static uint64_t field_bit(const FieldSpec* field) {
+    if (!field || field->index >= 64) {
+        return 0;
+    }
+    return 1ULL << field->index;
+}
+
+uint64_t OrderBook::field_mask(uint8_t msg_type) const {
+    const OrderFields& of = fields_by_type[msg_type];
+    if (of.action == ACTION_NONE) {
+        return 0;
+    }
+
+    return field_bit(of.order_number) |
+           field_bit(of.new_order_number) |
+           field_bit(of.side) |
+           field_bit(of.quantity) |
+           field_bit(of.price) |
+           field_bit(of.orderbook_id);
+}
+
+void OrderBook::clear() {
+    orders.clear();
+}
+
+void OrderBook::insert(const BookOrder& order) {
+    orders[order.order_number] = order;
+}
+
+void OrderBook::copy_orders(std::vector<BookOrder>& out) const {
+    out.clear();
+    out.reserve(orders.size());
+
+    std::unordered_map<uint64_t, BookOrder>::const_iterator it;
+    for (it = orders.begin(); it != orders.end(); ++it) {
+        out.push_back(it->second);
+    }
+}
+
+size_t OrderBook::order_count() const {
+    return orders.size();
+}
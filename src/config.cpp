@@ -1,4 +1,5 @@
 #include "config.h"
+#include "field_decode.h"
 
 #include <fstream>
 #include <string>
@@ -11,7 +12,42 @@ using json = nlohmann::json;
 AppConfig::AppConfig()
     : mcast_port(0),
       mcast_rerequester_port(0),
-      max_recovery_message_count(5000) {
+      watchdog_idle_ms(0),
+      max_recovery_message_count(5000),
+      min_recovery_message_count(100),
+      recovery_initial_timeout_ms(1000),
+      recovery_min_timeout_ms(2),
+      recovery_max_timeout_ms(2000),
+      recovery_max_retries(3),
+      recovery_max_requests_per_second(0),
+      reorder_window_us(200),
+      recovery_cache_messages(65536),
+      recovery_cache_bytes(16 * 1024 * 1024),
+      snapshot_interval_messages(1000000),
+      index_interval_messages(1000),
+      export_chunk_rows(65536),
+      shm_ring_slots(65536),
+      republish_mcast_port(0),
+      republish_ttl(1),
+      republish_mtu(1500),
+      republish_rerequest_port(0),
+      republish_retain_messages(1 << 20),
+      republish_retain_bytes(64 * 1024 * 1024),
+      latency_clock_offset_ns(0),
+      latency_report_interval_ms(10000),
+      latency_kernel_timestamps(true),
+      profile_report_interval_ms(10000),
+      clock_use_tsc(true),
+      clock_calibrate_interval_ms(1000),
+      trace_ring_events(16384),
+      trace_dump_dir("."),
+      trace_min_dump_interval_ms(1000),
+      trace_max_dump_files(16),
+      trace_dump_on_gap(true),
+      channel_threads(false),
+      sequence_reset_type(-1),
+      sequence_reset_offset(0),
+      plans() {
     std::memset(spec_by_type, 0, sizeof(spec_by_type));
 }
 
@@ -81,6 +117,8 @@ static bool load_spec(const std::string& spec_path, AppConfig* cfg) {
 
     cfg->msg_specs.clear();
     std::memset(cfg->spec_by_type, 0, sizeof(cfg->spec_by_type));
+    cfg->sequence_reset_type = -1;
+    cfg->sequence_reset_offset = 0;
 
     for (json::iterator it = root.begin(); it != root.end(); ++it) {
         std::string msg_key = it.key();
@@ -105,6 +143,7 @@ static bool load_spec(const std::string& spec_path, AppConfig* cfg) {
             field_spec.type = parse_field_type(json_file.value("type", "string"));
             field_spec.size = (uint32_t)json_file.value("size", 0);
             field_spec.offset = offset;
+            field_spec.index = (uint32_t)msg.fields.size();
 
             offset += field_spec.size;
             msg.fields.push_back(field_spec);
@@ -113,13 +152,25 @@ static bool load_spec(const std::string& spec_path, AppConfig* cfg) {
         msg.total_length = offset;
         cfg->msg_specs[msg.msg_type] = msg;
         cfg->spec_by_type[(unsigned char)msg.msg_type] = &cfg->msg_specs[msg.msg_type];
+
+        // Xrossing G: following messages
+        // are numbered from SequenceNumber
+        if (msg.name == "SequenceReset") {
+            for (size_t i = 0; i < msg.fields.size(); i++) {
+                const FieldSpec& field = msg.fields[i];
+                if (field.name == "SequenceNumber" && field.type == UINT64 && field.size == 8) {
+                    cfg->sequence_reset_type = (unsigned char)msg.msg_type;
+                    cfg->sequence_reset_offset = field.offset;
+                }
+            }
+        }
     }
 
-    return true;
+    return compile_decode_plans(cfg);
 }
 
 
-bool load_config(const char* config_path) {
+bool load_config_file(const char* config_path, AppConfig* out) {
     AppConfig cfg;
 
     std::ifstream file(config_path);
@@ -146,7 +197,16 @@ bool load_config(const char* config_path) {
         }
 
         if (line.front() == '[' && line.back() == ']') {
-            section = to_upper_case(trim(line.substr(1, line.size() -2)));
+            std::string name = trim(line.substr(1, line.size() -2));
+            section = to_upper_case(name);
+
+            // [CHANNEL <name>], name as written
+            if (section.compare(0, 8, "CHANNEL ") == 0) {
+                ChannelConfig channel;
+                channel.name = trim(name.substr(8));
+                cfg.channels.push_back(channel);
+                section = "CHANNEL";
+            }
             continue;
         }
 
@@ -166,29 +226,180 @@ bool load_config(const char* config_path) {
             else if (key == "mcast_rerequester_ip") cfg.mcast_rerequester_ip = val;
             else if (key == "mcast_rerequester_port") cfg.mcast_rerequester_port = (uint16_t)std::atoi(val.c_str());
             else if (key == "protocol_spec") cfg.protocol_spec = val;
+            else if (key == "alternate_interface_ip") cfg.alternate_interface_ip = val;
+            else if (key == "alternate_source_ip") cfg.alternate_source_ip = val;
+        }
+        else if (section == "CHANNEL") {
+            ChannelConfig& channel = cfg.channels.back();
+            if      (key == "mcast_ip") channel.mcast_ip = val;
+            else if (key == "mcast_port") channel.mcast_port = (uint16_t)std::atoi(val.c_str());
+            else if (key == "mcast_source_ip") channel.mcast_source_ip = val;
+            else if (key == "interface_ip") channel.interface_ip = val;
+            else if (key == "mcast_rerequester_ip") channel.mcast_rerequester_ip = val;
+            else if (key == "mcast_rerequester_port") channel.mcast_rerequester_port = (uint16_t)std::atoi(val.c_str());
+            else if (key == "protocol_spec") channel.protocol_spec = val;
+            else if (key == "alternate_interface_ip") channel.alternate_interface_ip = val;
+            else if (key == "alternate_source_ip") channel.alternate_source_ip = val;
+        }
+        else if (section == "LATENCY_SETTINGS") {
+            if (key == "clock_offset_ns") cfg.latency_clock_offset_ns = std::strtoll(val.c_str(), 0, 10);
+            else if (key == "report_interval_ms") cfg.latency_report_interval_ms = std::strtoull(val.c_str(), 0, 10);
+            else if (key == "kernel_timestamps") cfg.latency_kernel_timestamps = std::atoi(val.c_str()) != 0;
+        }
+        else if (section == "PROFILE_SETTINGS") {
+            if (key == "report_interval_ms") cfg.profile_report_interval_ms = std::strtoull(val.c_str(), 0, 10);
+        }
+        else if (section == "CLOCK_SETTINGS") {
+            if (key == "use_tsc") cfg.clock_use_tsc = std::atoi(val.c_str()) != 0;
+            else if (key == "calibrate_interval_ms") cfg.clock_calibrate_interval_ms = (uint32_t)std::strtoul(val.c_str(), 0, 10);
+        }
+        else if (section == "TRACE_SETTINGS") {
+            if (key == "ring_events") cfg.trace_ring_events = (uint32_t)std::strtoul(val.c_str(), 0, 10);
+            else if (key == "dump_dir") cfg.trace_dump_dir = val;
+            else if (key == "min_dump_interval_ms") cfg.trace_min_dump_interval_ms = (uint32_t)std::strtoul(val.c_str(), 0, 10);
+            else if (key == "max_dump_files") cfg.trace_max_dump_files = (uint32_t)std::strtoul(val.c_str(), 0, 10);
+            else if (key == "dump_on_gap") cfg.trace_dump_on_gap = std::atoi(val.c_str()) != 0;
+        }
+        else if (section == "WATCHDOG_SETTINGS") {
+            if (key == "idle_timeout_ms") cfg.watchdog_idle_ms = std::atoi(val.c_str());
+        }
+        else if (section == "CHANNEL_SETTINGS") {
+            if (key == "io_model") cfg.channel_threads = (val == "thread");
         }
         else if (section == "RECOVERY_SETTINGS") {
-            if (key == "max_recovery_message_count") {
-                cfg.max_recovery_message_count = (uint16_t)std::atoi(val.c_str());
+            if      (key == "max_recovery_message_count") cfg.max_recovery_message_count = (uint16_t)std::atoi(val.c_str());
+            else if (key == "min_recovery_message_count") cfg.min_recovery_message_count = (uint16_t)std::atoi(val.c_str());
+            else if (key == "initial_timeout_ms") cfg.recovery_initial_timeout_ms = std::atoi(val.c_str());
+            else if (key == "min_timeout_ms") cfg.recovery_min_timeout_ms = std::atoi(val.c_str());
+            else if (key == "max_timeout_ms") cfg.recovery_max_timeout_ms = std::atoi(val.c_str());
+            else if (key == "max_retries") cfg.recovery_max_retries = std::atoi(val.c_str());
+            else if (key == "max_requests_per_second") cfg.recovery_max_requests_per_second = (uint32_t)std::strtoul(val.c_str(), 0, 10);
+            else if (key == "reorder_window_us") cfg.reorder_window_us = std::atoi(val.c_str());
+            else if (key == "cache_messages") cfg.recovery_cache_messages = std::strtoull(val.c_str(), 0, 10);
+            else if (key == "cache_bytes") cfg.recovery_cache_bytes = std::strtoull(val.c_str(), 0, 10);
+        }
+        else if (section == "OUTPUT_SETTINGS") {
+            if      (key == "fields") cfg.output_fields.push_back(val);
+            else if (key == "filter") cfg.output_filters.push_back(val);
+        }
+        else if (section == "SNAPSHOT_SETTINGS") {
+            if      (key == "snapshot_path") cfg.snapshot_path = val;
+            else if (key == "snapshot_interval_messages") cfg.snapshot_interval_messages = std::strtoull(val.c_str(), 0, 10);
+        }
+        else if (section == "RECORD_SETTINGS") {
+            if (key == "index_interval_messages") {
+                cfg.index_interval_messages = (uint32_t)std::strtoul(val.c_str(), 0, 10);
+            }
+        }
+        else if (section == "EXPORT_SETTINGS") {
+            if      (key == "chunk_rows") cfg.export_chunk_rows = (uint32_t)std::strtoul(val.c_str(), 0, 10);
+            else if (key == "compress_columns") cfg.export_compress_columns = val;
+        }
+        else if (section == "SHM_RING_SETTINGS") {
+            if (key == "shm_ring_slots") {
+                cfg.shm_ring_slots = std::strtoull(val.c_str(), 0, 10);
             }
         }
+        else if (section == "REPUBLISH_SETTINGS") {
+            if      (key == "mcast_ip") cfg.republish_mcast_ip = val;
+            else if (key == "mcast_port") cfg.republish_mcast_port = (uint16_t)std::atoi(val.c_str());
+            else if (key == "interface_ip") cfg.republish_interface_ip = val;
+            else if (key == "ttl") cfg.republish_ttl = std::atoi(val.c_str());
+            else if (key == "mtu") cfg.republish_mtu = std::atoi(val.c_str());
+            else if (key == "rerequest_port") cfg.republish_rerequest_port = (uint16_t)std::atoi(val.c_str());
+            else if (key == "retain_messages") cfg.republish_retain_messages = std::strtoull(val.c_str(), 0, 10);
+            else if (key == "retain_bytes") cfg.republish_retain_bytes = std::strtoull(val.c_str(), 0, 10);
+        }
     }
 
-    if (cfg.mcast_ip.empty()) return false;
-    if (cfg.mcast_port == 0) return false;
-    if (cfg.interface_ip.empty()) return false;
-    if (cfg.protocol_spec.empty()) return false;
+    // No [CHANNEL] sections: the one
+    // feed in [FEED_CHANNELS]
+    if (cfg.channels.empty()) {
+        ChannelConfig channel;
+        channel.name = "default";
+        cfg.channels.push_back(channel);
+    }
 
-    cfg.protocol_spec = config_absolute_path(config_path, cfg.protocol_spec);
+    for (size_t i = 0; i < cfg.channels.size(); i++) {
+        ChannelConfig& channel = cfg.channels[i];
+        if (channel.mcast_ip.empty()) channel.mcast_ip = cfg.mcast_ip;
+        if (channel.mcast_port == 0) channel.mcast_port = cfg.mcast_port;
+        if (channel.mcast_source_ip.empty()) channel.mcast_source_ip = cfg.mcast_source_ip;
+        if (channel.interface_ip.empty()) channel.interface_ip = cfg.interface_ip;
+        if (channel.mcast_rerequester_ip.empty()) channel.mcast_rerequester_ip = cfg.mcast_rerequester_ip;
+        if (channel.mcast_rerequester_port == 0) channel.mcast_rerequester_port = cfg.mcast_rerequester_port;
+        if (channel.protocol_spec.empty()) channel.protocol_spec = cfg.protocol_spec;
+        if (channel.alternate_interface_ip.empty()) channel.alternate_interface_ip = cfg.alternate_interface_ip;
+        if (channel.alternate_source_ip.empty()) channel.alternate_source_ip = cfg.alternate_source_ip;
+
+        if (channel.mcast_ip.empty()) return false;
+        if (channel.mcast_port == 0) return false;
+        if (channel.interface_ip.empty()) return false;
+        if (channel.protocol_spec.empty()) return false;
+
+        channel.protocol_spec = config_absolute_path(config_path, channel.protocol_spec);
+    }
 
-    app_config = cfg;
-    if (!load_spec(app_config.protocol_spec, &app_config)) {
+    cfg.snapshot_path = config_absolute_path(config_path, cfg.snapshot_path);
+
+    // First channel until one is picked
+    const ChannelConfig& first = cfg.channels[0];
+    cfg.channel_name = first.name;
+    cfg.mcast_ip = first.mcast_ip;
+    cfg.mcast_port = first.mcast_port;
+    cfg.mcast_source_ip = first.mcast_source_ip;
+    cfg.interface_ip = first.interface_ip;
+    cfg.mcast_rerequester_ip = first.mcast_rerequester_ip;
+    cfg.mcast_rerequester_port = first.mcast_rerequester_port;
+    cfg.protocol_spec = first.protocol_spec;
+    cfg.alternate_interface_ip = first.alternate_interface_ip;
+    cfg.alternate_source_ip = first.alternate_source_ip;
+
+    *out = cfg;
+    if (!load_spec(out->protocol_spec, out)) {
         return false;
     }
 
     return true;
 }
 
+bool use_channel(AppConfig* cfg, const std::string& name) {
+    const ChannelConfig* channel = 0;
+    for (size_t i = 0; i < cfg->channels.size(); i++) {
+        if (cfg->channels[i].name == name) {
+            channel = &cfg->channels[i];
+        }
+    }
+    if (!channel) {
+        return false;
+    }
+
+    cfg->channel_name = channel->name;
+    cfg->mcast_ip = channel->mcast_ip;
+    cfg->mcast_port = channel->mcast_port;
+    cfg->mcast_source_ip = channel->mcast_source_ip;
+    cfg->interface_ip = channel->interface_ip;
+    cfg->mcast_rerequester_ip = channel->mcast_rerequester_ip;
+    cfg->mcast_rerequester_port = channel->mcast_rerequester_port;
+    cfg->alternate_interface_ip = channel->alternate_interface_ip;
+    cfg->alternate_source_ip = channel->alternate_source_ip;
+
+    if (channel->protocol_spec == cfg->protocol_spec) {
+        return true;
+    }
+
+    cfg->protocol_spec = channel->protocol_spec;
+    return load_spec(cfg->protocol_spec, cfg);
+}
+
+bool load_config(const char* config_path) {
+    return load_config_file(config_path, &app_config);
+}
+
+bool select_channel(const std::string& name) {
+    return use_channel(&app_config, name);
+}
+
 const AppConfig& config() {
     return app_config;
 }
@@ -0,0 +1,408 @@
+#include "config_reload.h"
+#include "field_decode.h"
+
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <new>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+
+static volatile sig_atomic_t hangup_requested = 0;
+
+static void on_hangup(int) {
+    hangup_requested = 1;
+}
+
+// AppConfig holds 64-byte aligned
+// plans, plain new is not enough
+// before C++17
+RuntimeConfig* create_runtime_config() {
+    void* memory = 0;
+    if (::posix_memalign(&memory, 64, sizeof(RuntimeConfig)) != 0) {
+        return 0;
+    }
+    return new (memory) RuntimeConfig();
+}
+
+void destroy_runtime_config(RuntimeConfig* rc) {
+    if (!rc) {
+        return;
+    }
+    rc->~RuntimeConfig();
+    std::free(rc);
+}
+
+static std::string dir_of(const std::string& path) {
+    size_t slash = path.find_last_of('/');
+    if (slash == std::string::npos) {
+        return ".";
+    }
+    if (slash == 0) {
+        return "/";
+    }
+    return path.substr(0, slash);
+}
+
+static std::string file_of(const std::string& path) {
+    size_t slash = path.find_last_of('/');
+    return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+// Same message types, field names,
+// types and offsets
+static bool same_layout(const AppConfig& a, const AppConfig& b) {
+    for (int t = 0; t < 256; t++) {
+        const MsgSpec* x = a.spec_by_type[t];
+        const MsgSpec* y = b.spec_by_type[t];
+        if (!x || !y) {
+            if (x != y) {
+                return false;
+            }
+            continue;
+        }
+
+        if (x->total_length != y->total_length || x->fields.size() != y->fields.size()) {
+            return false;
+        }
+        for (size_t i = 0; i < x->fields.size(); i++) {
+            const FieldSpec& f = x->fields[i];
+            const FieldSpec& g = y->fields[i];
+            if (f.name != g.name || f.type != g.type || f.size != g.size || f.offset != g.offset) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+OutputInputs::OutputInputs()
+: layout_pinned(false),
+  projection_pinned(false) {
+    std::memset(keep_masks, 0, sizeof(keep_masks));
+}
+
+bool compile_output(const AppConfig& cfg, const OutputInputs& inputs,
+                    DecodePlans* plans, Predicate* predicate, std::string* error) {
+    *plans = cfg.plans;
+
+    std::vector<std::string> projections = cfg.output_fields;
+    projections.insert(projections.end(), inputs.projections.begin(), inputs.projections.end());
+
+    if (!projections.empty()) {
+        if (!project_decode_plans(plans, projections, inputs.keep_masks, error)) {
+            return false;
+        }
+    }
+
+    std::vector<std::string> expressions = cfg.output_filters;
+    expressions.insert(expressions.end(), inputs.filters.begin(), inputs.filters.end());
+
+    if (!expressions.empty()) {
+        if (!predicate->compile(expressions, cfg, error)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+ConfigReloader::ConfigReloader()
+: base(0),
+  inotify_fd(-1),
+  generation(0),
+  latest(0),
+  in_use(0),
+  previous(0),
+  current(0),
+  holding_previous(false),
+  running(false) {}
+
+ConfigReloader::~ConfigReloader() {
+    stop();
+}
+
+bool ConfigReloader::start(const std::string& path, const AppConfig& base_cfg,
+                           const OutputInputs& output_inputs) {
+    config_path = path;
+    base = &base_cfg;
+    inputs = output_inputs;
+
+    // Restart recv() instead of
+    // failing it with EINTR
+    struct sigaction action;
+    std::memset(&action, 0, sizeof(action));
+    action.sa_handler = on_hangup;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    if (::sigaction(SIGHUP, &action, 0) != 0) {
+        return false;
+    }
+
+    inotify_fd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_fd < 0) {
+        std::printf(">> WARN: inotify unavailable (%s), reload on SIGHUP only\n",
+                    std::strerror(errno));
+    } else {
+        watch_files(base_cfg.protocol_spec);
+    }
+
+    running = true;
+    watcher = std::thread(&ConfigReloader::watch_loop, this);
+    return true;
+}
+
+void ConfigReloader::stop() {
+    if (running.exchange(false)) {
+        watcher.join();
+    }
+
+    if (inotify_fd >= 0) {
+        ::close(inotify_fd);
+        inotify_fd = -1;
+    }
+
+    for (size_t i = 0; i < published.size(); i++) {
+        destroy_runtime_config(published[i]);
+    }
+    published.clear();
+    latest = 0;
+    in_use = 0;
+    previous = 0;
+    current = 0;
+}
+
+// Watch the directories: editors save
+// by writing a new file and renaming
+void ConfigReloader::watch_files(const std::string& spec_path) {
+    if (inotify_fd < 0) {
+        return;
+    }
+
+    std::vector<std::string> files;
+    files.push_back(config_path);
+    files.push_back(spec_path);
+    if (files == watched_files) {
+        return;
+    }
+
+    for (size_t i = 0; i < watches.size(); i++) {
+        ::inotify_rm_watch(inotify_fd, watches[i]);
+    }
+    watches.clear();
+
+    for (size_t i = 0; i < files.size(); i++) {
+        int wd = ::inotify_add_watch(inotify_fd, dir_of(files[i]).c_str(),
+                                     IN_CLOSE_WRITE | IN_MOVED_TO);
+        if (wd < 0) {
+            std::printf(">> WARN: cannot watch %s (%s)\n", files[i].c_str(), std::strerror(errno));
+            continue;
+        }
+        watches.push_back(wd);
+    }
+    watched_files = files;
+}
+
+void ConfigReloader::watch_loop() {
+    bool pending = false;
+
+    while (running) {
+        pollfd pfd;
+        pfd.fd = inotify_fd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+
+        // Short wait also settles a burst
+        // of writes into one reload
+        int ready = ::poll(&pfd, inotify_fd >= 0 ? 1 : 0, 200);
+
+        if (ready > 0 && (pfd.revents & POLLIN)) {
+            alignas(inotify_event) char events[4096];
+            ssize_t n = ::read(inotify_fd, events, sizeof(events));
+
+            for (ssize_t off = 0; off < n;) {
+                const inotify_event* event = (const inotify_event*)(events + off);
+                if (event->len != 0) {
+                    for (size_t i = 0; i < watched_files.size(); i++) {
+                        if (file_of(watched_files[i]) == event->name) {
+                            pending = true;
+                        }
+                    }
+                }
+                off += sizeof(inotify_event) + event->len;
+            }
+            continue;
+        }
+
+        if (hangup_requested) {
+            hangup_requested = 0;
+            pending = true;
+        }
+
+        if (pending) {
+            pending = false;
+            reload();
+        }
+    }
+}
+
+bool ConfigReloader::build(RuntimeConfig* next, std::string* error) {
+    AppConfig& cfg = next->cfg;
+
+    if (!load_config_file(config_path.c_str(), &cfg)) {
+        *error = "failed to load " + config_path + " or its spec";
+        return false;
+    }
+    if (!use_channel(&cfg, base->channel_name)) {
+        *error = "channel " + base->channel_name + " no longer configured";
+        return false;
+    }
+
+    // Needs a new socket / join
+    struct SocketKey {
+        const char* name;
+        bool changed;
+    };
+    const SocketKey socket_keys[] = {
+        { "mcast_ip", cfg.mcast_ip != base->mcast_ip },
+        { "mcast_port", cfg.mcast_port != base->mcast_port },
+        { "mcast_source_ip", cfg.mcast_source_ip != base->mcast_source_ip },
+        { "interface_ip", cfg.interface_ip != base->interface_ip },
+        { "mcast_rerequester_ip", cfg.mcast_rerequester_ip != base->mcast_rerequester_ip },
+        { "mcast_rerequester_port", cfg.mcast_rerequester_port != base->mcast_rerequester_port },
+        { "REPUBLISH_SETTINGS", cfg.republish_mcast_ip != base->republish_mcast_ip ||
+                                cfg.republish_mcast_port != base->republish_mcast_port ||
+                                cfg.republish_interface_ip != base->republish_interface_ip ||
+                                cfg.republish_rerequest_port != base->republish_rerequest_port ||
+                                cfg.republish_ttl != base->republish_ttl ||
+                                cfg.republish_mtu != base->republish_mtu }
+    };
+    for (size_t i = 0; i < sizeof(socket_keys) / sizeof(socket_keys[0]); i++) {
+        if (socket_keys[i].changed) {
+            *error = std::string(socket_keys[i].name) + " changed, needs a restart";
+            return false;
+        }
+    }
+
+    if (inputs.layout_pinned && !same_layout(cfg, *base)) {
+        *error = "spec layout changed while book/record/export/shm use it, needs a restart";
+        return false;
+    }
+    if (inputs.projection_pinned && cfg.output_fields != base->output_fields) {
+        *error = "fields changed while exporting, needs a restart";
+        return false;
+    }
+
+    // Sized or opened at startup,
+    // keep the running values
+    bool kept = false;
+    if (cfg.snapshot_path != base->snapshot_path) { cfg.snapshot_path = base->snapshot_path; kept = true; }
+    if (cfg.recovery_cache_messages != base->recovery_cache_messages) { cfg.recovery_cache_messages = base->recovery_cache_messages; kept = true; }
+    if (cfg.recovery_cache_bytes != base->recovery_cache_bytes) { cfg.recovery_cache_bytes = base->recovery_cache_bytes; kept = true; }
+    if (cfg.index_interval_messages != base->index_interval_messages) { cfg.index_interval_messages = base->index_interval_messages; kept = true; }
+    if (cfg.export_chunk_rows != base->export_chunk_rows) { cfg.export_chunk_rows = base->export_chunk_rows; kept = true; }
+    if (cfg.export_compress_columns != base->export_compress_columns) { cfg.export_compress_columns = base->export_compress_columns; kept = true; }
+    if (cfg.shm_ring_slots != base->shm_ring_slots) { cfg.shm_ring_slots = base->shm_ring_slots; kept = true; }
+    if (cfg.republish_retain_messages != base->republish_retain_messages) { cfg.republish_retain_messages = base->republish_retain_messages; kept = true; }
+    if (cfg.republish_retain_bytes != base->republish_retain_bytes) { cfg.republish_retain_bytes = base->republish_retain_bytes; kept = true; }
+    if (cfg.clock_use_tsc != base->clock_use_tsc) { cfg.clock_use_tsc = base->clock_use_tsc; kept = true; }
+    if (cfg.clock_calibrate_interval_ms != base->clock_calibrate_interval_ms) { cfg.clock_calibrate_interval_ms = base->clock_calibrate_interval_ms; kept = true; }
+    if (cfg.trace_ring_events != base->trace_ring_events) { cfg.trace_ring_events = base->trace_ring_events; kept = true; }
+    if (cfg.trace_dump_dir != base->trace_dump_dir) { cfg.trace_dump_dir = base->trace_dump_dir; kept = true; }
+    if (cfg.trace_min_dump_interval_ms != base->trace_min_dump_interval_ms) { cfg.trace_min_dump_interval_ms = base->trace_min_dump_interval_ms; kept = true; }
+    if (cfg.trace_max_dump_files != base->trace_max_dump_files) { cfg.trace_max_dump_files = base->trace_max_dump_files; kept = true; }
+    if (cfg.trace_dump_on_gap != base->trace_dump_on_gap) { cfg.trace_dump_on_gap = base->trace_dump_on_gap; kept = true; }
+    if (kept) {
+        std::printf(">> WARN: config reload: snapshot/cache/record/export/shm/retain sizes apply on restart\n");
+    }
+
+    return compile_output(cfg, inputs, &next->plans, &next->predicate, error);
+}
+
+void ConfigReloader::reload() {
+    RuntimeConfig* next = create_runtime_config();
+    if (!next) {
+        std::printf(">> CONFIG RELOAD REJECTED: out of memory\n");
+        return;
+    }
+
+    // A half-saved spec throws
+    // from the JSON parser
+    std::string error;
+    bool ok = false;
+    try {
+        ok = build(next, &error);
+    } catch (const std::exception& e) {
+        error = std::string("spec: ") + e.what();
+        ok = false;
+    }
+
+    if (!ok) {
+        std::printf(">> CONFIG RELOAD REJECTED: %s\n", error.c_str());
+        destroy_runtime_config(next);
+        return;
+    }
+
+    reclaim();
+
+    next->generation = ++generation;
+    published.push_back(next);
+    latest.store(next);
+
+    watch_files(next->cfg.protocol_spec);
+    std::printf(">> CONFIG RELOAD READY: Generation=%llu\n", (unsigned long long)next->generation);
+}
+
+// Free what the hot thread can no
+// longer reach: not latest, and
+// not in a hazard slot
+void ConfigReloader::reclaim() {
+    RuntimeConfig* keep_latest = latest.load();
+    RuntimeConfig* keep_in_use = in_use.load();
+    RuntimeConfig* keep_previous = previous.load();
+
+    size_t kept = 0;
+    for (size_t i = 0; i < published.size(); i++) {
+        RuntimeConfig* rc = published[i];
+        if (rc == keep_latest || rc == keep_in_use || rc == keep_previous) {
+            published[kept++] = rc;
+        } else {
+            destroy_runtime_config(rc);
+        }
+    }
+    published.resize(kept);
+}
+
+RuntimeConfig* ConfigReloader::poll() {
+    RuntimeConfig* next = latest.load(std::memory_order_acquire);
+    if (next == current) {
+        if (holding_previous) {
+            previous.store(0);
+            holding_previous = false;
+        }
+        return 0;
+    }
+
+    // Old one is still read until the
+    // caller has switched over
+    previous.store(current);
+    holding_previous = true;
+
+    // Publish the hazard, then check it
+    // was not replaced in between
+    for (;;) {
+        in_use.store(next);
+        RuntimeConfig* again = latest.load();
+        if (again == next) {
+            break;
+        }
+        next = again;
+    }
+
+    current = next;
+    return next;
+}
@@ -1,6 +1,10 @@
 #include "decoder.h"
+#include "field_decode.h"
+#include "probes.h"
 
 #include <cstdio>
+#include <cstring>
+#include <ctime>
 
 // Read 2 bytes as big-endian (network order)
 // unsigned 16-bit value.
@@ -44,34 +48,31 @@ static uint32_t read_u32_big_endian(const uint8_t* bytes) {
            (b3 << 0);
 }
 
-static void print_field_value(FieldType type, const uint8_t* field_data, uint32_t size) {
+static void print_field_value(FieldType type, const uint8_t* field_data, uint32_t size,
+                              uint64_t value) {
     switch (type) {
         case STRING:
             std::printf("%.*s", (int)size, (const char*)field_data);
             return;
         case CHAR:
-            std::printf("%c", (char)field_data[0]);
+            std::printf("%c", (char)value);
             return;
         case UINT8:
-            std::printf("%u", (unsigned)field_data[0]);
-            return;
         case UINT16:
-            std::printf("%u", (unsigned)read_u16_big_endian(field_data));
-            return;
         case UINT32:
-            std::printf("%u", (unsigned)read_u32_big_endian(field_data));
+            std::printf("%u", (unsigned)value);
             return;
         case UINT64:
-            std::printf("%llu", (unsigned long long)read_u64_big_endian(field_data));
+            std::printf("%llu", (unsigned long long)value);
             return;
         case INT16:
-            std::printf("%d", (int)(int16_t)read_u16_big_endian(field_data));
+            std::printf("%d", (int)(int16_t)value);
             return;
         case INT32:
-            std::printf("%d", (int)(int32_t)read_u32_big_endian(field_data));
+            std::printf("%d", (int)(int32_t)value);
             return;
         case INT64:
-            std::printf("%lld", (long long)(int64_t)read_u64_big_endian(field_data));
+            std::printf("%lld", (long long)(int64_t)value);
             return;
         case BINARY:
         default:
@@ -82,6 +83,95 @@ static void print_field_value(FieldType type, const uint8_t* field_data, uint32_
     }
 }
 
+uint64_t read_field_unsigned(const uint8_t* field_data, FieldType type) {
+    switch (type) {
+        case CHAR:
+        case UINT8:
+            return (uint64_t)field_data[0];
+        case UINT16:
+        case INT16:
+            return (uint64_t)read_u16_big_endian(field_data);
+        case UINT32:
+        case INT32:
+            return (uint64_t)read_u32_big_endian(field_data);
+        case UINT64:
+        case INT64:
+            return read_u64_big_endian(field_data);
+        case STRING:
+        case BINARY:
+        default:
+            return 0;
+    }
+}
+
+uint16_t normalize_message(const uint8_t* msg, uint16_t msg_len,
+                           const DecodedFields* fields, uint8_t* out, uint16_t capacity) {
+
+    uint16_t copy_len = msg_len < capacity ? msg_len : capacity;
+
+    const TypePlan* type = fields ? fields->type : 0;
+    if (!type) {
+        std::memcpy(out, msg, copy_len);
+        return copy_len;
+    }
+
+    // Projected: only the selected
+    // fields are copied, rest is zero
+    if (type->projected) {
+        std::memset(out, 0, copy_len);
+        out[0] = msg[0];
+    } else {
+        std::memcpy(out, msg, copy_len);
+    }
+
+    const PlanField* plan = plan_fields(*fields->plans, type);
+    for (uint16_t i = 0; i < fields->count; i++) {
+        const PlanField& field = plan[i];
+        if (field.offset + field.size > copy_len) {
+            break;
+        }
+
+        if (!field_output(type, i)) {
+            continue;
+        }
+
+        if (type->projected && field.width == 0) {
+            std::memcpy(out + field.offset, msg + field.offset, field.size);
+            continue;
+        }
+
+        uint8_t* out_data = out + field.offset;
+        uint64_t value = fields->values[i];
+
+        switch ((FieldType)field.type) {
+            case CHAR:
+            case UINT8:
+                out_data[0] = (uint8_t)value;
+                break;
+            case UINT16:
+            case INT16: {
+                uint16_t host = (uint16_t)value;
+                std::memcpy(out_data, &host, sizeof(host));
+                break;
+            }
+            case UINT32:
+            case INT32: {
+                uint32_t host = (uint32_t)value;
+                std::memcpy(out_data, &host, sizeof(host));
+                break;
+            }
+            case UINT64:
+            case INT64:
+                std::memcpy(out_data, &value, sizeof(value));
+                break;
+            default:
+                break;
+        }
+    }
+
+    return copy_len;
+}
+
 bool parse_mold_header(const uint8_t* packet, int packet_len, MoldHeader* out) {
     if (!packet) return false;
     if (!out) return false;
@@ -95,6 +185,7 @@ bool parse_mold_header(const uint8_t* packet, int packet_len, MoldHeader* out) {
     out->sequence_number = read_u64_big_endian(packet + 10);
     out->message_count = read_u16_big_endian(packet + 10 + 8);
 
+    ITCH_PROBE3(mold_header, out->sequence_number, out->message_count, packet_len);
     return true;
 }
 
@@ -131,37 +222,95 @@ bool next_mold_message(const uint8_t* packet, int packet_len, int* offset,
     return true;
 }
 
-bool decode_itch_message(const uint8_t* msg, uint16_t msg_len,
-                         const AppConfig& cfg, const std::string& session,
-                         uint64_t seq, uint16_t packet_msg_count, bool verbose) {
+uint16_t scan_mold_messages(const uint8_t* packet, int packet_len,
+                            uint64_t first_seq, int* offset,
+                            uint16_t* remaining, MoldBatch* batch) {
+
+    if (!packet || !offset || !remaining || !batch) {
+        return 0;
+    }
+
+    uint16_t want = *remaining;
+    if (want > MOLD_BATCH_CAPACITY) {
+        want = MOLD_BATCH_CAPACITY;
+    }
+
+    // Packets are at most 64KB so
+    // offsets fit 16 bits; bounds are
+    // checked once per message against
+    // the end of the packet
+    int pos = *offset;
+    int end = packet_len;
+    uint16_t count = 0;
+
+    while (count < want && pos + 2 <= end) {
+        uint16_t length = read_u16_big_endian(packet + pos);
+        int body = pos + 2;
+
+        if (body + (int)length > end) {
+            break;
+        }
+
+        MoldMessageRef& ref = batch->refs[count];
+        ref.sequence = first_seq + count;
+        ref.offset = (uint16_t)body;
+        ref.length = length;
+        ref.reserved = 0;
+        batch->types[count] = length != 0 ? packet[body] : 0;
+
+        count++;
+        pos = body + (int)length;
+    }
+
+    batch->count = count;
+    *offset = pos;
+    *remaining = (uint16_t)(*remaining - count);
+    return count;
+}
+
+bool print_itch_message(const uint8_t* msg, uint16_t msg_len,
+                        const DecodedFields& fields, const std::string& session,
+                        uint64_t seq, uint16_t packet_msg_count,
+                        const char* exchange_time, bool verbose) {
 
     if (!msg || msg_len == 0) {
         return false;
     }
 
     char msg_type = (char)msg[0];
-    const MsgSpec* spec = cfg.spec_by_type[(unsigned char)msg_type];
+    const TypePlan* type = fields.type;
 
     std::printf(">> {'%.*s', %llu, %u",
                 (int)session.size(), session.c_str(),
                 (unsigned long long)seq,
                 (unsigned)packet_msg_count);
 
-    if (!spec) {
+    if (exchange_time) {
+        std::printf(verbose ? ", 'ExchangeTime=%s'" : ", '%s'", exchange_time);
+    }
+
+    if (!type) {
         std::printf(", 'Unknown(type=%c)'}\n", msg_type);
         return false;
     }
 
     // Validate MsgLength with Spec TotlaLength (if length is in the spec)
-    if (spec->total_length != 0 && msg_len != (uint16_t)spec->total_length) {
+    if (type->total_length != 0 && msg_len != type->total_length) {
         std::printf(", 'Length Mismatch', 'type=%c', 'exp=%u', 'got=%u'",
                     msg_type,
-                    (unsigned)spec->total_length,
+                    (unsigned)type->total_length,
                     (unsigned)msg_len);
     }
 
-    for (size_t i = 0; i < spec->fields.size(); i++) {
-        const FieldSpec& field = spec->fields[i];
+    const PlanField* plan = plan_fields(*fields.plans, type);
+
+    for (uint16_t i = 0; i < type->field_count; i++) {
+        const PlanField& field = plan[i];
+
+        // --fields projection
+        if (!field_output(type, i)) {
+            continue;
+        }
 
         if (field.offset + field.size > msg_len) {
             std::printf(", 'TRUNC', 'type=%c', 'need=%u', 'got=%u'}\n",
@@ -171,17 +320,133 @@ bool decode_itch_message(const uint8_t* msg, uint16_t msg_len,
             return false;
         }
 
+        // Past the decoded fields
+        // (very wide specs)
+        uint64_t value = 0;
+        if (i < fields.count) {
+            value = fields.values[i];
+        } else {
+            value = read_field_unsigned(msg + field.offset, (FieldType)field.type);
+        }
+
         const uint8_t* field_data = msg + field.offset;
         std::printf(", '");
 
         // verbose print
         if (verbose) {
-            std::printf("%s=", field.name.c_str());
+            std::printf("%s=", plan_name(*fields.plans, field.name));
         }
 
-        print_field_value(field.type, field_data, field.size);
+        print_field_value((FieldType)field.type, field_data, field.size, value);
         std::printf("'");
     }
     std::printf("}\n");
     return true;
 }
+
+ExchangeClock::ExchangeClock()
+: current_seconds(0),
+  text_seconds(~0ULL) {
+    std::memset(seconds_field, 0, sizeof(seconds_field));
+    std::memset(nanos_field, 0, sizeof(nanos_field));
+    text[0] = 0;
+}
+
+static void find_time_field(const MsgSpec& spec, const char* name, uint32_t* offset,
+                            uint32_t* size, FieldType* type) {
+    for (size_t i = 0; i < spec.fields.size(); i++) {
+        const FieldSpec& field = spec.fields[i];
+        if (field.name == name) {
+            *offset = field.offset;
+            *size = field.size;
+            *type = field.type;
+            return;
+        }
+    }
+}
+
+void ExchangeClock::init(const AppConfig& cfg) {
+    std::memset(seconds_field, 0, sizeof(seconds_field));
+    std::memset(nanos_field, 0, sizeof(nanos_field));
+
+    for (int t = 0; t < 256; t++) {
+        const MsgSpec* spec = cfg.spec_by_type[t];
+        if (!spec) {
+            continue;
+        }
+
+        TimeField& seconds = seconds_field[t];
+        find_time_field(*spec, "TimestampSeconds", &seconds.offset, &seconds.size, &seconds.type);
+
+        TimeField& nanos = nanos_field[t];
+        find_time_field(*spec, "TimestampNanoseconds", &nanos.offset, &nanos.size, &nanos.type);
+    }
+}
+
+void ExchangeClock::set_seconds(uint64_t seconds) {
+    current_seconds = seconds;
+}
+
+void ExchangeClock::reset() {
+    current_seconds = 0;
+}
+
+uint64_t ExchangeClock::update(const uint8_t* msg, uint16_t msg_len) {
+    if (!msg || msg_len == 0) {
+        return 0;
+    }
+
+    unsigned char type = msg[0];
+
+    const TimeField& seconds = seconds_field[type];
+    if (seconds.size != 0 && seconds.offset + seconds.size <= msg_len) {
+        current_seconds = read_field_unsigned(msg + seconds.offset, seconds.type);
+        return current_seconds * 1000000000ULL;
+    }
+
+    const TimeField& nanos = nanos_field[type];
+    if (nanos.size == 0 || nanos.offset + nanos.size > msg_len) {
+        return 0;
+    }
+
+    uint64_t value = read_field_unsigned(msg + nanos.offset, nanos.type);
+
+    // 8 byte field is already epoch ns,
+    // 4 byte field is ns within second
+    if (nanos.size >= 8) {
+        return value;
+    }
+
+    if (current_seconds == 0) {
+        return 0;
+    }
+
+    return current_seconds * 1000000000ULL + value;
+}
+
+const char* ExchangeClock::format(uint64_t epoch_ns) {
+    if (epoch_ns == 0) {
+        return "";
+    }
+
+    uint64_t seconds = epoch_ns / 1000000000ULL;
+    uint32_t nanos = (uint32_t)(epoch_ns % 1000000000ULL);
+
+    // "YYYY-MM-DD HH:MM:SS." kept
+    // until the second changes
+    if (seconds != text_seconds) {
+        time_t time_value = (time_t)seconds;
+        tm parts;
+        gmtime_r(&time_value, &parts);
+        std::strftime(text, sizeof(text), "%Y-%m-%d %H:%M:%S.", &parts);
+        text_seconds = seconds;
+    }
+
+    char* digits = text + 20;
+    for (int i = 8; i >= 0; i--) {
+        digits[i] = (char)('0' + nanos % 10);
+        nanos /= 10;
+    }
+    digits[9] = 0;
+    return text;
+}
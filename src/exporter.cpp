@@ -0,0 +1,308 @@
+#include "exporter.h"
+#include "decoder.h"
+
+#include <cstring>
+#include <cerrno>
+#include <sys/stat.h>
+
+static const char column_magic[8] = {'M', 'O', 'L', 'D', 'C', 'O', 'L', '1'};
+static const char chunk_magic[4] = {'C', 'H', 'N', 'K'};
+static const uint32_t column_version = 2;
+
+// Sequence, ExchangeTime
+static const size_t leading_columns = 2;
+
+static bool is_integer(FieldType type) {
+    switch (type) {
+        case UINT8:
+        case UINT16:
+        case UINT32:
+        case UINT64:
+        case INT16:
+        case INT32:
+        case INT64:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static bool column_selected(const std::string& list, const std::string& name) {
+    if (list == "*") {
+        return true;
+    }
+
+    size_t start = 0;
+    while (start < list.size()) {
+        size_t comma = list.find(',', start);
+        if (comma == std::string::npos) {
+            comma = list.size();
+        }
+
+        if (list.compare(start, comma - start, name) == 0) {
+            return true;
+        }
+        start = comma + 1;
+    }
+    return false;
+}
+
+// Store host order value
+// in size bytes
+static void put_fixed(std::vector<uint8_t>& out, uint64_t value, uint32_t size) {
+    uint8_t bytes[8];
+    switch (size) {
+        case 1: { uint8_t v = (uint8_t)value;   std::memcpy(bytes, &v, 1); break; }
+        case 2: { uint16_t v = (uint16_t)value; std::memcpy(bytes, &v, 2); break; }
+        case 4: { uint32_t v = (uint32_t)value; std::memcpy(bytes, &v, 4); break; }
+        default: std::memcpy(bytes, &value, 8); size = 8; break;
+    }
+    out.insert(out.end(), bytes, bytes + size);
+}
+
+static int64_t get_fixed(const uint8_t* data, FieldType type, uint32_t size) {
+    switch (size) {
+        case 1: { uint8_t v;  std::memcpy(&v, data, 1); return (int64_t)v; }
+        case 2: {
+            uint16_t v; std::memcpy(&v, data, 2);
+            return type == INT16 ? (int64_t)(int16_t)v : (int64_t)v;
+        }
+        case 4: {
+            uint32_t v; std::memcpy(&v, data, 4);
+            return type == INT32 ? (int64_t)(int32_t)v : (int64_t)v;
+        }
+        default: { uint64_t v; std::memcpy(&v, data, 8); return (int64_t)v; }
+    }
+}
+
+static void put_varint(std::vector<uint8_t>& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back((uint8_t)(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back((uint8_t)value);
+}
+
+ColumnExporter::ColumnExporter()
+: chunk_rows(65536) {
+    for (int t = 0; t < 256; t++) {
+        writers[t].spec = 0;
+        writers[t].file = 0;
+        writers[t].rows = 0;
+    }
+}
+
+ColumnExporter::~ColumnExporter() {
+    close();
+}
+
+bool ColumnExporter::open(const std::string& export_dir, const AppConfig& cfg, const DecodePlans& plans,
+                          uint32_t rows_per_chunk, const std::string& compress) {
+    close();
+
+    if (export_dir.empty()) {
+        return false;
+    }
+
+    if (::mkdir(export_dir.c_str(), 0755) < 0 && errno != EEXIST) {
+        return false;
+    }
+
+    dir = export_dir;
+    chunk_rows = rows_per_chunk ? rows_per_chunk : 65536;
+    compress_columns = compress;
+
+    for (int t = 0; t < 256; t++) {
+        writers[t].spec = cfg.spec_by_type[t];
+        writers[t].plan = &plans.types[t];
+        writers[t].file = 0;
+        writers[t].rows = 0;
+        writers[t].columns.clear();
+    }
+
+    return true;
+}
+
+void ColumnExporter::close() {
+    for (int t = 0; t < 256; t++) {
+        TypeWriter& writer = writers[t];
+        if (!writer.file) {
+            continue;
+        }
+
+        flush_chunk(writer);
+        std::fclose(writer.file);
+        writer.file = 0;
+    }
+}
+
+// Open file + write schema on
+// first message of a type
+bool ColumnExporter::open_type(TypeWriter& writer) {
+    const MsgSpec* spec = writer.spec;
+
+    std::string name = spec->name.empty() ? std::string(1, spec->msg_type) : spec->name;
+    std::string path = dir + "/" + name + ".col";
+
+    writer.file = std::fopen(path.c_str(), "wb");
+    if (!writer.file) {
+        writer.spec = 0;
+        return false;
+    }
+
+    std::setvbuf(writer.file, 0, _IOFBF, 1 << 20);
+
+    // Sequence column first
+    ColumnBuilder seq_column;
+    seq_column.type = UINT64;
+    seq_column.field_index = 0;
+    seq_column.offset = 0;
+    seq_column.size = 8;
+    seq_column.compress = column_selected(compress_columns, "Sequence");
+    writer.columns.push_back(seq_column);
+
+    ColumnBuilder time_column = seq_column;
+    time_column.compress = column_selected(compress_columns, "ExchangeTime");
+    writer.columns.push_back(time_column);
+
+    for (size_t i = 0; i < spec->fields.size(); i++) {
+        const FieldSpec& field = spec->fields[i];
+        if (!field_output(writer.plan, (uint32_t)i)) {
+            continue;
+        }
+
+        ColumnBuilder column;
+        column.type = field.type;
+        column.field_index = (uint32_t)i;
+        column.offset = field.offset;
+        column.size = field.size;
+        column.compress = is_integer(field.type) && column_selected(compress_columns, field.name);
+        writer.columns.push_back(column);
+    }
+
+    for (size_t i = 0; i < writer.columns.size(); i++) {
+        writer.columns[i].values.reserve((size_t)chunk_rows * writer.columns[i].size);
+    }
+
+    ColumnFileHeader file_header;
+    std::memset(&file_header, 0, sizeof(file_header));
+    std::memcpy(file_header.magic, column_magic, sizeof(file_header.magic));
+    file_header.version = column_version;
+    file_header.column_count = (uint32_t)writer.columns.size();
+    file_header.msg_type = spec->msg_type;
+    std::fwrite(&file_header, sizeof(file_header), 1, writer.file);
+
+    for (size_t i = 0; i < writer.columns.size(); i++) {
+        const char* column_name = "Sequence";
+        if (i == 1) {
+            column_name = "ExchangeTime";
+        } else if (i >= leading_columns) {
+            column_name = spec->fields[writer.columns[i].field_index].name.c_str();
+        }
+
+        ColumnDesc desc;
+        std::memset(&desc, 0, sizeof(desc));
+        desc.type = (uint8_t)writer.columns[i].type;
+        desc.name_len = (uint16_t)std::strlen(column_name);
+        desc.size = writer.columns[i].size;
+
+        std::fwrite(&desc, sizeof(desc), 1, writer.file);
+        std::fwrite(column_name, 1, desc.name_len, writer.file);
+    }
+
+    return true;
+}
+
+void ColumnExporter::append(const uint8_t* msg, uint16_t msg_len, uint64_t seq,
+                            uint64_t exchange_ns, const DecodedFields& fields) {
+    if (!msg || msg_len == 0) {
+        return;
+    }
+
+    TypeWriter& writer = writers[msg[0]];
+    if (!writer.spec) {
+        return;
+    }
+
+    // Short message would leave
+    // columns out of step
+    if (msg_len < writer.spec->total_length) {
+        return;
+    }
+
+    if (!writer.file && !open_type(writer)) {
+        return;
+    }
+
+    put_fixed(writer.columns[0].values, seq, 8);
+    put_fixed(writer.columns[1].values, exchange_ns, 8);
+
+    for (size_t i = leading_columns; i < writer.columns.size(); i++) {
+        ColumnBuilder& column = writer.columns[i];
+        const uint8_t* field_data = msg + column.offset;
+
+        if (is_integer(column.type)) {
+            put_fixed(column.values, fields.values[column.field_index], column.size);
+        } else {
+            // char / string / binary as is
+            column.values.insert(column.values.end(), field_data, field_data + column.size);
+        }
+    }
+
+    writer.rows++;
+    if (writer.rows >= chunk_rows) {
+        flush_chunk(writer);
+    }
+}
+
+void ColumnExporter::flush_chunk(TypeWriter& writer) {
+    if (!writer.file || writer.rows == 0) {
+        return;
+    }
+
+    ColumnChunkHeader chunk_header;
+    std::memcpy(chunk_header.magic, chunk_magic, sizeof(chunk_header.magic));
+    chunk_header.row_count = writer.rows;
+    std::fwrite(&chunk_header, sizeof(chunk_header), 1, writer.file);
+
+    for (size_t i = 0; i < writer.columns.size(); i++) {
+        ColumnBuilder& column = writer.columns[i];
+
+        uint8_t encoding = ENCODING_PLAIN;
+        const std::vector<uint8_t>* data = &column.values;
+
+        if (column.compress) {
+            // Zigzag delta varints, small
+            // for sequences, times, ids
+            encode_buffer.clear();
+            int64_t previous = 0;
+
+            for (uint32_t row = 0; row < writer.rows; row++) {
+                int64_t value = get_fixed(&column.values[(size_t)row * column.size],
+                                          column.type, column.size);
+                int64_t delta = (int64_t)((uint64_t)value - (uint64_t)previous);
+                put_varint(encode_buffer, ((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63));
+                previous = value;
+            }
+
+            encoding = ENCODING_DELTA_VARINT;
+            data = &encode_buffer;
+        }
+
+        uint8_t column_header[8];
+        std::memset(column_header, 0, sizeof(column_header));
+        column_header[0] = encoding;
+
+        uint32_t data_bytes = (uint32_t)data->size();
+        std::memcpy(column_header + 4, &data_bytes, sizeof(data_bytes));
+
+        std::fwrite(column_header, sizeof(column_header), 1, writer.file);
+        if (data_bytes > 0) {
+            std::fwrite(&(*data)[0], 1, data_bytes, writer.file);
+        }
+
+        column.values.clear();
+    }
+
+    writer.rows = 0;
+}
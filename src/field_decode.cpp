@@ -0,0 +1,496 @@
+#include "field_decode.h"
+
+#include <cstring>
+#include <unordered_map>
+#include <immintrin.h>
+
+// Bytes of the value read from a field,
+// 0 for string/binary.
+static uint32_t value_width(FieldType type) {
+    switch (type) {
+        case CHAR:
+        case UINT8:
+            return 1;
+        case UINT16:
+        case INT16:
+            return 2;
+        case UINT32:
+        case INT32:
+            return 4;
+        case UINT64:
+        case INT64:
+            return 8;
+        case STRING:
+        case BINARY:
+        default:
+            return 0;
+    }
+}
+
+static uint64_t load_field(const uint8_t* field_data, FieldType type) {
+    switch (type) {
+        case CHAR:
+        case UINT8:
+            return (uint64_t)field_data[0];
+        case UINT16:
+        case INT16: {
+            uint16_t value;
+            std::memcpy(&value, field_data, sizeof(value));
+            return (uint64_t)__builtin_bswap16(value);
+        }
+        case UINT32:
+        case INT32: {
+            uint32_t value;
+            std::memcpy(&value, field_data, sizeof(value));
+            return (uint64_t)__builtin_bswap32(value);
+        }
+        case UINT64:
+        case INT64: {
+            uint64_t value;
+            std::memcpy(&value, field_data, sizeof(value));
+            return __builtin_bswap64(value);
+        }
+        case STRING:
+        case BINARY:
+        default:
+            return 0;
+    }
+}
+
+static uint64_t full_mask(uint32_t field_count) {
+    return field_count >= 64 ? ~0ULL : (1ULL << field_count) - 1;
+}
+
+static bool in_mask(uint64_t mask, uint32_t index) {
+    return index >= 64 || ((mask >> index) & 1) != 0;
+}
+
+// Fields wholly inside msg_len,
+// stopping at the first one that isn't.
+// Only decode_mask fields are loaded.
+static uint16_t decode_scalar(const uint8_t* msg, uint16_t msg_len,
+                              const PlanField* fields, const TypePlan& type,
+                              uint64_t* values) {
+    uint16_t count = 0;
+
+    for (uint16_t i = 0; i < type.field_count && i < FIELD_PLAN_MAX_FIELDS; i++) {
+        const PlanField& field = fields[i];
+        uint32_t need = field.size > field.width ? field.size : field.width;
+
+        if ((uint32_t)field.offset + need > msg_len) {
+            break;
+        }
+
+        if (in_mask(type.decode_mask, i)) {
+            values[i] = load_field(msg + field.offset, (FieldType)field.type);
+        }
+        count++;
+    }
+
+    return count;
+}
+
+// Vector kernels read from a padded
+// copy so loads past the message end
+// stay inside the buffer. Each is built
+// with its own target attribute.
+
+__attribute__((target("ssse3")))
+static void decode_ssse3(const uint8_t* buffer, const FieldPlan& plan, uint64_t* values) {
+    for (uint16_t i = 0; i < plan.shuffle_count; i++) {
+        const FieldShuffle& op = plan.shuffles[i];
+
+        __m128i window = _mm_loadu_si128((const __m128i*)(buffer + op.src_offset));
+        __m128i mask = _mm_loadu_si128((const __m128i*)op.mask);
+        _mm_storeu_si128((__m128i*)(values + op.dst_field), _mm_shuffle_epi8(window, mask));
+    }
+}
+
+// Two windows per step,
+// one per 128-bit lane
+__attribute__((target("avx2")))
+static void decode_avx2(const uint8_t* buffer, const FieldPlan& plan, uint64_t* values) {
+    uint16_t i = 0;
+
+    for (; i + 2 <= plan.shuffle_count; i += 2) {
+        const FieldShuffle& low = plan.shuffles[i];
+        const FieldShuffle& high = plan.shuffles[i + 1];
+
+        __m256i windows = _mm256_inserti128_si256(
+            _mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)(buffer + low.src_offset))),
+            _mm_loadu_si128((const __m128i*)(buffer + high.src_offset)), 1);
+
+        __m256i masks = _mm256_inserti128_si256(
+            _mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)low.mask)),
+            _mm_loadu_si128((const __m128i*)high.mask), 1);
+
+        __m256i out = _mm256_shuffle_epi8(windows, masks);
+
+        // Low first: its spare lane may
+        // overlap the high destination
+        _mm_storeu_si128((__m128i*)(values + low.dst_field), _mm256_castsi256_si128(out));
+        _mm_storeu_si128((__m128i*)(values + high.dst_field), _mm256_extracti128_si256(out, 1));
+    }
+
+    if (i < plan.shuffle_count) {
+        const FieldShuffle& op = plan.shuffles[i];
+
+        __m128i window = _mm_loadu_si128((const __m128i*)(buffer + op.src_offset));
+        __m128i mask = _mm_loadu_si128((const __m128i*)op.mask);
+        _mm_storeu_si128((__m128i*)(values + op.dst_field), _mm_shuffle_epi8(window, mask));
+    }
+}
+
+// VPERMB: any byte of the 64 byte
+// message into 8 values per step
+__attribute__((target("avx512f,avx512bw,avx512vbmi")))
+static void decode_avx512(const uint8_t* buffer, const FieldPlan& plan, uint64_t* values) {
+    __m512i message = _mm512_loadu_si512((const void*)buffer);
+
+    for (uint16_t i = 0; i < plan.permute_count; i++) {
+        const FieldPermute& op = plan.permutes[i];
+
+        __m512i index = _mm512_loadu_si512((const void*)op.index);
+        __m512i out = _mm512_maskz_permutexvar_epi8((__mmask64)op.lane_mask, index, message);
+        _mm512_storeu_si512((void*)(values + op.dst_field), out);
+    }
+}
+
+static FieldKernel best_field_kernel() {
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx512vbmi") && __builtin_cpu_supports("avx512bw")) {
+        return FIELD_KERNEL_AVX512;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        return FIELD_KERNEL_AVX2;
+    }
+    if (__builtin_cpu_supports("ssse3")) {
+        return FIELD_KERNEL_SSSE3;
+    }
+    return FIELD_KERNEL_SCALAR;
+}
+
+static FieldKernel supported_kernel = best_field_kernel();
+static FieldKernel active_kernel = supported_kernel;
+
+// Shuffles: a window starts at a
+// decoded field and takes the next
+// field too if it is decoded and ends
+// within 16 bytes. Strings/binary and
+// fields outside decode_mask get no lane.
+// Lane byte j = field byte width-1-j
+// (big-endian -> host order)
+static void build_vector_plan(const PlanField* fields, uint16_t field_count,
+                              uint16_t required_len, uint64_t decode_mask,
+                              FieldPlan* plan) {
+    std::memset(plan, 0, sizeof(*plan));
+
+    uint16_t i = 0;
+    while (i < field_count) {
+        const PlanField& first = fields[i];
+        if (first.width == 0 || !in_mask(decode_mask, i)) {
+            i++;
+            continue;
+        }
+
+        FieldShuffle& op = plan->shuffles[plan->shuffle_count++];
+        std::memset(op.mask, 0x80, sizeof(op.mask));
+        op.src_offset = first.offset;
+        op.dst_field = i;
+
+        for (uint32_t j = 0; j < first.width; j++) {
+            op.mask[j] = (uint8_t)(first.width - 1 - j);
+        }
+        i++;
+
+        if (i < field_count) {
+            const PlanField& second = fields[i];
+
+            if (second.width != 0 && in_mask(decode_mask, i) &&
+                second.offset >= first.offset &&
+                second.offset + second.width <= first.offset + 16) {
+
+                uint32_t base = second.offset - first.offset;
+                for (uint32_t j = 0; j < second.width; j++) {
+                    op.mask[8 + j] = (uint8_t)(base + second.width - 1 - j);
+                }
+                i++;
+            }
+        }
+    }
+
+    // Permutes: 8 fields per step,
+    // only if the message fits 64 bytes.
+    // Groups with nothing to decode
+    // are left out.
+    if (required_len > 64) {
+        return;
+    }
+
+    for (uint16_t group = 0; group * 8 < field_count; group++) {
+        FieldPermute op;
+        std::memset(&op, 0, sizeof(op));
+        op.dst_field = (uint16_t)(group * 8);
+
+        for (uint16_t f = group * 8; f < field_count && f < group * 8 + 8; f++) {
+            const PlanField& field = fields[f];
+            if (!in_mask(decode_mask, f)) {
+                continue;
+            }
+
+            uint32_t lane = (uint32_t)(f % 8) * 8;
+            for (uint32_t j = 0; j < field.width; j++) {
+                op.index[lane + j] = (uint8_t)(field.offset + field.width - 1 - j);
+                op.lane_mask |= 1ULL << (lane + j);
+            }
+        }
+
+        if (op.lane_mask != 0) {
+            plan->permutes[plan->permute_count++] = op;
+        }
+    }
+}
+
+static uint16_t intern_name(DecodePlans& plans,
+                            std::unordered_map<std::string, uint16_t>& ids,
+                            const std::string& name) {
+    std::unordered_map<std::string, uint16_t>::iterator it = ids.find(name);
+    if (it != ids.end()) {
+        return it->second;
+    }
+
+    uint16_t id = (uint16_t)plans.names.size();
+    plans.names.push_back(name);
+    ids[name] = id;
+    return id;
+}
+
+bool compile_decode_plans(AppConfig* cfg) {
+    if (!cfg) {
+        return false;
+    }
+
+    DecodePlans& plans = cfg->plans;
+    std::memset(plans.fields, 0, sizeof(plans.fields));
+    std::memset(plans.types, 0, sizeof(plans.types));
+    plans.field_total = 0;
+    plans.vectors.clear();
+    plans.names.clear();
+
+    std::unordered_map<std::string, uint16_t> ids;
+
+    for (int t = 0; t < 256; t++) {
+        TypePlan& type = plans.types[t];
+        type.vector_plan = PLAN_NONE;
+
+        const MsgSpec* spec = cfg->spec_by_type[t];
+        if (!spec) {
+            continue;
+        }
+
+        // Each type starts on its own
+        // cache line (8 fields per line)
+        uint32_t first = (plans.field_total + 7) & ~7u;
+        uint32_t count = (uint32_t)spec->fields.size();
+        if (first + count > (uint32_t)DECODE_PLAN_MAX_FIELDS) {
+            return false;
+        }
+
+        uint32_t required = 0;
+        for (uint32_t i = 0; i < count; i++) {
+            const FieldSpec& field = spec->fields[i];
+            PlanField& out = plans.fields[first + i];
+
+            out.offset = (uint16_t)field.offset;
+            out.size = (uint16_t)field.size;
+            out.type = (uint8_t)field.type;
+            out.width = (uint8_t)value_width(field.type);
+            out.name = intern_name(plans, ids, field.name);
+
+            uint32_t end = field.offset + (field.size > out.width ? field.size : out.width);
+            if (end > required) {
+                required = end;
+            }
+        }
+
+        type.first_field = (uint16_t)first;
+        type.field_count = (uint16_t)count;
+        type.total_length = (uint16_t)spec->total_length;
+        type.required_len = (uint16_t)(required < 0xFFFF ? required : 0xFFFF);
+        type.name = intern_name(plans, ids, spec->name);
+        type.defined = 1;
+        type.output_mask = full_mask(count);
+        type.decode_mask = full_mask(count);
+
+        if (count <= (uint32_t)FIELD_PLAN_MAX_FIELDS && required <= (uint32_t)FIELD_PLAN_MAX_BYTES) {
+            FieldPlan vector_plan;
+            build_vector_plan(&plans.fields[first], (uint16_t)count, type.required_len,
+                              type.decode_mask, &vector_plan);
+
+            type.vector_plan = (uint16_t)plans.vectors.size();
+            plans.vectors.push_back(vector_plan);
+        }
+
+        plans.field_total = first + count;
+    }
+
+    return true;
+}
+
+bool project_decode_plans(DecodePlans* plans, const std::vector<std::string>& projections,
+                          const uint64_t* keep_masks, std::string* error) {
+    if (!plans) {
+        return false;
+    }
+
+    for (size_t p = 0; p < projections.size(); p++) {
+        const std::string& projection = projections[p];
+
+        // <type>:<name>[,<name>...]
+        if (projection.size() < 3 || projection[1] != ':') {
+            if (error) *error = "bad field projection '" + projection + "'";
+            return false;
+        }
+
+        TypePlan& type = plans->types[(unsigned char)projection[0]];
+        if (!type.defined) {
+            if (error) *error = "unknown message type in '" + projection + "'";
+            return false;
+        }
+
+        if (!type.projected) {
+            type.output_mask = 0;
+            type.projected = 1;
+        }
+
+        const PlanField* fields = &plans->fields[type.first_field];
+        size_t start = 2;
+
+        while (start <= projection.size()) {
+            size_t comma = projection.find(',', start);
+            if (comma == std::string::npos) {
+                comma = projection.size();
+            }
+
+            std::string name = projection.substr(start, comma - start);
+            start = comma + 1;
+
+            if (name.empty()) {
+                continue;
+            }
+
+            uint16_t found = PLAN_NONE;
+            for (uint16_t i = 0; i < type.field_count && i < 64; i++) {
+                if (plans->names[fields[i].name] == name) {
+                    found = i;
+                    break;
+                }
+            }
+
+            if (found == PLAN_NONE) {
+                if (error) *error = "unknown field '" + name + "' in '" + projection + "'";
+                return false;
+            }
+
+            type.output_mask |= 1ULL << found;
+        }
+    }
+
+    // Decode only what is output
+    // or kept for internal users
+    for (int t = 0; t < 256; t++) {
+        TypePlan& type = plans->types[t];
+        if (!type.defined) {
+            continue;
+        }
+
+        uint64_t keep = keep_masks ? keep_masks[t] : 0;
+        type.decode_mask = (type.output_mask | keep) & full_mask(type.field_count);
+
+        if (type.vector_plan != PLAN_NONE) {
+            build_vector_plan(&plans->fields[type.first_field], type.field_count,
+                              type.required_len, type.decode_mask,
+                              &plans->vectors[type.vector_plan]);
+        }
+    }
+
+    return true;
+}
+
+uint16_t decode_fields(const uint8_t* msg, uint16_t msg_len,
+                       const DecodePlans& plans, DecodedFields* out) {
+    if (!out) {
+        return 0;
+    }
+
+    out->plans = &plans;
+    out->type = 0;
+    out->count = 0;
+
+    if (!msg || msg_len == 0) {
+        return 0;
+    }
+
+    const TypePlan& type = plans.types[msg[0]];
+    if (!type.defined) {
+        return 0;
+    }
+    out->type = &type;
+
+    // Short message: only the fields
+    // it holds, one at a time
+    if (active_kernel == FIELD_KERNEL_SCALAR || type.vector_plan == PLAN_NONE ||
+        msg_len < type.required_len) {
+        out->count = decode_scalar(msg, msg_len, &plans.fields[type.first_field],
+                                   type, out->values);
+        return out->count;
+    }
+
+    const FieldPlan& plan = plans.vectors[type.vector_plan];
+
+    alignas(64) uint8_t buffer[FIELD_PLAN_MAX_BYTES + 16];
+    std::memcpy(buffer, msg, type.required_len);
+
+    FieldKernel kernel = active_kernel;
+    if (kernel == FIELD_KERNEL_AVX512 && plan.permute_count == 0) {
+        kernel = FIELD_KERNEL_AVX2;
+    }
+
+    switch (kernel) {
+        case FIELD_KERNEL_AVX512:
+            decode_avx512(buffer, plan, out->values);
+            break;
+        case FIELD_KERNEL_AVX2:
+            decode_avx2(buffer, plan, out->values);
+            break;
+        case FIELD_KERNEL_SSSE3:
+        default:
+            decode_ssse3(buffer, plan, out->values);
+            break;
+    }
+
+    out->count = type.field_count;
+    return out->count;
+}
+
+bool set_field_kernel(FieldKernel kernel) {
+    if (kernel > supported_kernel) {
+        return false;
+    }
+    active_kernel = kernel;
+    return true;
+}
+
+FieldKernel field_kernel() {
+    return active_kernel;
+}
+
+const char* field_kernel_name() {
+    switch (active_kernel) {
+        case FIELD_KERNEL_AVX512: return "avx512vbmi";
+        case FIELD_KERNEL_AVX2: return "avx2";
+        case FIELD_KERNEL_SSSE3: return "ssse3";
+        default: return "scalar";
+    }
+}
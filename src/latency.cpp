@@ -0,0 +1,202 @@
+#include "latency.h"
+#include "tsc_clock.h"
+
+#include <cstdio>
+#include <cstring>
+
+// 0..7 exact, then 8 sub-buckets
+// per power of two
+static int bucket_of(uint64_t ns) {
+    if (ns < 8) {
+        return (int)ns;
+    }
+    int msb = 63 - __builtin_clzll(ns);
+    return (msb - 2) * 8 + (int)((ns >> (msb - 3)) & 7);
+}
+
+static uint64_t bucket_upper(int index) {
+    if (index < 8) {
+        return (uint64_t)index;
+    }
+    int msb = index / 8 + 2;
+    uint64_t low = (uint64_t)(8 + index % 8) << (msb - 3);
+    return low + ((uint64_t)1 << (msb - 3)) - 1;
+}
+
+LatencyHistogram::LatencyHistogram() {
+    clear();
+}
+
+void LatencyHistogram::clear() {
+    std::memset(buckets, 0, sizeof(buckets));
+    total = 0;
+    min_ns = 0;
+    max_ns = 0;
+}
+
+void LatencyHistogram::record(uint64_t ns) {
+    buckets[bucket_of(ns)]++;
+
+    if (total == 0 || ns < min_ns) {
+        min_ns = ns;
+    }
+    if (ns > max_ns) {
+        max_ns = ns;
+    }
+    total++;
+}
+
+uint64_t LatencyHistogram::count() const {
+    return total;
+}
+
+uint64_t LatencyHistogram::min() const {
+    return min_ns;
+}
+
+uint64_t LatencyHistogram::max() const {
+    return max_ns;
+}
+
+uint64_t LatencyHistogram::percentile(double p) const {
+    if (total == 0) {
+        return 0;
+    }
+
+    uint64_t rank = (uint64_t)(p * (double)total);
+    if (rank >= total) {
+        rank = total - 1;
+    }
+
+    uint64_t seen = 0;
+    for (int i = 0; i < LATENCY_BUCKETS; i++) {
+        seen += buckets[i];
+        if (seen > rank) {
+            uint64_t upper = bucket_upper(i);
+            return upper < max_ns ? upper : max_ns;
+        }
+    }
+    return max_ns;
+}
+
+LatencyStats::LatencyStats()
+: window_start_ns(0),
+  next_report_ns(0) {
+    std::memset(wire.by_type, 0, sizeof(wire.by_type));
+    std::memset(decode.by_type, 0, sizeof(decode.by_type));
+    wire.early = 0;
+    decode.early = 0;
+}
+
+LatencyStats::~LatencyStats() {
+    for (int t = 0; t < 256; t++) {
+        delete wire.by_type[t];
+        delete decode.by_type[t];
+    }
+}
+
+void LatencyStats::init(const std::string& stats_name, const LatencySettings& stats_settings) {
+    name = stats_name;
+    settings = stats_settings;
+    window_start_ns = clock_realtime_ns();
+    next_report_ns = settings.report_interval_ns != 0 ? window_start_ns + settings.report_interval_ns : 0;
+}
+
+void LatencyStats::set_clock_offset(int64_t clock_offset_ns) {
+    settings.clock_offset_ns = clock_offset_ns;
+}
+
+void LatencyStats::record_stage(Stage& stage, uint8_t msg_type, int64_t ns) {
+    if (ns < 0) {
+        stage.early++;
+        return;
+    }
+
+    stage.all.record((uint64_t)ns);
+
+    // Types seen get their
+    // histogram on first use
+    LatencyHistogram*& by_type = stage.by_type[msg_type];
+    if (!by_type) {
+        by_type = new LatencyHistogram();
+    }
+    by_type->record((uint64_t)ns);
+}
+
+void LatencyStats::record(uint8_t msg_type, uint64_t exchange_ns, uint64_t receive_ns) {
+    if (exchange_ns != 0) {
+        int64_t sent_ns = (int64_t)exchange_ns - settings.clock_offset_ns;
+        record_stage(wire, msg_type, (int64_t)receive_ns - sent_ns);
+    }
+
+    if (settings.measure_decode) {
+        record_stage(decode, msg_type, (int64_t)(clock_realtime_ns() - receive_ns));
+    }
+}
+
+void LatencyStats::tick(uint64_t now_ns) {
+    if (next_report_ns == 0 || now_ns < next_report_ns) {
+        return;
+    }
+    report();
+}
+
+static void print_line(const char* label, const LatencyHistogram& h) {
+    std::printf("%s Count=%llu, Min=%.1f P50=%.1f P90=%.1f P99=%.1f P99.9=%.1f Max=%.1f\n",
+                label,
+                (unsigned long long)h.count(),
+                h.min() / 1000.0,
+                h.percentile(0.50) / 1000.0,
+                h.percentile(0.90) / 1000.0,
+                h.percentile(0.99) / 1000.0,
+                h.percentile(0.999) / 1000.0,
+                h.max() / 1000.0);
+}
+
+void LatencyStats::print_stage(const char* stage_name, Stage& stage) {
+    if (stage.all.count() == 0 && stage.early == 0) {
+        return;
+    }
+
+    char label[128];
+    std::snprintf(label, sizeof(label), ">> LATENCY(us): Channel=%s, Stage=%s, Early=%llu,",
+                  name.c_str(), stage_name, (unsigned long long)stage.early);
+    print_line(label, stage.all);
+
+    for (int t = 0; t < 256; t++) {
+        LatencyHistogram* h = stage.by_type[t];
+        if (!h || h->count() == 0) {
+            continue;
+        }
+
+        if (t >= 0x20 && t < 0x7F) {
+            std::snprintf(label, sizeof(label), ">>   [%c]", (char)t);
+        } else {
+            std::snprintf(label, sizeof(label), ">>   [0x%02X]", t);
+        }
+        print_line(label, *h);
+        h->clear();
+    }
+
+    stage.all.clear();
+    stage.early = 0;
+}
+
+void LatencyStats::report() {
+    uint64_t now_ns = clock_realtime_ns();
+
+    // Several channel threads
+    // share stdout
+    flockfile(stdout);
+    std::printf(">> LATENCY WINDOW: Channel=%s, Seconds=%.1f, ClockOffset(ns)=%lld\n",
+                name.c_str(), (now_ns - window_start_ns) / 1e9,
+                (long long)settings.clock_offset_ns);
+    print_stage("ExchangeToReceive", wire);
+    print_stage("ReceiveToDecode", decode);
+    funlockfile(stdout);
+
+    window_start_ns = now_ns;
+    if (settings.report_interval_ns != 0) {
+        next_report_ns = now_ns + settings.report_interval_ns;
+    }
+}
@@ -8,15 +8,69 @@
 
 static void usage(const char* prog) {
     std::fprintf(stderr,
-            "Usage: %s [-g] [-s <seq>] [-n <count>] [-v] [--type <X> ...]\n\n"
+            "Usage: %s [-c <file>] [--channel <name> ...] [-g] [-s <seq>] [-n <count>] [-v] [--type <X> ...] [--fields <X:f,..> ...]\n"
+            "       %*s [--filter <expr> ...] [--record <file>] [--replay <file> [--seq <a[:b]>] [--time <a[:b]>]]\n"
+            "       %*s [--export <dir>] [--shm <name>] [--shm-read <name>] [--republish] [--latency]\n"
+            "       %*s [--profile] [--trace-json <file>]\n\n"
             "Options:\n"
+            "   -c <file>       config file (default config/config.ini),\n"
+            "                   reloaded on change or SIGHUP (live mode)\n"
+            "   --channel <name> decode [CHANNEL <name>] only (repeatable,\n"
+            "                   default all; live mode runs several at once)\n"
             "   -g              gap-fill mode\n"
             "   -s <seq>        get data starting at <seq>\n"
             "   -n <count>      stops after decoding <count> msg\n"
             "   -v              verbose mode\n"
             "   --type <X>      filter message type <X> (repeatable)\n"
+            "   --fields <X:f1,f2> output only fields f1,f2 of type <X> (repeatable)\n"
+            "   --filter <expr> output only messages matching <expr>, e.g.\n"
+            "                   \"Price > 10000 && BuySellIndicator == 'B'\" (repeatable)\n"
+            "   --record <file> record the delivered stream + sequence index\n"
+            "   --replay <file> decode a recording instead of the feed\n"
+            "   --seq <a[:b]>   replay only sequence a..b\n"
+            "   --time <a[:b]>  replay only exchange time a..b (epoch ns)\n"
+            "   --export <dir>  write columnar files per message type\n"
+            "   --shm <name>    publish binary records to shared memory ring\n"
+            "   --shm-read <name> print records from a shared memory ring\n"
+            "   --republish     re-send recovered stream + serve rerequests\n"
+            "   --latency       exchange -> receive -> decode latency per\n"
+            "                   channel and message type ([LATENCY_SETTINGS])\n"
+            "   --profile       cycles per pipeline stage, table every\n"
+            "                   [PROFILE_SETTINGS] report_interval_ms\n"
+            "   --trace-json <file> flight recorder dump ([TRACE_SETTINGS]) to\n"
+            "                   Chrome trace / Perfetto JSON on stdout\n"
             "   -h              show help\n",
-            prog);
+            prog, (int)std::strlen(prog), "", (int)std::strlen(prog), "", (int)std::strlen(prog), "");
+}
+
+// Parse "<a>" or "<a>:<b>", open end
+// when b is missing.
+static bool parse_range(const char* text, uint64_t* first, uint64_t* last) {
+    char* end = 0;
+    unsigned long long a = std::strtoull(text, &end, 10);
+    if (end == text) {
+        return false;
+    }
+
+    *first = (uint64_t)a;
+    *last = UINT64_MAX;
+
+    if (*end == '\0') {
+        return true;
+    }
+
+    if (*end != ':') {
+        return false;
+    }
+
+    const char* second = end + 1;
+    unsigned long long b = std::strtoull(second, &end, 10);
+    if (end == second || *end != '\0' || b < a) {
+        return false;
+    }
+
+    *last = (uint64_t)b;
+    return true;
 }
 
 int main(int argc, char** argv) {
@@ -35,13 +89,27 @@ int main(int argc, char** argv) {
 
     static struct option long_options[] = {
         {"type", required_argument, 0, 1000},
+        {"record", required_argument, 0, 1001},
+        {"replay", required_argument, 0, 1002},
+        {"seq", required_argument, 0, 1003},
+        {"time", required_argument, 0, 1004},
+        {"export", required_argument, 0, 1005},
+        {"shm", required_argument, 0, 1006},
+        {"shm-read", required_argument, 0, 1007},
+        {"republish", no_argument, 0, 1008},
+        {"fields", required_argument, 0, 1009},
+        {"filter", required_argument, 0, 1010},
+        {"channel", required_argument, 0, 1011},
+        {"latency", no_argument, 0, 1012},
+        {"trace-json", required_argument, 0, 1013},
+        {"profile", no_argument, 0, 1014},
         {0, 0, 0, 0}
     };
 
     int opt;
     int long_index = 0;
 
-    while ((opt = getopt_long(argc, argv, "gs:n:vh", long_options, &long_index)) != -1) {
+    while ((opt = getopt_long(argc, argv, "c:gs:n:vh", long_options, &long_index)) != -1) {
         if (opt == 1000) {
             // --type
             if (!optarg || std::strlen(optarg) != 1) {
@@ -54,7 +122,89 @@ int main(int argc, char** argv) {
             continue;
         }
 
+        if (opt == 1001) {
+            app.set_record_path(optarg);
+            continue;
+        }
+
+        if (opt == 1002) {
+            app.set_replay_path(optarg);
+            continue;
+        }
+
+        if (opt == 1005) {
+            app.set_export_dir(optarg);
+            continue;
+        }
+
+        if (opt == 1006) {
+            app.set_shm_ring_name(optarg);
+            continue;
+        }
+
+        if (opt == 1007) {
+            app.set_shm_read_name(optarg);
+            continue;
+        }
+
+        if (opt == 1008) {
+            app.set_republish(true);
+            continue;
+        }
+
+        if (opt == 1009) {
+            app.add_field_projection(optarg);
+            continue;
+        }
+
+        if (opt == 1010) {
+            app.add_filter(optarg);
+            continue;
+        }
+
+        if (opt == 1011) {
+            app.add_channel(optarg);
+            continue;
+        }
+
+        if (opt == 1012) {
+            app.set_latency(true);
+            continue;
+        }
+
+        if (opt == 1013) {
+            app.set_trace_json_path(optarg);
+            continue;
+        }
+
+        if (opt == 1014) {
+            app.set_profile(true);
+            continue;
+        }
+
+        if (opt == 1003 || opt == 1004) {
+            uint64_t first = 0;
+            uint64_t last = 0;
+            if (!parse_range(optarg, &first, &last)) {
+                std::fprintf(stderr, "Invalid %s value: %s\n",
+                        opt == 1003 ? "--seq" : "--time", optarg);
+                usage(argv[0]);
+                return 1;
+            }
+
+            if (opt == 1003) {
+                app.set_replay_seq_range(first, last);
+            } else {
+                app.set_replay_time_range(first, last);
+            }
+            continue;
+        }
+
         switch (opt) {
+            case 'c':
+                app.set_config_path(optarg);
+                break;
+
             case 'g':
                 enable_recovery = true;
                 break;
@@ -0,0 +1,100 @@
+#include "message_cache.h"
+
+#include <cstring>
+
+MessageCache::MessageCache()
+: mask(0),
+  write_pos(0),
+  valid_from(0) {}
+
+void MessageCache::init(uint64_t max_messages, uint64_t max_bytes) {
+    uint64_t slots = 1;
+    while (slots < max_messages) {
+        slots <<= 1;
+    }
+
+    // Arena must fit at least
+    // one max size message
+    if (max_bytes < 64 * 1024) {
+        max_bytes = 64 * 1024;
+    }
+
+    entries.assign(slots, Entry());
+    arena.assign(max_bytes, 0);
+    mask = slots - 1;
+    write_pos = 0;
+    clear();
+}
+
+// Session change / sequence reset on
+// the hot path: move the floor instead
+// of walking every slot
+void MessageCache::clear() {
+    cache_session.clear();
+    valid_from = write_pos;
+}
+
+void MessageCache::store(const std::string& session, uint64_t seq,
+                         const uint8_t* msg, uint16_t msg_len) {
+
+    if (entries.empty() || !msg || msg_len == 0) {
+        return;
+    }
+
+    if (session != cache_session) {
+        clear();
+        cache_session = session;
+    }
+
+    uint64_t arena_size = arena.size();
+    uint64_t offset = write_pos % arena_size;
+
+    // Never split a message
+    // across the arena end
+    if (offset + msg_len > arena_size) {
+        write_pos += arena_size - offset;
+        offset = 0;
+    }
+
+    std::memcpy(&arena[offset], msg, msg_len);
+
+    Entry& entry = entries[seq & mask];
+    entry.seq = seq;
+    entry.arena_pos = write_pos;
+    entry.msg_len = msg_len;
+    entry.valid = true;
+
+    write_pos += msg_len;
+}
+
+bool MessageCache::get(uint64_t seq, const uint8_t** msg, uint16_t* msg_len) const {
+    if (entries.empty()) {
+        return false;
+    }
+
+    const Entry& entry = entries[seq & mask];
+    if (!entry.valid || entry.seq != seq || entry.arena_pos < valid_from) {
+        return false;
+    }
+
+    // Bytes overwritten by newer messages
+    if (write_pos - entry.arena_pos > arena.size()) {
+        return false;
+    }
+
+    if (msg) {
+        *msg = &arena[entry.arena_pos % arena.size()];
+    }
+    if (msg_len) {
+        *msg_len = entry.msg_len;
+    }
+    return true;
+}
+
+bool MessageCache::contains(uint64_t seq) const {
+    return get(seq, 0, 0);
+}
+
+const std::string& MessageCache::session() const {
+    return cache_session;
+}
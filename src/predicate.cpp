@@ -0,0 +1,557 @@
+#include "predicate.h"
+
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+// Field bytes as stored (big-endian),
+// for ==/!= against a pre-swapped literal
+static inline uint64_t load_raw(const uint8_t* p, uint8_t width) {
+    switch (width) {
+        case 1:
+            return p[0];
+        case 2: {
+            uint16_t value;
+            std::memcpy(&value, p, 2);
+            return value;
+        }
+        case 4: {
+            uint32_t value;
+            std::memcpy(&value, p, 4);
+            return value;
+        }
+        default: {
+            uint64_t value;
+            std::memcpy(&value, p, 8);
+            return value;
+        }
+    }
+}
+
+static inline uint64_t load_host(const uint8_t* p, uint8_t width) {
+    switch (width) {
+        case 1:
+            return p[0];
+        case 2:
+            return __builtin_bswap16((uint16_t)load_raw(p, 2));
+        case 4:
+            return __builtin_bswap32((uint32_t)load_raw(p, 4));
+        default:
+            return __builtin_bswap64(load_raw(p, 8));
+    }
+}
+
+static inline int64_t sign_extend(uint64_t value, uint8_t width) {
+    switch (width) {
+        case 1:
+            return (int8_t)value;
+        case 2:
+            return (int16_t)value;
+        case 4:
+            return (int32_t)value;
+        default:
+            return (int64_t)value;
+    }
+}
+
+template <typename T>
+static inline bool apply_compare(uint8_t op, T a, T b) {
+    switch (op) {
+        case 0: return a == b;
+        case 1: return a != b;
+        case 2: return a < b;
+        case 3: return a <= b;
+        case 4: return a > b;
+        default: return a >= b;
+    }
+}
+
+static const FieldSpec* find_field(const MsgSpec* spec, const std::string& name) {
+    if (!spec) {
+        return 0;
+    }
+
+    for (size_t i = 0; i < spec->fields.size(); i++) {
+        if (spec->fields[i].name == name) {
+            return &spec->fields[i];
+        }
+    }
+    return 0;
+}
+
+Predicate::Predicate()
+: pos(0),
+  evaluated(0),
+  passed(0) {
+    std::memset(program_first, 0, sizeof(program_first));
+    std::memset(program_count, 0, sizeof(program_count));
+}
+
+bool Predicate::empty() const {
+    return code.empty();
+}
+
+void Predicate::skip_spaces() {
+    while (pos < input.size() && std::isspace((unsigned char)input[pos])) {
+        pos++;
+    }
+}
+
+bool Predicate::accept(const char* token) {
+    skip_spaces();
+    size_t n = std::strlen(token);
+    if (input.compare(pos, n, token) != 0) {
+        return false;
+    }
+    pos += n;
+    return true;
+}
+
+int Predicate::parse_or(std::vector<Node>& nodes) {
+    int left = parse_and(nodes);
+    while (left >= 0 && accept("||")) {
+        int right = parse_and(nodes);
+        if (right < 0) {
+            return -1;
+        }
+
+        Node node = Node();
+        node.kind = 2;
+        node.left = left;
+        node.right = right;
+        node.counter = -1;
+        nodes.push_back(node);
+        left = (int)nodes.size() - 1;
+    }
+    return left;
+}
+
+int Predicate::parse_and(std::vector<Node>& nodes) {
+    int left = parse_unary(nodes);
+    while (left >= 0 && accept("&&")) {
+        int right = parse_unary(nodes);
+        if (right < 0) {
+            return -1;
+        }
+
+        Node node = Node();
+        node.kind = 1;
+        node.left = left;
+        node.right = right;
+        node.counter = -1;
+        nodes.push_back(node);
+        left = (int)nodes.size() - 1;
+    }
+    return left;
+}
+
+int Predicate::parse_unary(std::vector<Node>& nodes) {
+    skip_spaces();
+
+    if (pos + 1 < input.size() && input[pos] == '!' && input[pos + 1] != '=') {
+        pos++;
+        int inner = parse_unary(nodes);
+        if (inner < 0) {
+            return -1;
+        }
+
+        Node node = Node();
+        node.kind = 3;
+        node.left = inner;
+        node.right = -1;
+        node.counter = -1;
+        nodes.push_back(node);
+        return (int)nodes.size() - 1;
+    }
+
+    if (accept("(")) {
+        int inner = parse_or(nodes);
+        if (inner < 0) {
+            return -1;
+        }
+        if (!accept(")")) {
+            parse_error = "missing )";
+            return -1;
+        }
+        return inner;
+    }
+
+    return parse_compare(nodes);
+}
+
+// <Field> <op> <number | 'c' | "text">
+int Predicate::parse_compare(std::vector<Node>& nodes) {
+    skip_spaces();
+    size_t start = pos;
+
+    Node node = Node();
+    node.kind = 0;
+    node.left = -1;
+    node.right = -1;
+
+    while (pos < input.size() && (std::isalnum((unsigned char)input[pos]) || input[pos] == '_')) {
+        pos++;
+    }
+    if (pos == start) {
+        parse_error = "expected field name at '" + input.substr(start) + "'";
+        return -1;
+    }
+    node.field = input.substr(start, pos - start);
+
+    // Two-char operators first
+    static const char* ops[] = { "==", "!=", "<=", ">=", "<", ">" };
+    static const uint8_t codes[] = { 0, 1, 3, 5, 2, 4 };
+    bool found = false;
+    for (int i = 0; i < 6; i++) {
+        if (accept(ops[i])) {
+            node.compare = codes[i];
+            found = true;
+            break;
+        }
+    }
+    if (!found) {
+        parse_error = "expected comparison after " + node.field;
+        return -1;
+    }
+
+    skip_spaces();
+    if (pos >= input.size()) {
+        parse_error = "expected value after " + node.field;
+        return -1;
+    }
+
+    char c = input[pos];
+    if (c == '\'') {
+        if (pos + 2 >= input.size() || input[pos + 2] != '\'') {
+            parse_error = "bad char literal in " + node.field;
+            return -1;
+        }
+        node.literal = LIT_CHAR;
+        node.number = (unsigned char)input[pos + 1];
+        node.text = input.substr(pos + 1, 1);
+        pos += 3;
+    } else if (c == '"') {
+        size_t close = input.find('"', pos + 1);
+        if (close == std::string::npos) {
+            parse_error = "unterminated string in " + node.field;
+            return -1;
+        }
+        node.literal = LIT_TEXT;
+        node.text = input.substr(pos + 1, close - pos - 1);
+        pos = close + 1;
+    } else {
+        bool negative = (c == '-');
+        const char* text = input.c_str() + pos + (negative ? 1 : 0);
+        char* end = 0;
+        if (!std::isdigit((unsigned char)*text)) {
+            parse_error = "bad value for " + node.field;
+            return -1;
+        }
+        unsigned long long value = std::strtoull(text, &end, 10);
+        if (value > (unsigned long long)INT64_MAX) {
+            parse_error = "value too large for " + node.field;
+            return -1;
+        }
+        node.literal = LIT_NUMBER;
+        node.number = negative ? -(int64_t)value : (int64_t)value;
+        pos = end - input.c_str();
+    }
+
+    node.source = input.substr(start, pos - start);
+
+    Counter counter;
+    counter.source = node.source;
+    counter.evaluated = 0;
+    counter.passed = 0;
+    counters.push_back(counter);
+    node.counter = (int)counters.size() - 1;
+
+    nodes.push_back(node);
+    return (int)nodes.size() - 1;
+}
+
+void Predicate::emit_const(const Node& node, bool value) {
+    Instr instr = Instr();
+    instr.opcode = OP_CONST;
+    instr.node = (uint32_t)node.counter;
+    instr.literal = value ? 1 : 0;
+    code.push_back(instr);
+}
+
+bool Predicate::emit(const std::vector<Node>& nodes, int index, const MsgSpec* spec,
+                     std::string* error) {
+    const Node& node = nodes[index];
+
+    // && / || short-circuit on the
+    // left result, still in acc at
+    // the jump target
+    if (node.kind == 1 || node.kind == 2) {
+        if (!emit(nodes, node.left, spec, error)) {
+            return false;
+        }
+
+        size_t jump = code.size();
+        Instr instr = Instr();
+        instr.opcode = node.kind == 1 ? OP_JUMP_FALSE : OP_JUMP_TRUE;
+        code.push_back(instr);
+
+        if (!emit(nodes, node.right, spec, error)) {
+            return false;
+        }
+        code[jump].target = (uint32_t)code.size();
+        return true;
+    }
+
+    if (node.kind == 3) {
+        if (!emit(nodes, node.left, spec, error)) {
+            return false;
+        }
+        Instr instr = Instr();
+        instr.opcode = OP_NOT;
+        code.push_back(instr);
+        return true;
+    }
+
+    const FieldSpec* field = find_field(spec, node.field);
+    if (!field) {
+        emit_const(node, false);
+        return true;
+    }
+
+    Instr instr = Instr();
+    instr.opcode = OP_COMPARE;
+    instr.compare = node.compare;
+    instr.offset = (uint16_t)field->offset;
+    instr.end = (uint16_t)(field->offset + field->size);
+    instr.node = (uint32_t)node.counter;
+
+    // Text against space padded
+    // field bytes
+    bool text_field = field->type == STRING || (field->type == CHAR && node.literal == LIT_TEXT);
+    if (text_field) {
+        if (node.literal == LIT_NUMBER) {
+            *error = "filter: " + node.field + " is a text field (" + node.source + ")";
+            return false;
+        }
+        if (node.text.size() > field->size) {
+            *error = "filter: value longer than " + node.field + " (" + node.source + ")";
+            return false;
+        }
+
+        instr.kind = VALUE_TEXT;
+        instr.target = (uint32_t)text_pool.size();
+        text_pool.insert(text_pool.end(), node.text.begin(), node.text.end());
+        text_pool.insert(text_pool.end(), field->size - node.text.size(), ' ');
+        code.push_back(instr);
+        return true;
+    }
+
+    if (field->type == BINARY) {
+        *error = "filter: " + node.field + " is a binary field (" + node.source + ")";
+        return false;
+    }
+    if (node.literal == LIT_TEXT) {
+        *error = "filter: " + node.field + " is a number field (" + node.source + ")";
+        return false;
+    }
+    if (field->size != 1 && field->size != 2 && field->size != 4 && field->size != 8) {
+        *error = "filter: unsupported size for " + node.field;
+        return false;
+    }
+
+    bool is_signed = field->type == INT16 || field->type == INT32 || field->type == INT64;
+    uint8_t width = (uint8_t)field->size;
+
+    int64_t min_value = 0;
+    uint64_t max_value = width == 8 ? UINT64_MAX : ((1ULL << (8 * width)) - 1);
+    if (is_signed) {
+        min_value = width == 8 ? INT64_MIN : -(int64_t)(1ULL << (8 * width - 1));
+        max_value = width == 8 ? (uint64_t)INT64_MAX : ((1ULL << (8 * width - 1)) - 1);
+    }
+
+    // Out of range literal: same
+    // answer for every message
+    if (node.number < min_value) {
+        emit_const(node, node.compare == CMP_NE || node.compare == CMP_GT || node.compare == CMP_GE);
+        return true;
+    }
+    if (node.number > 0 && (uint64_t)node.number > max_value) {
+        emit_const(node, node.compare == CMP_NE || node.compare == CMP_LT || node.compare == CMP_LE);
+        return true;
+    }
+
+    instr.kind = is_signed ? VALUE_SIGNED : VALUE_UNSIGNED;
+    instr.width = width;
+
+    if (node.compare == CMP_EQ || node.compare == CMP_NE) {
+        uint8_t bytes[8];
+        for (int i = 0; i < width; i++) {
+            bytes[i] = (uint8_t)((uint64_t)node.number >> (8 * (width - 1 - i)));
+        }
+        instr.literal = load_raw(bytes, width);
+    } else {
+        instr.literal = (uint64_t)node.number;
+    }
+
+    code.push_back(instr);
+    return true;
+}
+
+bool Predicate::compile(const std::vector<std::string>& expressions, const AppConfig& cfg,
+                        std::string* error) {
+    std::vector<Node> nodes;
+    int root = -1;
+
+    for (size_t i = 0; i < expressions.size(); i++) {
+        input = expressions[i];
+        pos = 0;
+        parse_error.clear();
+
+        int expr = parse_or(nodes);
+        skip_spaces();
+        if (expr >= 0 && pos != input.size()) {
+            parse_error = "unexpected '" + input.substr(pos) + "'";
+            expr = -1;
+        }
+        if (expr < 0) {
+            *error = "filter: " + parse_error + " in \"" + expressions[i] + "\"";
+            return false;
+        }
+
+        if (root < 0) {
+            root = expr;
+            continue;
+        }
+
+        Node node = Node();
+        node.kind = 1;
+        node.left = root;
+        node.right = expr;
+        node.counter = -1;
+        nodes.push_back(node);
+        root = (int)nodes.size() - 1;
+    }
+
+    if (root < 0) {
+        return true;
+    }
+
+    // Every field must exist in
+    // at least one message type
+    for (size_t i = 0; i < nodes.size(); i++) {
+        if (nodes[i].kind != 0) {
+            continue;
+        }
+
+        bool known = false;
+        for (int t = 0; t < 256 && !known; t++) {
+            known = find_field(cfg.spec_by_type[t], nodes[i].field) != 0;
+        }
+        if (!known) {
+            *error = "filter: unknown field " + nodes[i].field;
+            return false;
+        }
+    }
+
+    // One program per message type
+    for (int t = 0; t < 256; t++) {
+        program_first[t] = (uint32_t)code.size();
+        if (!emit(nodes, root, cfg.spec_by_type[t], error)) {
+            code.clear();
+            return false;
+        }
+        program_count[t] = (uint32_t)code.size() - program_first[t];
+    }
+
+    return true;
+}
+
+bool Predicate::compare(const Instr& instr, const uint8_t* msg) const {
+    const uint8_t* p = msg + instr.offset;
+
+    if (instr.kind == VALUE_TEXT) {
+        int diff = std::memcmp(p, &text_pool[instr.target], instr.end - instr.offset);
+        return apply_compare<int>(instr.compare, diff, 0);
+    }
+
+    // No swap for ==/!=
+    if (instr.compare <= CMP_NE) {
+        return apply_compare<uint64_t>(instr.compare, load_raw(p, instr.width), instr.literal);
+    }
+
+    uint64_t value = load_host(p, instr.width);
+    if (instr.kind == VALUE_SIGNED) {
+        return apply_compare<int64_t>(instr.compare, sign_extend(value, instr.width),
+                                      (int64_t)instr.literal);
+    }
+    return apply_compare<uint64_t>(instr.compare, value, instr.literal);
+}
+
+bool Predicate::match(const uint8_t* msg, uint16_t msg_len) {
+    evaluated++;
+    if (msg_len == 0) {
+        return false;
+    }
+
+    uint32_t pc = program_first[msg[0]];
+    uint32_t end = pc + program_count[msg[0]];
+    bool acc = false;
+
+    while (pc < end) {
+        const Instr& instr = code[pc];
+
+        switch (instr.opcode) {
+            case OP_COMPARE:
+                acc = instr.end <= msg_len && compare(instr, msg);
+                counters[instr.node].evaluated++;
+                counters[instr.node].passed += acc ? 1 : 0;
+                pc++;
+                break;
+            case OP_CONST:
+                acc = instr.literal != 0;
+                counters[instr.node].evaluated++;
+                counters[instr.node].passed += acc ? 1 : 0;
+                pc++;
+                break;
+            case OP_JUMP_FALSE:
+                pc = acc ? pc + 1 : instr.target;
+                break;
+            case OP_JUMP_TRUE:
+                pc = acc ? instr.target : pc + 1;
+                break;
+            default:
+                acc = !acc;
+                pc++;
+                break;
+        }
+    }
+
+    passed += acc ? 1 : 0;
+    return acc;
+}
+
+static double percent(uint64_t part, uint64_t total) {
+    return total == 0 ? 0.0 : 100.0 * (double)part / (double)total;
+}
+
+void Predicate::print_stats() const {
+    if (code.empty()) {
+        return;
+    }
+
+    std::printf(">> FILTER STATS: Evaluated=%llu, Passed=%llu (%.2f%%)\n",
+                (unsigned long long)evaluated, (unsigned long long)passed,
+                percent(passed, evaluated));
+
+    // Later clauses only see what
+    // && / || did not short-circuit
+    for (size_t i = 0; i < counters.size(); i++) {
+        const Counter& counter = counters[i];
+        std::printf(">>   [%s] Evaluated=%llu, Passed=%llu (%.2f%%)\n",
+                    counter.source.c_str(),
+                    (unsigned long long)counter.evaluated,
+                    (unsigned long long)counter.passed,
+                    percent(counter.passed, counter.evaluated));
+    }
+}
@@ -0,0 +1,102 @@
+#include "profile.h"
+#include "tsc_clock.h"
+
+#include <cstdio>
+#include <cstring>
+
+static const char* const stage_names[PROFILE_STAGES] = {
+    "Recv", "Header", "Split", "Filter", "Decode", "Output", "Book", "Flush"
+};
+
+uint64_t profile_now() {
+    uint64_t cycles = tsc_cycles();
+    return cycles != 0 ? cycles : clock_monotonic_ns();
+}
+
+StageProfile::StageProfile()
+: tsc(false),
+  report_interval_ns(0),
+  window_start_ns(0),
+  next_report_ns(0),
+  packets(0),
+  messages(0) {
+    std::memset(cycles, 0, sizeof(cycles));
+}
+
+void StageProfile::init(const std::string& profile_name, uint64_t interval_ns) {
+    name = profile_name;
+    tsc = tsc_cycles() != 0;
+    report_interval_ns = interval_ns;
+    window_start_ns = clock_monotonic_ns();
+    next_report_ns = interval_ns != 0 ? window_start_ns + interval_ns : 0;
+}
+
+uint64_t StageProfile::add(ProfileStage stage, uint64_t start) {
+    uint64_t now = profile_now();
+    cycles[stage] += now - start;
+    return now;
+}
+
+void StageProfile::count(uint64_t packet_count, uint64_t message_count) {
+    packets += packet_count;
+    messages += message_count;
+}
+
+void StageProfile::tick() {
+    if (next_report_ns == 0 || clock_monotonic_ns() < next_report_ns) {
+        return;
+    }
+    report();
+}
+
+// Share is of the busy stages: Recv
+// blocks until a packet arrives
+// (except with epoll), so it is
+// shown but kept out of the total
+void StageProfile::report() {
+    uint64_t now_ns = clock_monotonic_ns();
+
+    uint64_t busy = 0;
+    for (int s = STAGE_HEADER; s < PROFILE_STAGES; s++) {
+        busy += cycles[s];
+    }
+
+    flockfile(stdout);
+    std::printf(">> PROFILE: Name=%s, Seconds=%.1f, Packets=%llu, Messages=%llu, Unit=%s\n",
+                name.c_str(), (now_ns - window_start_ns) / 1e9,
+                (unsigned long long)packets, (unsigned long long)messages,
+                tsc ? "cycles" : "ns");
+    std::printf(">>   %-8s %12s %10s %10s %8s %7s\n",
+                "Stage", "Total(us)", "PerPacket", "PerMsg", "ns/Msg", "Share");
+
+    for (int s = 0; s <= PROFILE_STAGES; s++) {
+        bool total = s == PROFILE_STAGES;
+        if (total && busy == 0) {
+            break;
+        }
+
+        uint64_t c = total ? busy : cycles[s];
+        uint64_t ns = tsc ? tsc_cycles_to_ns(c) : c;
+        char share[16] = "-";
+        if (s != STAGE_RECV && busy != 0) {
+            std::snprintf(share, sizeof(share), "%.1f%%", 100.0 * (double)c / (double)busy);
+        }
+
+        std::printf(">>   %-8s %12.1f %10.1f %10.1f %8.1f %7s\n",
+                    total ? "Busy" : stage_names[s],
+                    ns / 1000.0,
+                    packets ? (double)c / (double)packets : 0.0,
+                    messages ? (double)c / (double)messages : 0.0,
+                    messages ? (double)ns / (double)messages : 0.0,
+                    share);
+    }
+    funlockfile(stdout);
+
+    std::memset(cycles, 0, sizeof(cycles));
+    packets = 0;
+    messages = 0;
+    window_start_ns = now_ns;
+    if (report_interval_ns != 0) {
+        next_report_ns = now_ns + report_interval_ns;
+    }
+}
@@ -0,0 +1,441 @@
+#include "recorder.h"
+#include "decoder.h"
+
+#include <cstring>
+
+static const char record_magic[8] = {'M', 'O', 'L', 'D', 'R', 'E', 'C', '1'};
+static const char index_magic[8] = {'M', 'O', 'L', 'D', 'I', 'D', 'X', '1'};
+static const uint32_t record_version = 1;
+
+// Mold header + messages, within
+// what replay reads in one go
+static const size_t mold_header_len = 10 + 8 + 2;
+static const size_t max_packet_bytes = 64 * 1024;
+
+// Index entry due if this packet
+// reaches the next index sequence.
+static bool index_due(uint64_t first_seq, uint16_t message_count,
+                      uint32_t interval, bool& has_index_seq,
+                      uint64_t& next_index_seq) {
+
+    if (message_count == 0 || message_count == 0xFFFF) {
+        return false;
+    }
+
+    uint64_t last_seq = first_seq + (uint64_t)message_count - 1;
+
+    if (!has_index_seq) {
+        has_index_seq = true;
+        next_index_seq = first_seq + interval;
+        return true;
+    }
+
+    if (last_seq < next_index_seq) {
+        return false;
+    }
+
+    while (next_index_seq <= last_seq) {
+        next_index_seq += interval;
+    }
+    return true;
+}
+
+// Sequence, count and exchange time
+// of the first message of a packet.
+// Walks every message so the clock
+// sees each T message.
+static bool scan_packet(const uint8_t* packet, int packet_len, ExchangeClock& clock,
+                        uint64_t* first_seq, uint16_t* message_count, uint64_t* first_ts) {
+
+    MoldHeader header;
+    if (!parse_mold_header(packet, packet_len, &header)) {
+        return false;
+    }
+
+    int msg_offset = 10 + 8 + 2;
+    uint16_t remaining = (uint16_t)header.message_count;
+    const uint8_t* msg = 0;
+    uint16_t msg_len = 0;
+    bool first = true;
+
+    *first_ts = 0;
+    while (next_mold_message(packet, packet_len, &msg_offset, &remaining, &msg, &msg_len)) {
+        uint64_t ts = clock.update(msg, msg_len);
+        if (first) {
+            *first_ts = ts;
+            first = false;
+        }
+    }
+
+    *first_seq = header.sequence_number;
+    *message_count = (uint16_t)header.message_count;
+    return true;
+}
+
+Recorder::Recorder()
+: data_file(0),
+  index_file(0),
+  data_offset(0),
+  interval(1000),
+  next_index_seq(0),
+  has_index_seq(false),
+  pending_count(0),
+  pending_first_seq(0),
+  pending_receive_ns(0) {}
+
+Recorder::~Recorder() {
+    close();
+}
+
+bool Recorder::open(const std::string& path, uint32_t index_interval, const AppConfig& cfg) {
+    close();
+    clock.init(cfg);
+
+    if (path.empty()) {
+        return false;
+    }
+
+    data_file = std::fopen(path.c_str(), "wb");
+    if (!data_file) {
+        return false;
+    }
+
+    index_file = std::fopen(index_path_for(path).c_str(), "wb");
+    if (!index_file) {
+        close();
+        return false;
+    }
+
+    // Large stdio buffers, the
+    // hot path only does memcpy
+    std::setvbuf(data_file, 0, _IOFBF, 1 << 20);
+    std::setvbuf(index_file, 0, _IOFBF, 64 * 1024);
+
+    interval = index_interval ? index_interval : 1000;
+    has_index_seq = false;
+    next_index_seq = 0;
+
+    pending.clear();
+    pending.reserve(max_packet_bytes);
+    pending_count = 0;
+
+    RecordFileHeader file_header;
+    std::memset(&file_header, 0, sizeof(file_header));
+    std::memcpy(file_header.magic, record_magic, sizeof(file_header.magic));
+    file_header.version = record_version;
+    std::fwrite(&file_header, sizeof(file_header), 1, data_file);
+    data_offset = sizeof(file_header);
+
+    IndexFileHeader index_header;
+    std::memset(&index_header, 0, sizeof(index_header));
+    std::memcpy(index_header.magic, index_magic, sizeof(index_header.magic));
+    index_header.version = record_version;
+    index_header.interval = interval;
+    std::fwrite(&index_header, sizeof(index_header), 1, index_file);
+
+    return true;
+}
+
+void Recorder::close() {
+    flush_packet();
+
+    if (data_file) {
+        std::fclose(data_file);
+        data_file = 0;
+    }
+
+    if (index_file) {
+        std::fclose(index_file);
+        index_file = 0;
+    }
+}
+
+void Recorder::write_packet(const uint8_t* packet, int packet_len, uint64_t receive_ns) {
+    if (!data_file || !packet || packet_len <= 0) {
+        return;
+    }
+
+    uint64_t first_seq = 0;
+    uint16_t message_count = 0;
+    uint64_t timestamp_ns = 0;
+
+    if (scan_packet(packet, packet_len, clock, &first_seq, &message_count, &timestamp_ns) &&
+        index_due(first_seq, message_count, interval, has_index_seq, next_index_seq)) {
+        IndexEntry entry;
+        entry.sequence = first_seq;
+        entry.file_offset = data_offset;
+        entry.timestamp_ns = timestamp_ns;
+        std::fwrite(&entry, sizeof(entry), 1, index_file);
+    }
+
+    RecordPacketHeader packet_header;
+    packet_header.packet_len = (uint32_t)packet_len;
+    packet_header.reserved = 0;
+    packet_header.receive_ns = receive_ns;
+
+    std::fwrite(&packet_header, sizeof(packet_header), 1, data_file);
+    std::fwrite(packet, 1, (size_t)packet_len, data_file);
+    data_offset += sizeof(packet_header) + (uint64_t)packet_len;
+}
+
+void Recorder::write_message(const std::string& session, uint64_t seq,
+                             const uint8_t* msg, uint16_t msg_len, uint64_t receive_ns) {
+    if (!data_file || session.size() != 10) {
+        return;
+    }
+
+    // New packet on a session change, a
+    // sequence jump (reset) or when full
+    if (pending_count != 0 &&
+        (std::memcmp(&pending[0], session.data(), 10) != 0 ||
+         seq != pending_first_seq + pending_count ||
+         pending_count == 0xFFFE ||
+         pending.size() + 2 + msg_len > max_packet_bytes)) {
+        flush_packet();
+    }
+
+    if (pending_count == 0) {
+        pending.resize(mold_header_len);
+        std::memcpy(&pending[0], session.data(), 10);
+        pending_first_seq = seq;
+        pending_receive_ns = receive_ns;
+    }
+
+    size_t offset = pending.size();
+    pending.resize(offset + 2 + msg_len);
+    pending[offset] = (uint8_t)(msg_len >> 8);
+    pending[offset + 1] = (uint8_t)msg_len;
+    std::memcpy(&pending[offset + 2], msg, msg_len);
+    pending_count++;
+}
+
+void Recorder::flush_packet() {
+    if (pending_count == 0) {
+        return;
+    }
+
+    // Mold header, big endian
+    for (int i = 0; i < 8; i++) {
+        pending[10 + i] = (uint8_t)(pending_first_seq >> (56 - 8 * i));
+    }
+    pending[18] = (uint8_t)(pending_count >> 8);
+    pending[19] = (uint8_t)pending_count;
+
+    write_packet(&pending[0], (int)pending.size(), pending_receive_ns);
+    pending_count = 0;
+}
+
+RecordReader::RecordReader()
+: file(0) {}
+
+RecordReader::~RecordReader() {
+    close();
+}
+
+bool RecordReader::open(const std::string& path) {
+    close();
+
+    file = std::fopen(path.c_str(), "rb");
+    if (!file) {
+        return false;
+    }
+
+    std::setvbuf(file, 0, _IOFBF, 1 << 20);
+
+    RecordFileHeader file_header;
+    if (std::fread(&file_header, sizeof(file_header), 1, file) != 1 ||
+        std::memcmp(file_header.magic, record_magic, sizeof(file_header.magic)) != 0 ||
+        file_header.version != record_version) {
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+void RecordReader::close() {
+    if (file) {
+        std::fclose(file);
+        file = 0;
+    }
+}
+
+bool RecordReader::seek(uint64_t file_offset) {
+    if (!file) {
+        return false;
+    }
+
+    if (file_offset < sizeof(RecordFileHeader)) {
+        file_offset = sizeof(RecordFileHeader);
+    }
+
+    return ::fseeko(file, (off_t)file_offset, SEEK_SET) == 0;
+}
+
+int RecordReader::next_packet(uint8_t* buffer, int capacity, uint64_t* receive_ns) {
+    if (!file) {
+        return -1;
+    }
+
+    RecordPacketHeader packet_header;
+    if (std::fread(&packet_header, sizeof(packet_header), 1, file) != 1) {
+        return 0;
+    }
+
+    if (packet_header.packet_len == 0 || (int)packet_header.packet_len > capacity) {
+        return -1;
+    }
+
+    if (std::fread(buffer, 1, packet_header.packet_len, file) != packet_header.packet_len) {
+        // Truncated tail (recorder killed)
+        return 0;
+    }
+
+    if (receive_ns) {
+        *receive_ns = packet_header.receive_ns;
+    }
+
+    return (int)packet_header.packet_len;
+}
+
+std::string index_path_for(const std::string& record_path) {
+    return record_path + ".idx";
+}
+
+static bool read_index_file(const std::string& path, std::vector<IndexEntry>& out) {
+    FILE* file = std::fopen(path.c_str(), "rb");
+    if (!file) {
+        return false;
+    }
+
+    IndexFileHeader index_header;
+    if (std::fread(&index_header, sizeof(index_header), 1, file) != 1 ||
+        std::memcmp(index_header.magic, index_magic, sizeof(index_header.magic)) != 0 ||
+        index_header.version != record_version) {
+        std::fclose(file);
+        return false;
+    }
+
+    out.clear();
+    IndexEntry entry;
+    while (std::fread(&entry, sizeof(entry), 1, file) == 1) {
+        out.push_back(entry);
+    }
+
+    std::fclose(file);
+    return true;
+}
+
+// Full scan of the recording,
+// writes the same entries the
+// recorder would have.
+static bool rebuild_index(const std::string& record_path, const AppConfig& cfg,
+                          uint32_t interval, std::vector<IndexEntry>& out) {
+
+    RecordReader reader;
+    if (!reader.open(record_path)) {
+        return false;
+    }
+
+    ExchangeClock clock;
+    clock.init(cfg);
+
+    out.clear();
+    bool has_index_seq = false;
+    uint64_t next_index_seq = 0;
+    uint64_t offset = sizeof(RecordFileHeader);
+
+    const int capacity = 64 * 1024;
+    std::vector<uint8_t> buffer(capacity);
+
+    while (1) {
+        int bytes = reader.next_packet(&buffer[0], capacity, 0);
+        if (bytes <= 0) {
+            break;
+        }
+
+        uint64_t packet_offset = offset;
+        offset += sizeof(RecordPacketHeader) + (uint64_t)bytes;
+
+        uint64_t first_seq = 0;
+        uint16_t message_count = 0;
+        uint64_t first_ts = 0;
+
+        if (!scan_packet(&buffer[0], bytes, clock, &first_seq, &message_count, &first_ts)) {
+            continue;
+        }
+
+        if (index_due(first_seq, message_count, interval, has_index_seq, next_index_seq)) {
+            IndexEntry entry;
+            entry.sequence = first_seq;
+            entry.file_offset = packet_offset;
+            entry.timestamp_ns = first_ts;
+            out.push_back(entry);
+        }
+    }
+
+    FILE* file = std::fopen(index_path_for(record_path).c_str(), "wb");
+    if (file) {
+        IndexFileHeader index_header;
+        std::memset(&index_header, 0, sizeof(index_header));
+        std::memcpy(index_header.magic, index_magic, sizeof(index_header.magic));
+        index_header.version = record_version;
+        index_header.interval = interval;
+        std::fwrite(&index_header, sizeof(index_header), 1, file);
+
+        if (!out.empty()) {
+            std::fwrite(&out[0], sizeof(IndexEntry), out.size(), file);
+        }
+        std::fclose(file);
+    }
+
+    return true;
+}
+
+bool load_index(const std::string& record_path, const AppConfig& cfg,
+                uint32_t interval, std::vector<IndexEntry>& out) {
+
+    if (read_index_file(index_path_for(record_path), out)) {
+        return true;
+    }
+
+    std::printf(">> INFO: Index missing, rebuilding %s\n", index_path_for(record_path).c_str());
+    return rebuild_index(record_path, cfg, interval ? interval : 1000, out);
+}
+
+const IndexEntry* find_by_sequence(const std::vector<IndexEntry>& index, uint64_t sequence) {
+    // Last entry with entry.sequence <= sequence
+    size_t low = 0;
+    size_t high = index.size();
+
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (index[mid].sequence <= sequence) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    return low == 0 ? 0 : &index[low - 1];
+}
+
+const IndexEntry* find_by_timestamp(const std::vector<IndexEntry>& index, uint64_t timestamp_ns) {
+    // Entries without a timestamp
+    // (before first T) sort first
+    size_t low = 0;
+    size_t high = index.size();
+
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (index[mid].timestamp_ns < timestamp_ns) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    // Entry strictly before the time, the
+    // wanted message can sit inside it
+    return low == 0 ? 0 : &index[low - 1];
+}
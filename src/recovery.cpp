@@ -1,4 +1,6 @@
 #include "recovery.h"
+#include "tsc_clock.h"
+#include "probes.h"
 #include <cstdio>
 #include <cstring>
 #include <unistd.h>
@@ -6,6 +8,8 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <endian.h>
+#include <poll.h>
+#include <ctime>
 
 #pragma pack(push, 1)
 struct RerequestPacket {
@@ -15,8 +19,28 @@ struct RerequestPacket {
 };
 #pragma pack(pop)
 
+static uint64_t monotonic_us() {
+    return clock_monotonic_ns() / 1000;
+}
+
+static int64_t clamp_us(int64_t value, int64_t low, int64_t high) {
+    if (value < low) return low;
+    if (value > high) return high;
+    return value;
+}
+
 Rerequester::Rerequester()
-: fd(-1) {
+: fd(-1),
+  has_rtt(false),
+  srtt_us(0),
+  rttvar_us(0),
+  interarrival_us(0),
+  backoff(0),
+  sent_at_us(0),
+  last_reply_us(0),
+  awaiting_first_reply(false),
+  next_send_us(0),
+  request_count(5000) {
     std::memset(&dst_addr, 0, sizeof(dst_addr));
 }
 
@@ -24,7 +48,7 @@ Rerequester::~Rerequester() {
     close();
 }
 
-bool Rerequester::open(const std::string& ip, uint16_t port, int receive_buffer_bytes, int timeout_ms) {
+bool Rerequester::open(const std::string& ip, uint16_t port, int receive_buffer_bytes) {
     close();
 
     if (ip.empty() || port == 0) {
@@ -39,15 +63,6 @@ bool Rerequester::open(const std::string& ip, uint16_t port, int receive_buffer_
     // Increase receive buffer
     ::setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &receive_buffer_bytes, sizeof(receive_buffer_bytes));
 
-    // set recv timeout
-    // so recvfrom doesn't
-    // get stock forever
-    timeval tv;
-    std::memset(&tv, 0, sizeof(tv));
-    tv.tv_sec = timeout_ms / 1000;
-    tv.tv_usec = (timeout_ms % 1000) * 1000;
-    ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
-
     // Bind to any local port
     sockaddr_in local;
     std::memset(&local, 0, sizeof(local));
@@ -72,9 +87,31 @@ bool Rerequester::open(const std::string& ip, uint16_t port, int receive_buffer_
         return false;
     }
     dst_addr.sin_addr.s_addr = addr;
+
+    has_rtt = false;
+    backoff = 0;
+    awaiting_first_reply = false;
+    next_send_us = 0;
+    request_count = tuning.max_request_count;
     return true;
 }
 
+void Rerequester::set_tuning(const RecoveryTuning& value) {
+    tuning = value;
+
+    if (tuning.max_request_count == 0) {
+        tuning.max_request_count = 5000;
+    }
+    if (tuning.min_request_count == 0 || tuning.min_request_count > tuning.max_request_count) {
+        tuning.min_request_count = tuning.max_request_count;
+    }
+    if (tuning.min_timeout_us > tuning.max_timeout_us) {
+        tuning.min_timeout_us = tuning.max_timeout_us;
+    }
+
+    request_count = tuning.max_request_count;
+}
+
 void Rerequester::close() {
     if (fd >= 0) {
         ::close(fd);
@@ -87,6 +124,17 @@ bool Rerequester::send_request(const char session[10], uint64_t start_seq, uint1
         return false;
     }
 
+    // Respect server side request limit
+    uint64_t now = monotonic_us();
+    if (now < next_send_us) {
+        ::usleep((useconds_t)(next_send_us - now));
+        now = monotonic_us();
+    }
+
+    if (tuning.max_requests_per_second != 0) {
+        next_send_us = now + 1000000ULL / tuning.max_requests_per_second;
+    }
+
     RerequestPacket packet;
     std::memset(&packet, 0, sizeof(packet));
 
@@ -101,7 +149,15 @@ bool Rerequester::send_request(const char session[10], uint64_t start_seq, uint1
     int sent = (int)::sendto(fd, &packet, (int)sizeof(packet), 0,
                              (sockaddr*)&dst_addr, sizeof(dst_addr));
 
-    return (sent == (int)sizeof(packet));
+    if (sent != (int)sizeof(packet)) {
+        return false;
+    }
+
+    sent_at_us = now;
+    awaiting_first_reply = true;
+    recovery_stats.requests++;
+    ITCH_PROBE2(rerequest_send, start_seq, count);
+    return true;
 }
 
 int Rerequester::receive_packet(uint8_t* buffer, int capacity) {
@@ -109,8 +165,146 @@ int Rerequester::receive_packet(uint8_t* buffer, int capacity) {
         return -1;
     }
 
+    int wait_us = timeout_us();
+
+    pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+
+    timespec timeout;
+    timeout.tv_sec = wait_us / 1000000;
+    timeout.tv_nsec = (long)(wait_us % 1000000) * 1000;
+
+    int ready = ::ppoll(&pfd, 1, &timeout, 0);
+    if (ready < 0) {
+        return -1;
+    }
+
+    if (ready == 0) {
+        recovery_stats.timeouts++;
+        ITCH_PROBE1(rerequest_timeout, wait_us);
+
+        // No reply at all: back off
+        // before the request is retried
+        if (awaiting_first_reply && backoff < 6) {
+            backoff++;
+        }
+        return 0;
+    }
+
     // Receive one reply MoldUDP64 packet
     // (unicast) into buffer
-    int n = (int)::recvfrom(fd, buffer, (size_t)capacity, 0, 0, 0);
+    int n = (int)::recvfrom(fd, buffer, (size_t)capacity, MSG_DONTWAIT, 0, 0);
+    if (n <= 0) {
+        return n < 0 ? -1 : 0;
+    }
+
+    uint64_t now = monotonic_us();
+    recovery_stats.reply_packets++;
+
+    if (awaiting_first_reply) {
+        int64_t rtt = (int64_t)(now - sent_at_us);
+        awaiting_first_reply = false;
+
+        // Karn: a retried request gives
+        // an ambiguous sample, skip it
+        if (backoff == 0) {
+            if (!has_rtt) {
+                srtt_us = rtt;
+                rttvar_us = rtt / 2;
+                has_rtt = true;
+            } else {
+                int64_t error = rtt - srtt_us;
+                srtt_us += error / 8;
+                rttvar_us += ((error < 0 ? -error : error) - rttvar_us) / 4;
+            }
+        }
+        backoff = 0;
+
+        recovery_stats.last_rtt_us = (uint64_t)rtt;
+        recovery_stats.rtt_total_us += (uint64_t)rtt;
+        if (recovery_stats.rtt_samples == 0 || (uint64_t)rtt < recovery_stats.rtt_min_us) {
+            recovery_stats.rtt_min_us = (uint64_t)rtt;
+        }
+        if ((uint64_t)rtt > recovery_stats.rtt_max_us) {
+            recovery_stats.rtt_max_us = (uint64_t)rtt;
+        }
+        recovery_stats.rtt_samples++;
+    } else {
+        int64_t gap = (int64_t)(now - last_reply_us);
+        interarrival_us = interarrival_us == 0 ? gap : interarrival_us + (gap - interarrival_us) / 8;
+    }
+
+    last_reply_us = now;
+    ITCH_PROBE2(rerequest_reply, buffer, n);
     return n;
 }
+
+int Rerequester::rto_us() const {
+    int64_t rto = tuning.initial_timeout_us;
+    if (has_rtt) {
+        rto = srtt_us + 4 * rttvar_us;
+    }
+
+    rto <<= backoff;
+    return (int)clamp_us(rto, tuning.min_timeout_us, tuning.max_timeout_us);
+}
+
+int Rerequester::timeout_us() const {
+    if (awaiting_first_reply) {
+        return rto_us();
+    }
+
+    // No spacing seen yet (second reply
+    // of the first chunk): the server may
+    // pace replies slower than the RTT,
+    // wait as for an unanswered request
+    if (interarrival_us == 0) {
+        int64_t first_wait = clamp_us(tuning.initial_timeout_us, tuning.min_timeout_us,
+                                      tuning.max_timeout_us);
+        int rto = rto_us();
+        return rto > first_wait ? rto : (int)first_wait;
+    }
+
+    // Replies stream back: a pause well
+    // beyond the usual spacing means the
+    // rest of the chunk is lost. Not
+    // capped by the RTT, a paced server
+    // spaces replies wider than that.
+    int64_t gap_timeout = 8 * interarrival_us;
+    return (int)clamp_us(gap_timeout, tuning.min_timeout_us, tuning.max_timeout_us);
+}
+
+uint16_t Rerequester::request_size(uint64_t remaining) const {
+    if (remaining < (uint64_t)request_count) {
+        return (uint16_t)remaining;
+    }
+    return request_count;
+}
+
+void Rerequester::chunk_done(uint16_t requested, uint64_t received) {
+    // AIMD: halve on loss,
+    // grow back slowly on success
+    if (received < (uint64_t)requested) {
+        uint16_t smaller = (uint16_t)(request_count / 2);
+        request_count = smaller < tuning.min_request_count ? tuning.min_request_count : smaller;
+        return;
+    }
+
+    uint32_t step = tuning.max_request_count / 8;
+    if (step == 0) {
+        step = 1;
+    }
+
+    uint32_t larger = (uint32_t)request_count + step;
+    request_count = larger > tuning.max_request_count ? tuning.max_request_count : (uint16_t)larger;
+}
+
+const RecoveryStats& Rerequester::stats() const {
+    return recovery_stats;
+}
+
+void Rerequester::reset_stats() {
+    recovery_stats = RecoveryStats();
+}
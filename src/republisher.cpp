@@ -0,0 +1,327 @@
+#include "republisher.h"
+
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <endian.h>
+
+static const int mold_header_len = 10 + 8 + 2;
+
+// Fill MoldUDP64 header
+static void write_mold_header(uint8_t* packet, const char session[10],
+                              uint64_t seq, uint16_t count) {
+    std::memcpy(packet, session, 10);
+
+    uint64_t seq_be = htobe64(seq);
+    uint16_t count_be = htobe16(count);
+    std::memcpy(packet + 10, &seq_be, sizeof(seq_be));
+    std::memcpy(packet + 18, &count_be, sizeof(count_be));
+}
+
+static void pad_session(const std::string& in, char out[10]) {
+    std::memset(out, ' ', 10);
+    size_t len = in.size() > 10 ? 10 : in.size();
+    std::memcpy(out, in.data(), len);
+}
+
+Republisher::Republisher()
+: send_fd(-1),
+  request_fd(-1),
+  max_payload(1472),
+  packet_len(0),
+  packet_count(0),
+  packet_first_seq(0),
+  has_next(false),
+  next_seq(0),
+  running(false) {
+    std::memset(&group_addr, 0, sizeof(group_addr));
+    std::memset(session, ' ', sizeof(session));
+}
+
+Republisher::~Republisher() {
+    close();
+}
+
+bool Republisher::open(const RepublishSettings& settings) {
+    close();
+
+    if (settings.mcast_ip.empty() || settings.mcast_port == 0) {
+        return false;
+    }
+
+    send_fd = ::socket(AF_INET, SOCK_DGRAM, 0);
+    if (send_fd < 0) {
+        return false;
+    }
+
+    if (!settings.interface_ip.empty()) {
+        in_addr interface_addr;
+        interface_addr.s_addr = ::inet_addr(settings.interface_ip.c_str());
+        ::setsockopt(send_fd, IPPROTO_IP, IP_MULTICAST_IF, &interface_addr, sizeof(interface_addr));
+    }
+
+    unsigned char ttl = (unsigned char)settings.ttl;
+    ::setsockopt(send_fd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+
+    // Local subscribers on this box
+    unsigned char loop = 1;
+    ::setsockopt(send_fd, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop));
+
+    group_addr.sin_family = AF_INET;
+    group_addr.sin_port = htons(settings.mcast_port);
+    group_addr.sin_addr.s_addr = ::inet_addr(settings.mcast_ip.c_str());
+
+    // MTU minus IP + UDP headers
+    max_payload = settings.mtu - 28;
+    if (max_payload < mold_header_len + 2 + 64) {
+        max_payload = mold_header_len + 2 + 64;
+    }
+    if (max_payload > (int)sizeof(packet)) {
+        max_payload = (int)sizeof(packet);
+    }
+
+    cache.init(settings.retain_messages, settings.retain_bytes);
+    packet_len = 0;
+    packet_count = 0;
+    has_next = false;
+
+    if (settings.rerequest_port != 0) {
+        request_fd = ::socket(AF_INET, SOCK_DGRAM, 0);
+        if (request_fd < 0) {
+            close();
+            return false;
+        }
+
+        sockaddr_in local;
+        std::memset(&local, 0, sizeof(local));
+        local.sin_family = AF_INET;
+        local.sin_addr.s_addr = htonl(INADDR_ANY);
+        local.sin_port = htons(settings.rerequest_port);
+
+        if (::bind(request_fd, (sockaddr*)&local, sizeof(local)) < 0) {
+            close();
+            return false;
+        }
+
+        // Wake up now and then
+        // to notice close()
+        timeval tv;
+        tv.tv_sec = 0;
+        tv.tv_usec = 200 * 1000;
+        ::setsockopt(request_fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+        running = true;
+        server = std::thread(&Republisher::serve_loop, this);
+    }
+
+    std::printf("INFO : Republish : %s:%u MTU=%d Rerequest Port=%u\n",
+                settings.mcast_ip.c_str(), (unsigned)settings.mcast_port,
+                settings.mtu, (unsigned)settings.rerequest_port);
+    return true;
+}
+
+void Republisher::close() {
+    running = false;
+    if (server.joinable()) {
+        server.join();
+    }
+
+    if (send_fd >= 0) {
+        flush();
+        ::close(send_fd);
+        send_fd = -1;
+    }
+
+    if (request_fd >= 0) {
+        ::close(request_fd);
+        request_fd = -1;
+    }
+}
+
+void Republisher::send_packet(const uint8_t* data, int data_len, const sockaddr_in& dst) {
+    ::sendto(send_fd, data, (size_t)data_len, 0, (const sockaddr*)&dst, sizeof(dst));
+}
+
+void Republisher::publish(const std::string& session_value, uint64_t seq,
+                          const uint8_t* msg, uint16_t msg_len) {
+
+    if (send_fd < 0 || !msg || msg_len == 0) {
+        return;
+    }
+
+    char msg_session[10];
+    pad_session(session_value, msg_session);
+    bool same_session = std::memcmp(msg_session, session, sizeof(session)) == 0;
+
+    if (has_next && same_session) {
+        // Already sent (A/B copy,
+        // recovery overlap)
+        if (seq < next_seq) {
+            return;
+        }
+
+        if (seq > next_seq) {
+            flush();
+            std::printf(">> WARN: REPUBLISH GAP ExpectedSequence=%llu Received=%llu\n",
+                        (unsigned long long)next_seq, (unsigned long long)seq);
+        }
+    }
+
+    if (!same_session) {
+        flush();
+        std::memcpy(session, msg_session, sizeof(session));
+    }
+
+    if (packet_count > 0 && packet_len + 2 + (int)msg_len > max_payload) {
+        flush();
+    }
+
+    if (packet_count == 0) {
+        packet_first_seq = seq;
+        packet_len = mold_header_len;
+    }
+
+    uint16_t len_be = htobe16(msg_len);
+    std::memcpy(packet + packet_len, &len_be, sizeof(len_be));
+    std::memcpy(packet + packet_len + 2, msg, msg_len);
+    packet_len += 2 + (int)msg_len;
+    packet_count++;
+
+    has_next = true;
+    next_seq = seq + 1;
+
+    std::lock_guard<std::mutex> guard(cache_lock);
+    cache.store(session_value, seq, msg, msg_len);
+}
+
+void Republisher::flush() {
+    if (send_fd < 0 || packet_count == 0) {
+        return;
+    }
+
+    write_mold_header(packet, session, packet_first_seq, packet_count);
+    send_packet(packet, packet_len, group_addr);
+
+    packet_len = 0;
+    packet_count = 0;
+}
+
+void Republisher::heartbeat(const std::string& session_value, bool end_of_session) {
+    if (send_fd < 0) {
+        return;
+    }
+
+    flush();
+
+    if (!has_next) {
+        return;
+    }
+
+    char msg_session[10];
+    pad_session(session_value, msg_session);
+    if (std::memcmp(msg_session, session, sizeof(session)) != 0) {
+        return;
+    }
+
+    uint8_t heartbeat_packet[mold_header_len];
+    write_mold_header(heartbeat_packet, session, next_seq, end_of_session ? 0xFFFF : 0);
+    send_packet(heartbeat_packet, mold_header_len, group_addr);
+}
+
+void Republisher::sequence_reset(uint64_t next) {
+    flush();
+
+    if (has_next) {
+        next_seq = next;
+    }
+
+    std::lock_guard<std::mutex> guard(cache_lock);
+    cache.clear();
+}
+
+void Republisher::serve_loop() {
+    uint8_t request[64];
+
+    while (running) {
+        sockaddr_in from;
+        socklen_t from_len = sizeof(from);
+
+        int n = (int)::recvfrom(request_fd, request, sizeof(request), 0,
+                                (sockaddr*)&from, &from_len);
+        if (n <= 0) {
+            continue;
+        }
+
+        answer_request(request, n, from);
+    }
+}
+
+// Reply from retained messages, in
+// MTU sized packets, up to the first
+// sequence no longer held. The cache
+// is locked while one packet is built,
+// not across the sends, so publish()
+// on the decode thread never waits
+// for a whole reply.
+void Republisher::answer_request(const uint8_t* request, int request_len, const sockaddr_in& from) {
+    if (request_len < mold_header_len) {
+        return;
+    }
+
+    uint64_t seq_be;
+    uint16_t count_be;
+    std::memcpy(&seq_be, request + 10, sizeof(seq_be));
+    std::memcpy(&count_be, request + 18, sizeof(count_be));
+
+    uint64_t seq = be64toh(seq_be);
+    uint16_t count = be16toh(count_be);
+    uint64_t end = seq + count;
+
+    uint8_t reply[64 * 1024];
+    bool more = true;
+
+    while (more && seq < end) {
+        int reply_len = mold_header_len;
+        uint16_t reply_count = 0;
+
+        {
+            std::lock_guard<std::mutex> guard(cache_lock);
+
+            // Checked per packet, a session
+            // change or reset clears the cache
+            const std::string& cache_session = cache.session();
+            if (cache_session.size() != 10 || std::memcmp(request, cache_session.data(), 10) != 0) {
+                return;
+            }
+
+            for (uint64_t s = seq; s < end; s++) {
+                const uint8_t* msg = 0;
+                uint16_t msg_len = 0;
+                if (!cache.get(s, &msg, &msg_len)) {
+                    more = false;
+                    break;
+                }
+
+                if (reply_count > 0 && reply_len + 2 + (int)msg_len > max_payload) {
+                    break;
+                }
+
+                uint16_t len_be = htobe16(msg_len);
+                std::memcpy(reply + reply_len, &len_be, sizeof(len_be));
+                std::memcpy(reply + reply_len + 2, msg, msg_len);
+                reply_len += 2 + (int)msg_len;
+                reply_count++;
+            }
+        }
+
+        if (reply_count == 0) {
+            return;
+        }
+
+        write_mold_header(reply, (const char*)request, seq, reply_count);
+        send_packet(reply, reply_len, from);
+        seq += reply_count;
+    }
+}
@@ -0,0 +1,167 @@
+#include "session_tracker.h"
+#include "probes.h"
+
+#include <cstdio>
+
+uint16_t mold_data_count(const MoldHeader& header) {
+    if (header.message_count == MOLD_END_OF_SESSION) {
+        return 0;
+    }
+    return (uint16_t)header.message_count;
+}
+
+SessionTracker::SessionTracker()
+: current(SESSION_JOINED),
+  expected_seq(0),
+  end_after_recovery(false) {}
+
+void SessionTracker::resume(const std::string& session, uint64_t next_seq) {
+    current = SESSION_LIVE;
+    current_session = session;
+    expected_seq = next_seq;
+    end_after_recovery = false;
+}
+
+// First packet of a session. Data
+// starts at its sequence, heartbeat
+// and end-of-session name the next.
+void SessionTracker::enter(const MoldHeader& header) {
+    current_session = header.session;
+    expected_seq = header.sequence_number;
+    end_after_recovery = false;
+    current = SESSION_LIVE;
+}
+
+PacketAction SessionTracker::on_packet(const MoldHeader& header) {
+    uint64_t expected_before = expected_seq;
+    PacketAction action = check_packet(header);
+    ITCH_PROBE4(sequence_check, (int)action, expected_before,
+                header.sequence_number, header.message_count);
+    return action;
+}
+
+PacketAction SessionTracker::check_packet(const MoldHeader& header) {
+    bool heartbeat = header.message_count == MOLD_HEARTBEAT;
+    bool end = header.message_count == MOLD_END_OF_SESSION;
+    uint64_t count = mold_data_count(header);
+
+    if (heartbeat) {
+        stats.heartbeats++;
+    }
+
+    if (current == SESSION_JOINED) {
+        enter(header);
+    } else if (header.session != current_session) {
+        std::printf(">> INFO: SESSION_CHANGE SequenceNum=%llu\n",
+                    (unsigned long long)header.sequence_number);
+        stats.session_changes++;
+        enter(header);
+    } else if (current == SESSION_ENDED) {
+        // Nothing more to ask for
+        stats.after_end++;
+        return PACKET_SKIP;
+    }
+
+    if (header.sequence_number > expected_seq) {
+        uint64_t gap_count = header.sequence_number - expected_seq;
+
+        if (heartbeat || end) {
+            stats.tail_gaps++;
+            std::printf(">> GAP DETECT: ExpectedSequence=%llu, %s=%llu, TotalMissing=%llu\n",
+                        (unsigned long long)expected_seq,
+                        end ? "EndOfSession" : "Heartbeat",
+                        (unsigned long long)header.sequence_number,
+                        (unsigned long long)gap_count);
+        } else {
+            stats.gaps++;
+            std::printf(">> GAP DETECT: ExpectedSequence=%llu, Received=%llu, TotalMissing=%llu\n",
+                        (unsigned long long)expected_seq,
+                        (unsigned long long)header.sequence_number,
+                        (unsigned long long)gap_count);
+        }
+
+        current = SESSION_RECOVERING;
+        end_after_recovery = end;
+        return PACKET_RECOVER;
+    }
+
+    if (header.sequence_number < expected_seq) {
+        if (count == 0) {
+            return PACKET_SKIP;
+        }
+
+        // Whole packet already delivered
+        uint64_t end_seq = header.sequence_number + count;
+        if (end_seq <= expected_seq) {
+            stats.duplicates++;
+            std::printf(">> DUPLICATE: ExpectedSequence=%llu Received=%llu, Ignoring...\n",
+                        (unsigned long long)expected_seq,
+                        (unsigned long long)header.sequence_number);
+            return PACKET_SKIP;
+        }
+
+        // New suffix only, the decoder
+        // skips the delivered prefix
+        stats.overlaps++;
+        std::printf(">> OVERLAP: ExpectedSequence=%llu Received=%llu, Count=%llu, New=%llu\n",
+                    (unsigned long long)expected_seq,
+                    (unsigned long long)header.sequence_number,
+                    (unsigned long long)count,
+                    (unsigned long long)(end_seq - expected_seq));
+        expected_seq = end_seq;
+        return PACKET_DELIVER;
+    }
+
+    expected_seq = header.sequence_number + count;
+
+    if (end) {
+        current = SESSION_ENDED;
+        std::printf(">> END OF SESSION: Session=%s, NextSequence=%llu\n",
+                    current_session.c_str(), (unsigned long long)expected_seq);
+    }
+    return PACKET_DELIVER;
+}
+
+void SessionTracker::recovered(uint64_t next_seq) {
+    if (next_seq > expected_seq) {
+        expected_seq = next_seq;
+    }
+
+    if (end_after_recovery) {
+        end_after_recovery = false;
+        current = SESSION_ENDED;
+        std::printf(">> END OF SESSION: Session=%s, NextSequence=%llu\n",
+                    current_session.c_str(), (unsigned long long)expected_seq);
+        return;
+    }
+    current = SESSION_LIVE;
+}
+
+void SessionTracker::rebase(uint64_t next_seq) {
+    expected_seq = next_seq;
+}
+
+SessionState SessionTracker::state() const {
+    return current;
+}
+
+const char* SessionTracker::state_name() const {
+    switch (current) {
+        case SESSION_JOINED: return "Joined";
+        case SESSION_LIVE: return "Live";
+        case SESSION_RECOVERING: return "Recovering";
+        default: return "EndOfSession";
+    }
+}
+
+const std::string& SessionTracker::session() const {
+    return current_session;
+}
+
+uint64_t SessionTracker::expected() const {
+    return expected_seq;
+}
+
+const SessionCounters& SessionTracker::counters() const {
+    return stats;
+}
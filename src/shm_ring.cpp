@@ -0,0 +1,272 @@
+#include "shm_ring.h"
+#include "decoder.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static const char ring_magic[8] = {'M', 'O', 'L', 'D', 'R', 'I', 'N', 'G'};
+static const uint32_t ring_version = 3;
+
+static uint64_t round_up_power_of_two(uint64_t value) {
+    uint64_t out = 1;
+    while (out < value) {
+        out <<= 1;
+    }
+    return out;
+}
+
+ShmRingWriter::ShmRingWriter()
+: cfg(0),
+  header(0),
+  slots(0),
+  mapped_bytes(0),
+  mask(0),
+  next_index(0) {}
+
+ShmRingWriter::~ShmRingWriter() {
+    close();
+}
+
+bool ShmRingWriter::open(const std::string& ring_name, uint64_t slot_count, const AppConfig& config) {
+    close();
+
+    if (ring_name.empty() || slot_count == 0) {
+        return false;
+    }
+
+    slot_count = round_up_power_of_two(slot_count);
+    mapped_bytes = sizeof(ShmRingHeader) + slot_count * sizeof(ShmRingSlot);
+
+    // Fresh ring each run, readers
+    // re-attach by name
+    ::shm_unlink(ring_name.c_str());
+    int fd = ::shm_open(ring_name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd < 0) {
+        return false;
+    }
+
+    if (::ftruncate(fd, (off_t)mapped_bytes) < 0) {
+        ::close(fd);
+        ::shm_unlink(ring_name.c_str());
+        return false;
+    }
+
+    void* base = ::mmap(0, mapped_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+
+    if (base == MAP_FAILED) {
+        ::shm_unlink(ring_name.c_str());
+        return false;
+    }
+
+    // Zeroed by ftruncate: every
+    // slot seq starts at 0 (empty)
+    header = (ShmRingHeader*)base;
+    slots = (ShmRingSlot*)((uint8_t*)base + sizeof(ShmRingHeader));
+
+    header->version = ring_version;
+    header->slot_size = (uint32_t)sizeof(ShmRingSlot);
+    header->slot_count = slot_count;
+    header->writer_pid = (uint32_t)::getpid();
+    header->write_index.store(0, std::memory_order_relaxed);
+
+    // Magic last, readers check it
+    // before trusting the header
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(header->magic, ring_magic, sizeof(header->magic));
+
+    cfg = &config;
+    name = ring_name;
+    mask = slot_count - 1;
+    next_index = 0;
+    return true;
+}
+
+void ShmRingWriter::close() {
+    if (header) {
+        ::munmap(header, mapped_bytes);
+        ::shm_unlink(name.c_str());
+        header = 0;
+        slots = 0;
+    }
+}
+
+void ShmRingWriter::publish(const std::string& session, uint64_t seq, uint64_t receive_ns,
+                            uint64_t exchange_ns, const uint8_t* msg, uint16_t msg_len, const DecodedFields& fields) {
+
+    if (!header || !msg || msg_len == 0) {
+        return;
+    }
+
+    uint64_t index = next_index++;
+    ShmRingSlot& slot = slots[index & mask];
+
+    // Odd: record being written
+    slot.seq.store(2 * index + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    NormalizedRecord& record = slot.record;
+    record.sequence = seq;
+    record.receive_ns = receive_ns;
+    record.exchange_ns = exchange_ns;
+
+    std::memset(record.session, ' ', sizeof(record.session));
+    size_t session_len = session.size();
+    if (session_len > sizeof(record.session)) {
+        session_len = sizeof(record.session);
+    }
+    std::memcpy(record.session, session.data(), session_len);
+
+    record.msg_type = (char)msg[0];
+    record.msg_len = msg_len;
+    record.truncated = msg_len > sizeof(record.data) ? 1 : 0;
+    record.reserved = 0;
+
+    normalize_message(msg, msg_len, &fields,
+                      record.data, (uint16_t)sizeof(record.data));
+
+    // Even: record ready
+    slot.seq.store(2 * index + 2, std::memory_order_release);
+    header->write_index.store(index + 1, std::memory_order_release);
+}
+
+ShmRingReader::ShmRingReader()
+: header(0),
+  slots(0),
+  mapped_bytes(0),
+  mask(0),
+  next_index(0),
+  device(0),
+  inode(0) {}
+
+ShmRingReader::~ShmRingReader() {
+    close();
+}
+
+bool ShmRingReader::open(const std::string& ring_name) {
+    close();
+
+    int fd = ::shm_open(ring_name.c_str(), O_RDONLY, 0);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    if (::fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(ShmRingHeader)) {
+        ::close(fd);
+        return false;
+    }
+
+    mapped_bytes = (size_t)st.st_size;
+    device = (uint64_t)st.st_dev;
+    inode = (uint64_t)st.st_ino;
+    void* base = ::mmap(0, mapped_bytes, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+
+    if (base == MAP_FAILED) {
+        return false;
+    }
+
+    header = (ShmRingHeader*)base;
+
+    bool valid = std::memcmp(header->magic, ring_magic, sizeof(header->magic)) == 0 &&
+                 header->version == ring_version &&
+                 header->slot_size == sizeof(ShmRingSlot) &&
+                 sizeof(ShmRingHeader) + header->slot_count * sizeof(ShmRingSlot) <= mapped_bytes;
+
+    if (!valid) {
+        close();
+        return false;
+    }
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    slots = (ShmRingSlot*)((uint8_t*)base + sizeof(ShmRingHeader));
+    mask = header->slot_count - 1;
+    next_index = header->write_index.load(std::memory_order_acquire);
+    name = ring_name;
+    return true;
+}
+
+void ShmRingReader::close() {
+    if (header) {
+        ::munmap(header, mapped_bytes);
+        header = 0;
+        slots = 0;
+    }
+}
+
+void ShmRingReader::rewind() {
+    if (!header) {
+        return;
+    }
+
+    uint64_t write_index = header->write_index.load(std::memory_order_acquire);
+    next_index = write_index > mask ? write_index - mask : 0;
+}
+
+bool ShmRingReader::stale() const {
+    if (!header) {
+        return true;
+    }
+
+    // Crashed writer: name still
+    // there, nobody writes
+    if (::kill((pid_t)header->writer_pid, 0) < 0 && errno == ESRCH) {
+        return true;
+    }
+
+    // Clean stop unlinks the name,
+    // a restart creates a new ring
+    int fd = ::shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0) {
+        return true;
+    }
+
+    struct stat st;
+    bool moved = ::fstat(fd, &st) < 0 ||
+                 (uint64_t)st.st_dev != device ||
+                 (uint64_t)st.st_ino != inode;
+    ::close(fd);
+    return moved;
+}
+
+ShmReadResult ShmRingReader::read(NormalizedRecord* out, uint64_t* skipped) {
+    if (!header || !out) {
+        return SHM_READ_EMPTY;
+    }
+
+    const ShmRingSlot& slot = slots[next_index & mask];
+    uint64_t ready = 2 * next_index + 2;
+
+    uint64_t before = slot.seq.load(std::memory_order_acquire);
+    if (before < ready) {
+        return SHM_READ_EMPTY;
+    }
+
+    if (before == ready) {
+        std::memcpy(out, &slot.record, sizeof(*out));
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        // Unchanged: copy is consistent
+        if (slot.seq.load(std::memory_order_relaxed) == ready) {
+            next_index++;
+            return SHM_READ_OK;
+        }
+    }
+
+    // Writer reused the slot, jump to
+    // the oldest record still held
+    uint64_t write_index = header->write_index.load(std::memory_order_acquire);
+    uint64_t oldest = write_index > mask ? write_index - mask : 0;
+
+    if (skipped) {
+        *skipped = oldest > next_index ? oldest - next_index : 0;
+    }
+    next_index = oldest;
+    return SHM_READ_LAPPED;
+}
@@ -0,0 +1,201 @@
+#include "snapshot.h"
+
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static const char snapshot_magic[8] = {'M', 'O', 'L', 'D', 'S', 'N', 'A', 'P'};
+static const uint32_t snapshot_version = 1;
+
+static uint64_t realtime_ns() {
+    timespec ts;
+    ::clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static bool write_snapshot_file(const std::string& path, const Snapshot& snapshot) {
+    // Write to temp file, rename when done
+    // so a crash never leaves a half
+    // written "latest" snapshot.
+    std::string temp_path = path + ".tmp";
+
+    int fd = ::open(temp_path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+
+    size_t orders_bytes = snapshot.orders.size() * sizeof(BookOrder);
+    size_t file_bytes = sizeof(SnapshotHeader) + orders_bytes;
+
+    if (::ftruncate(fd, (off_t)file_bytes) < 0) {
+        ::close(fd);
+        return false;
+    }
+
+    void* base = ::mmap(0, file_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        ::close(fd);
+        return false;
+    }
+
+    SnapshotHeader* header = (SnapshotHeader*)base;
+    std::memset(header, 0, sizeof(*header));
+    std::memcpy(header->magic, snapshot_magic, sizeof(header->magic));
+    header->version = snapshot_version;
+    header->record_size = (uint32_t)sizeof(BookOrder);
+
+    std::memset(header->session, ' ', sizeof(header->session));
+    size_t session_len = snapshot.session.size();
+    if (session_len > sizeof(header->session)) {
+        session_len = sizeof(header->session);
+    }
+    std::memcpy(header->session, snapshot.session.data(), session_len);
+
+    header->next_sequence = snapshot.next_sequence;
+    header->decoded_count = snapshot.decoded_count;
+    header->created_ns = realtime_ns();
+    header->order_count = snapshot.orders.size();
+
+    if (orders_bytes > 0) {
+        std::memcpy((uint8_t*)base + sizeof(SnapshotHeader), &snapshot.orders[0], orders_bytes);
+    }
+
+    bool ok = (::msync(base, file_bytes, MS_SYNC) == 0);
+    ::munmap(base, file_bytes);
+    ::close(fd);
+
+    if (!ok || ::rename(temp_path.c_str(), path.c_str()) < 0) {
+        ::unlink(temp_path.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+bool load_snapshot(const std::string& path, Snapshot* out) {
+    if (!out || path.empty()) {
+        return false;
+    }
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    if (::fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(SnapshotHeader)) {
+        ::close(fd);
+        return false;
+    }
+
+    size_t file_bytes = (size_t)st.st_size;
+    void* base = ::mmap(0, file_bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+
+    if (base == MAP_FAILED) {
+        return false;
+    }
+
+    const SnapshotHeader* header = (const SnapshotHeader*)base;
+
+    bool valid = std::memcmp(header->magic, snapshot_magic, sizeof(header->magic)) == 0 &&
+                 header->version == snapshot_version &&
+                 header->record_size == sizeof(BookOrder) &&
+                 sizeof(SnapshotHeader) + header->order_count * sizeof(BookOrder) <= file_bytes;
+
+    if (valid) {
+        out->session.assign(header->session, sizeof(header->session));
+        out->next_sequence = header->next_sequence;
+        out->decoded_count = header->decoded_count;
+
+        const BookOrder* orders = (const BookOrder*)((const uint8_t*)base + sizeof(SnapshotHeader));
+        out->orders.assign(orders, orders + header->order_count);
+    }
+
+    ::munmap(base, file_bytes);
+    return valid;
+}
+
+SnapshotWriter::SnapshotWriter()
+: running(false),
+  has_pending(false) {}
+
+SnapshotWriter::~SnapshotWriter() {
+    stop();
+}
+
+bool SnapshotWriter::start(const std::string& snapshot_path) {
+    stop();
+
+    if (snapshot_path.empty()) {
+        return false;
+    }
+
+    path = snapshot_path;
+    running = true;
+    has_pending = false;
+    writer = std::thread(&SnapshotWriter::writer_loop, this);
+    return true;
+}
+
+void SnapshotWriter::submit(Snapshot& snapshot) {
+    std::lock_guard<std::mutex> guard(lock);
+    if (!running) {
+        return;
+    }
+
+    // Swap, caller gets the old buffer back
+    // to reuse its capacity next time
+    pending.session.swap(snapshot.session);
+    pending.orders.swap(snapshot.orders);
+    pending.next_sequence = snapshot.next_sequence;
+    pending.decoded_count = snapshot.decoded_count;
+    has_pending = true;
+    wake.notify_one();
+}
+
+void SnapshotWriter::stop() {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (!running) {
+            return;
+        }
+        running = false;
+        wake.notify_one();
+    }
+
+    if (writer.joinable()) {
+        writer.join();
+    }
+}
+
+void SnapshotWriter::writer_loop() {
+    Snapshot current;
+
+    while (1) {
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            while (running && !has_pending) {
+                wake.wait(guard);
+            }
+
+            if (!has_pending) {
+                return;
+            }
+
+            current.session.swap(pending.session);
+            current.orders.swap(pending.orders);
+            current.next_sequence = pending.next_sequence;
+            current.decoded_count = pending.decoded_count;
+            has_pending = false;
+        }
+
+        if (!write_snapshot_file(path, current)) {
+            std::printf(">> WARN: Snapshot write failed path=%s\n", path.c_str());
+        }
+    }
+}
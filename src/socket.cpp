@@ -1,11 +1,15 @@
 #include "socket.h"
+#include "probes.h"
 #include <sys/socket.h>
 #include <unistd.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <cstring>
+#include <poll.h>
+#include <ctime>
+#include <sys/time.h>
 
-Socket::Socket() : fd(-1) {}
+Socket::Socket() : fd(-1), timestamps(false), receive_ns(0) {}
 
 Socket::~Socket() {
     close();
@@ -45,6 +49,19 @@ bool Socket::connect_socket(const std::string& mcast_ip, uint16_t mcast_port,
         return false;
     }
 
+    // Only groups joined on this socket,
+    // not every group on the port (channels
+    // sharing a port in one process)
+    #ifdef IP_MULTICAST_ALL
+    int multicast_all = 0;
+    ::setsockopt(fd, IPPROTO_IP, IP_MULTICAST_ALL, &multicast_all, sizeof(multicast_all));
+    #endif
+
+    if (timestamps) {
+        int on = 1;
+        ::setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on));
+    }
+
     // SSM (Source Specific Multicast)
     if (!source_ip.empty()) {
         ip_mreq_source multicast_request;
@@ -79,12 +96,75 @@ bool Socket::connect_socket(const std::string& mcast_ip, uint16_t mcast_port,
     return true;
 }
 
+// recvmsg() with the timestamp
+// control message when it is on
+int Socket::receive_into(uint8_t* buffer, int buffer_capacity, int flags) {
+    if (!timestamps) {
+        int bytes = (int)::recvfrom(fd, buffer, (size_t)buffer_capacity, flags, 0, 0);
+        ITCH_PROBE2(packet_receive, buffer, bytes);
+        return bytes;
+    }
+
+    iovec io;
+    io.iov_base = buffer;
+    io.iov_len = (size_t)buffer_capacity;
+
+    char control[CMSG_SPACE(sizeof(timespec))];
+
+    msghdr message;
+    std::memset(&message, 0, sizeof(message));
+    message.msg_iov = &io;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    int bytes = (int)::recvmsg(fd, &message, flags);
+    if (bytes < 0) {
+        return bytes;
+    }
+
+    receive_ns = 0;
+    for (cmsghdr* cmsg = CMSG_FIRSTHDR(&message); cmsg; cmsg = CMSG_NXTHDR(&message, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+            timespec ts;
+            std::memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+            receive_ns = (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+        }
+    }
+    ITCH_PROBE2(packet_receive, buffer, bytes);
+    return bytes;
+}
+
 int Socket::receive_bytes(uint8_t* buffer, int buffer_capacity) {
     if (fd < 0) {
         return -1;
     }
 
-    return (int)::recvfrom(fd, buffer, (size_t)buffer_capacity, 0, 0, 0);
+    return receive_into(buffer, buffer_capacity, 0);
+}
+
+int Socket::receive_bytes_timeout(uint8_t* buffer, int buffer_capacity, int timeout_us) {
+    if (fd < 0) {
+        return -1;
+    }
+
+    // ppoll() for us resolution,
+    // reorder windows are short
+    pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+
+    timespec timeout;
+    timeout.tv_sec = timeout_us / 1000000;
+    timeout.tv_nsec = (long)(timeout_us % 1000000) * 1000;
+
+    int ready = ::ppoll(&pfd, 1, &timeout, 0);
+    if (ready <= 0) {
+        return ready;
+    }
+
+    return receive_into(buffer, buffer_capacity, MSG_DONTWAIT);
 }
 
 #ifdef __linux__
@@ -95,7 +175,9 @@ int Socket::receive_batch(struct mmsghdr* message_vector, int message_count) {
 
     // MSG_WAITFORONE: block until >=1 packet arrives
     // then return quickly
-    return ::recvmmsg(fd, message_vector, (unsigned int)message_count, MSG_WAITFORONE, 0);
+    int received = ::recvmmsg(fd, message_vector, (unsigned int)message_count, MSG_WAITFORONE, 0);
+    ITCH_PROBE2(packet_batch, message_vector, received);
+    return received;
 }
 #endif
 
@@ -111,4 +193,42 @@ bool Socket::set_receive_buffer(int receive_buffer_bytes) {
     return true;
 }
 
+bool Socket::set_receive_timeout(int timeout_ms) {
+    if (fd < 0) {
+        return false;
+    }
+
+    timeval timeout;
+    timeout.tv_sec = timeout_ms / 1000;
+    timeout.tv_usec = (timeout_ms % 1000) * 1000;
+
+    if (::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) < 0) {
+        return false;
+    }
+
+    return true;
+}
+
+bool Socket::set_receive_timestamps(bool on) {
+    timestamps = on;
+    receive_ns = 0;
 
+    if (fd < 0) {
+        return true;
+    }
+
+    int value = on ? 1 : 0;
+    if (::setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPNS, &value, sizeof(value)) < 0) {
+        timestamps = false;
+        return false;
+    }
+    return true;
+}
+
+uint64_t Socket::last_receive_ns() const {
+    return timestamps ? receive_ns : 0;
+}
+
+int Socket::handle() const {
+    return fd;
+}
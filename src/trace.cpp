@@ -0,0 +1,639 @@
+#include "trace.h"
+#include "tsc_clock.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+static const char TRACE_MAGIC[8] = { 'I', 'T', 'C', 'H', 'T', 'R', 'C', 'E' };
+static const uint32_t TRACE_VERSION = 1;
+static const int TRACE_MAX_THREADS = 64;
+static const int TRACE_MAX_CHANNELS = 64;
+static const int TRACE_NAME_LENGTH = 32;
+
+// File: header, channel names,
+// then per thread a header and its
+// events, oldest first
+struct TraceFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t pid;
+    uint64_t dump_ns;
+    char reason[16];
+    uint32_t thread_count;
+    uint32_t channel_count;
+};
+
+struct TraceThreadHeader {
+    char name[TRACE_NAME_LENGTH];
+    uint32_t tid;
+    uint32_t event_count;
+};
+
+// One writer (its thread), read
+// by whoever dumps. An event being
+// written during a dump may come
+// out torn: best effort.
+struct TraceRing {
+    char name[TRACE_NAME_LENGTH];
+    uint32_t tid;
+    uint64_t mask;
+    TraceEvent* events;
+    std::atomic<uint64_t> head;     // events written
+};
+
+static std::atomic<TraceRing*> rings[TRACE_MAX_THREADS];
+static std::atomic<int> ring_slots(0);
+
+static char channel_names[TRACE_MAX_CHANNELS][TRACE_NAME_LENGTH];
+static std::atomic<int> channel_count(0);
+static std::mutex channel_mutex;
+
+// Set by trace_init only
+static uint64_t ring_capacity = 0;      // power of two, 0 = off
+static uint64_t min_dump_interval_ns = 0;
+static bool dump_on_gap = true;
+static uint32_t max_dump_files = 0;     // 0 = keep all
+static char dump_prefix[256];           // "<dir>/itch-trace-<pid>-"
+
+static std::atomic<uint32_t> dump_serial(0);
+static std::atomic<bool> dumping(false);
+static std::atomic<uint64_t> last_dump_ns(0);
+
+static thread_local TraceRing* thread_ring = 0;
+static thread_local bool thread_ring_failed = false;
+static thread_local char thread_name[TRACE_NAME_LENGTH];
+
+static const char* reason_name(TraceDumpReason reason) {
+    switch (reason) {
+        case TRACE_DUMP_GAP: return "gap";
+        case TRACE_DUMP_STALL: return "stall";
+        case TRACE_DUMP_SIGNAL: return "signal";
+        default: return "crash";
+    }
+}
+
+static void copy_name(char* out, const std::string& name) {
+    std::memset(out, 0, TRACE_NAME_LENGTH);
+    std::memcpy(out, name.data(), name.size() < TRACE_NAME_LENGTH - 1 ? name.size() : TRACE_NAME_LENGTH - 1);
+}
+
+// No snprintf in a signal handler:
+// build strings by hand
+static void append_text(char* out, size_t capacity, size_t* length, const char* text) {
+    while (*text && *length + 1 < capacity) {
+        out[(*length)++] = *text++;
+    }
+    out[*length] = '\0';
+}
+
+static void append_number(char* out, size_t capacity, size_t* length, uint64_t value) {
+    char digits[24];
+    int n = 0;
+    do {
+        digits[n++] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value != 0);
+
+    char text[24];
+    for (int i = 0; i < n; i++) {
+        text[i] = digits[n - 1 - i];
+    }
+    text[n] = '\0';
+    append_text(out, capacity, length, text);
+}
+
+static bool write_all(int fd, const void* data, size_t size) {
+    const char* p = (const char*)data;
+    while (size > 0) {
+        ssize_t n = ::write(fd, p, size);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        size -= (size_t)n;
+    }
+    return true;
+}
+
+// Async-signal-safe: open/write/close
+// and atomics only, the caller passes
+// the time
+static bool write_dump(TraceDumpReason reason, uint64_t now_ns, char* path, size_t path_capacity,
+                       uint64_t* events_written) {
+    uint32_t serial = dump_serial.fetch_add(1);
+
+    size_t path_length = 0;
+    path[0] = '\0';
+    append_text(path, path_capacity, &path_length, dump_prefix);
+    append_number(path, path_capacity, &path_length, serial);
+    append_text(path, path_capacity, &path_length, ".bin");
+
+    // Rotate: only the newest
+    // max_dump_files are kept
+    if (max_dump_files != 0 && serial >= max_dump_files) {
+        char old_path[320];
+        size_t old_length = 0;
+        old_path[0] = '\0';
+        append_text(old_path, sizeof(old_path), &old_length, dump_prefix);
+        append_number(old_path, sizeof(old_path), &old_length, serial - max_dump_files);
+        append_text(old_path, sizeof(old_path), &old_length, ".bin");
+        ::unlink(old_path);
+    }
+
+    int fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+
+    int slots = ring_slots.load(std::memory_order_acquire);
+    if (slots > TRACE_MAX_THREADS) {
+        slots = TRACE_MAX_THREADS;
+    }
+    uint32_t threads = 0;
+    for (int i = 0; i < slots; i++) {
+        if (rings[i].load(std::memory_order_acquire)) {
+            threads++;
+        }
+    }
+
+    TraceFileHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+    header.version = TRACE_VERSION;
+    header.pid = (uint32_t)::getpid();
+    header.dump_ns = now_ns;
+    size_t reason_length = 0;
+    append_text(header.reason, sizeof(header.reason), &reason_length, reason_name(reason));
+    header.thread_count = threads;
+    header.channel_count = (uint32_t)channel_count.load(std::memory_order_acquire);
+
+    bool ok = write_all(fd, &header, sizeof(header)) &&
+              write_all(fd, channel_names, header.channel_count * TRACE_NAME_LENGTH);
+
+    *events_written = 0;
+    for (int i = 0; i < slots && ok; i++) {
+        TraceRing* ring = rings[i].load(std::memory_order_acquire);
+        if (!ring) {
+            continue;
+        }
+
+        uint64_t head = ring->head.load(std::memory_order_acquire);
+        uint64_t count = head < ring_capacity ? head : ring_capacity;
+        uint64_t first = (head - count) & ring->mask;
+
+        TraceThreadHeader thread;
+        std::memcpy(thread.name, ring->name, sizeof(thread.name));
+        thread.tid = ring->tid;
+        thread.event_count = (uint32_t)count;
+
+        // Oldest part runs to the end
+        // of the ring, then wraps
+        uint64_t tail_part = ring_capacity - first < count ? ring_capacity - first : count;
+        ok = write_all(fd, &thread, sizeof(thread)) &&
+             write_all(fd, ring->events + first, tail_part * sizeof(TraceEvent)) &&
+             write_all(fd, ring->events, (count - tail_part) * sizeof(TraceEvent));
+        *events_written += count;
+    }
+
+    ::close(fd);
+    return ok;
+}
+
+static void signal_dump(TraceDumpReason reason) {
+    if (ring_capacity == 0 || dumping.exchange(true)) {
+        return;
+    }
+
+    // Not clock_realtime_ns(): it spins
+    // on the calibration seqlock, which
+    // this thread may be holding odd
+    timespec ts;
+    ::clock_gettime(CLOCK_REALTIME, &ts);
+    uint64_t now_ns = (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+
+    char path[320];
+    uint64_t events = 0;
+    bool ok = write_dump(reason, now_ns, path, sizeof(path), &events);
+    dumping.store(false);
+
+    char line[512];
+    size_t length = 0;
+    append_text(line, sizeof(line), &length, ok ? ">> TRACE DUMP: Reason=" : ">> TRACE DUMP FAILED: Reason=");
+    append_text(line, sizeof(line), &length, reason_name(reason));
+    append_text(line, sizeof(line), &length, ", File=");
+    append_text(line, sizeof(line), &length, path);
+    append_text(line, sizeof(line), &length, ", Events=");
+    append_number(line, sizeof(line), &length, events);
+    append_text(line, sizeof(line), &length, "\n");
+    write_all(STDOUT_FILENO, line, length);
+}
+
+static void on_dump_signal(int) {
+    int saved_errno = errno;
+    signal_dump(TRACE_DUMP_SIGNAL);
+    errno = saved_errno;
+}
+
+// Handler is reset on entry: the
+// re-raised signal takes the default
+// action (core) once this returns
+static void on_fatal_signal(int sig) {
+    signal_dump(TRACE_DUMP_CRASH);
+    ::raise(sig);
+}
+
+// Gap / stall dumps are written here,
+// the decode thread only hands over
+// the request. The rings are read a
+// moment later, the newest events are
+// still the ones around the request.
+struct DumpWriter {
+    std::thread writer;
+    std::mutex lock;
+    std::condition_variable wake;
+    bool running;
+    bool has_pending;
+    TraceDumpReason pending_reason;
+    uint64_t pending_ns;
+
+    DumpWriter()
+    : running(false),
+      has_pending(false),
+      pending_reason(TRACE_DUMP_GAP),
+      pending_ns(0) {}
+
+    ~DumpWriter() {
+        stop();
+    }
+
+    void start();
+    bool submit(TraceDumpReason reason, uint64_t now_ns);
+
+    // Write pending dump and stop thread
+    void stop();
+    void writer_loop();
+};
+
+static DumpWriter dump_writer;
+
+void DumpWriter::start() {
+    std::lock_guard<std::mutex> guard(lock);
+    if (running) {
+        return;
+    }
+    running = true;
+    writer = std::thread(&DumpWriter::writer_loop, this);
+}
+
+bool DumpWriter::submit(TraceDumpReason reason, uint64_t now_ns) {
+    std::lock_guard<std::mutex> guard(lock);
+    if (!running || has_pending) {
+        return false;
+    }
+    pending_reason = reason;
+    pending_ns = now_ns;
+    has_pending = true;
+    wake.notify_one();
+    return true;
+}
+
+void DumpWriter::stop() {
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (!running) {
+            return;
+        }
+        running = false;
+        wake.notify_one();
+    }
+
+    if (writer.joinable()) {
+        writer.join();
+    }
+}
+
+void DumpWriter::writer_loop() {
+    while (1) {
+        TraceDumpReason reason;
+        uint64_t now_ns;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            while (running && !has_pending) {
+                wake.wait(guard);
+            }
+
+            if (!has_pending) {
+                return;
+            }
+
+            reason = pending_reason;
+            now_ns = pending_ns;
+            has_pending = false;
+        }
+
+        // A signal dump is running
+        if (dumping.exchange(true)) {
+            continue;
+        }
+
+        char path[320];
+        uint64_t events = 0;
+        bool ok = write_dump(reason, now_ns, path, sizeof(path), &events);
+        int saved_errno = errno;
+        dumping.store(false);
+
+        if (!ok) {
+            std::printf(">> TRACE DUMP FAILED: Reason=%s, File=%s (%s)\n",
+                        reason_name(reason), path, std::strerror(saved_errno));
+            continue;
+        }
+        std::printf(">> TRACE DUMP: Reason=%s, File=%s, Events=%llu\n",
+                    reason_name(reason), path, (unsigned long long)events);
+    }
+}
+
+static void install_handler(int sig, void (*handler)(int), int flags) {
+    struct sigaction action;
+    std::memset(&action, 0, sizeof(action));
+    action.sa_handler = handler;
+    action.sa_flags = flags;
+    sigemptyset(&action.sa_mask);
+    ::sigaction(sig, &action, 0);
+}
+
+void trace_init(const TraceSettings& settings) {
+    if (settings.ring_events == 0) {
+        ring_capacity = 0;
+        return;
+    }
+
+    ring_capacity = 1;
+    while (ring_capacity < settings.ring_events) {
+        ring_capacity <<= 1;
+    }
+    min_dump_interval_ns = (uint64_t)settings.min_dump_interval_ms * 1000000ULL;
+    dump_on_gap = settings.dump_on_gap;
+    max_dump_files = settings.max_dump_files;
+
+    size_t length = 0;
+    append_text(dump_prefix, sizeof(dump_prefix), &length,
+                settings.dump_dir.empty() ? "." : settings.dump_dir.c_str());
+    append_text(dump_prefix, sizeof(dump_prefix), &length, "/itch-trace-");
+    append_number(dump_prefix, sizeof(dump_prefix), &length, (uint64_t)::getpid());
+    append_text(dump_prefix, sizeof(dump_prefix), &length, "-");
+
+    dump_writer.start();
+
+    install_handler(SIGUSR1, on_dump_signal, SA_RESTART);
+    install_handler(SIGSEGV, on_fatal_signal, SA_RESETHAND);
+    install_handler(SIGBUS, on_fatal_signal, SA_RESETHAND);
+    install_handler(SIGFPE, on_fatal_signal, SA_RESETHAND);
+    install_handler(SIGILL, on_fatal_signal, SA_RESETHAND);
+    install_handler(SIGABRT, on_fatal_signal, SA_RESETHAND);
+}
+
+uint16_t trace_channel(const std::string& name) {
+    std::lock_guard<std::mutex> lock(channel_mutex);
+
+    char padded[TRACE_NAME_LENGTH];
+    copy_name(padded, name);
+
+    int count = channel_count.load(std::memory_order_relaxed);
+    for (int i = 0; i < count; i++) {
+        if (std::memcmp(channel_names[i], padded, TRACE_NAME_LENGTH) == 0) {
+            return (uint16_t)i;
+        }
+    }
+
+    // Full: share the last id
+    if (count == TRACE_MAX_CHANNELS) {
+        return (uint16_t)(count - 1);
+    }
+    std::memcpy(channel_names[count], padded, TRACE_NAME_LENGTH);
+    channel_count.store(count + 1, std::memory_order_release);
+    return (uint16_t)count;
+}
+
+void trace_thread(const std::string& name) {
+    copy_name(thread_name, name);
+}
+
+// First event of a thread: its ring,
+// pre-touched so the hot path does
+// not page fault
+static TraceRing* attach_ring() {
+    if (thread_ring_failed) {
+        return 0;
+    }
+
+    int slot = ring_slots.fetch_add(1);
+    if (slot >= TRACE_MAX_THREADS) {
+        thread_ring_failed = true;
+        return 0;
+    }
+
+    TraceRing* ring = new TraceRing();
+    std::memcpy(ring->name, thread_name, sizeof(ring->name));
+    if (ring->name[0] == '\0') {
+        copy_name(ring->name, "thread");
+    }
+    ring->tid = (uint32_t)::syscall(SYS_gettid);
+    ring->mask = ring_capacity - 1;
+    ring->events = new TraceEvent[ring_capacity]();
+    ring->head.store(0);
+
+    rings[slot].store(ring, std::memory_order_release);
+    thread_ring = ring;
+    return ring;
+}
+
+void trace_event(uint16_t type, uint16_t channel, uint64_t seq, uint32_t count,
+                 uint32_t arg, uint64_t ts_ns) {
+    if (ring_capacity == 0) {
+        return;
+    }
+
+    TraceRing* ring = thread_ring;
+    if (!ring && !(ring = attach_ring())) {
+        return;
+    }
+
+    uint64_t head = ring->head.load(std::memory_order_relaxed);
+    TraceEvent& event = ring->events[head & ring->mask];
+    event.ts_ns = ts_ns != 0 ? ts_ns : clock_realtime_ns();
+    event.seq = seq;
+    event.count = count;
+    event.arg = arg;
+    event.type = type;
+    event.channel = channel;
+    event.reserved = 0;
+    ring->head.store(head + 1, std::memory_order_release);
+}
+
+bool trace_dump(TraceDumpReason reason) {
+    if (ring_capacity == 0 || (reason == TRACE_DUMP_GAP && !dump_on_gap)) {
+        return false;
+    }
+
+    // A lossy feed gaps constantly:
+    // one dump covers a burst
+    uint64_t now_ns = clock_realtime_ns();
+    uint64_t last_ns = last_dump_ns.load();
+    if (last_ns != 0 && now_ns - last_ns < min_dump_interval_ns) {
+        return false;
+    }
+    if (!dump_writer.submit(reason, now_ns)) {
+        return false;
+    }
+    last_dump_ns.store(now_ns);
+    return true;
+}
+
+static void print_json_string(const char* text) {
+    std::putchar('"');
+    for (const char* p = text; *p; p++) {
+        unsigned char c = (unsigned char)*p;
+        if (c == '"' || c == '\\') {
+            std::printf("\\%c", c);
+        } else if (c < 0x20) {
+            std::printf("\\u%04x", c);
+        } else {
+            std::putchar(c);
+        }
+    }
+    std::putchar('"');
+}
+
+struct TraceThread {
+    TraceThreadHeader header;
+    std::vector<TraceEvent> events;
+};
+
+int trace_to_json(const std::string& path) {
+    FILE* f = std::fopen(path.c_str(), "rb");
+    if (!f) {
+        std::printf("Error: cannot open %s (%s)\n", path.c_str(), std::strerror(errno));
+        return 1;
+    }
+
+    TraceFileHeader header;
+    bool ok = std::fread(&header, sizeof(header), 1, f) == 1 &&
+              std::memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic)) == 0 &&
+              header.version == TRACE_VERSION &&
+              header.channel_count <= TRACE_MAX_CHANNELS &&
+              header.thread_count <= TRACE_MAX_THREADS;
+
+    char channels[TRACE_MAX_CHANNELS][TRACE_NAME_LENGTH];
+    ok = ok && std::fread(channels, TRACE_NAME_LENGTH, header.channel_count, f) == header.channel_count;
+
+    std::vector<TraceThread> threads(ok ? header.thread_count : 0);
+    for (size_t i = 0; i < threads.size() && ok; i++) {
+        TraceThread& thread = threads[i];
+        ok = std::fread(&thread.header, sizeof(thread.header), 1, f) == 1;
+        if (ok) {
+            thread.header.name[TRACE_NAME_LENGTH - 1] = '\0';
+            thread.events.resize(thread.header.event_count);
+            ok = thread.events.empty() ||
+                 std::fread(&thread.events[0], sizeof(TraceEvent), thread.events.size(), f) == thread.events.size();
+        }
+    }
+    std::fclose(f);
+
+    if (!ok) {
+        std::printf("Error: %s is not a trace dump (or is truncated)\n", path.c_str());
+        return 1;
+    }
+    for (uint32_t c = 0; c < header.channel_count; c++) {
+        channels[c][TRACE_NAME_LENGTH - 1] = '\0';
+    }
+    header.reason[sizeof(header.reason) - 1] = '\0';
+
+    // Times relative to the oldest
+    // event, us with ns precision
+    uint64_t base_ns = header.dump_ns;
+    for (size_t i = 0; i < threads.size(); i++) {
+        for (size_t j = 0; j < threads[i].events.size(); j++) {
+            uint64_t ts = threads[i].events[j].ts_ns;
+            if (ts != 0 && ts < base_ns) {
+                base_ns = ts;
+            }
+        }
+    }
+
+    std::printf("{\"displayTimeUnit\":\"ns\",\"otherData\":{\"reason\":");
+    print_json_string(header.reason);
+    std::printf(",\"pid\":%u,\"dump_ns\":%llu,\"base_ns\":%llu},\n\"traceEvents\":[\n",
+                header.pid, (unsigned long long)header.dump_ns, (unsigned long long)base_ns);
+
+    std::printf("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%u,\"tid\":0,\"args\":{\"name\":\"itch\"}}",
+                header.pid);
+    for (size_t i = 0; i < threads.size(); i++) {
+        std::printf(",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%u,\"tid\":%u,\"args\":{\"name\":",
+                    header.pid, threads[i].header.tid);
+        print_json_string(threads[i].header.name);
+        std::printf("}}");
+    }
+
+    for (size_t i = 0; i < threads.size(); i++) {
+        const TraceThread& thread = threads[i];
+
+        for (size_t j = 0; j < thread.events.size(); j++) {
+            const TraceEvent& e = thread.events[j];
+            if (e.ts_ns == 0) {
+                continue;
+            }
+
+            const char* name = 0;
+            const char* count_name = "count";
+            const char* arg_name = 0;
+            switch (e.type) {
+                case TRACE_PACKET:
+                    name = e.count == 0 ? "Heartbeat" : e.count == 0xFFFF ? "EndOfSession" : "Packet";
+                    break;
+                case TRACE_GAP: name = "Gap"; count_name = "missing"; break;
+                case TRACE_REQUEST: name = "Request"; arg_name = "attempt"; break;
+                case TRACE_REPLY: name = "Reply"; count_name = "messages"; break;
+                case TRACE_REQUEST_TIMEOUT: name = "RequestTimeout"; arg_name = "attempt"; break;
+                case TRACE_DECODE: name = "Decode"; count_name = "messages"; break;
+                case TRACE_STALL: name = "Stall"; arg_name = "idle_ms"; break;
+                default: continue;
+            }
+
+            double ts_us = (double)(e.ts_ns - base_ns) / 1000.0;
+            std::printf(",\n{\"name\":\"%s\",\"cat\":\"feed\",", name);
+            if (e.type == TRACE_DECODE) {
+                std::printf("\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,", ts_us, e.arg / 1000.0);
+            } else {
+                std::printf("\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,", ts_us);
+            }
+            std::printf("\"pid\":%u,\"tid\":%u,\"args\":{\"channel\":", header.pid, thread.header.tid);
+            print_json_string(e.channel < header.channel_count ? channels[e.channel] : "");
+            std::printf(",\"seq\":%llu,\"%s\":%u", (unsigned long long)e.seq, count_name, e.count);
+            if (arg_name) {
+                std::printf(",\"%s\":%u", arg_name, e.arg);
+            }
+            std::printf("}}");
+        }
+    }
+
+    std::printf(",\n{\"name\":\"Dump\",\"cat\":\"feed\",\"ph\":\"i\",\"s\":\"g\",\"ts\":%.3f,"
+                "\"pid\":%u,\"tid\":0,\"args\":{\"reason\":",
+                (double)(header.dump_ns - base_ns) / 1000.0, header.pid);
+    print_json_string(header.reason);
+    std::printf("}}\n]}\n");
+    return 0;
+}
@@ -0,0 +1,312 @@
+#include "tsc_clock.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#else
+#define HAVE_TSC 0
+#endif
+
+// ns = base_ns + (cycles - base_tsc)
+//      * mult >> 32, mult = ns per
+// cycle in 32.32 fixed point.
+// Seqlock, one writer (calibrator).
+struct TscCalibration {
+    std::atomic<uint32_t> seq;
+    std::atomic<uint64_t> base_tsc;
+    std::atomic<uint64_t> base_ns;      // CLOCK_MONOTONIC
+    std::atomic<uint64_t> mult;
+    std::atomic<int64_t> real_offset_ns; // REALTIME - MONOTONIC
+};
+
+static TscCalibration calibration;
+static std::atomic<bool> tsc_active(false);
+static std::atomic<bool> calibrator_owned(false);
+
+// Clock steps past this (suspend,
+// VM migration) are taken at once,
+// smaller errors are slewed out
+// over the next interval
+static const int64_t MAX_SLEW_NS = 1000000;
+static const uint32_t MIN_INTERVAL_MS = 100;
+
+static uint64_t system_ns(clockid_t id) {
+    timespec ts;
+    ::clock_gettime(id, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static inline uint64_t read_tsc() {
+#if HAVE_TSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+static inline uint64_t scale(uint64_t cycles, uint64_t mult) {
+    return (uint64_t)(((unsigned __int128)cycles * mult) >> 32);
+}
+
+static void load_calibration(uint64_t* base_tsc, uint64_t* base_ns, uint64_t* mult,
+                             int64_t* real_offset_ns) {
+    for (;;) {
+        uint32_t before = calibration.seq.load(std::memory_order_acquire);
+        if (before & 1) {
+            continue;
+        }
+
+        *base_tsc = calibration.base_tsc.load(std::memory_order_relaxed);
+        *base_ns = calibration.base_ns.load(std::memory_order_relaxed);
+        *mult = calibration.mult.load(std::memory_order_relaxed);
+        *real_offset_ns = calibration.real_offset_ns.load(std::memory_order_relaxed);
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (calibration.seq.load(std::memory_order_relaxed) == before) {
+            return;
+        }
+    }
+}
+
+static void store_calibration(uint64_t base_tsc, uint64_t base_ns, uint64_t mult,
+                              int64_t real_offset_ns) {
+    uint32_t seq = calibration.seq.load(std::memory_order_relaxed);
+    calibration.seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    calibration.base_tsc.store(base_tsc, std::memory_order_relaxed);
+    calibration.base_ns.store(base_ns, std::memory_order_relaxed);
+    calibration.mult.store(mult, std::memory_order_relaxed);
+    calibration.real_offset_ns.store(real_offset_ns, std::memory_order_relaxed);
+
+    calibration.seq.store(seq + 2, std::memory_order_release);
+}
+
+// Counter read after the calibration,
+// so it is at or past base_tsc unless
+// the CPU reordered it; both handled
+static uint64_t monotonic_at(uint64_t tsc, uint64_t base_tsc, uint64_t base_ns, uint64_t mult) {
+    if (tsc >= base_tsc) {
+        return base_ns + scale(tsc - base_tsc, mult);
+    }
+    return base_ns - scale(base_tsc - tsc, mult);
+}
+
+static uint64_t tsc_monotonic_ns(int64_t* real_offset_ns) {
+    uint64_t base_tsc, base_ns, mult;
+    load_calibration(&base_tsc, &base_ns, &mult, real_offset_ns);
+    return monotonic_at(read_tsc(), base_tsc, base_ns, mult);
+}
+
+uint64_t clock_realtime_ns() {
+    if (!tsc_active.load(std::memory_order_acquire)) {
+        return system_ns(CLOCK_REALTIME);
+    }
+
+    int64_t real_offset_ns;
+    uint64_t mono = tsc_monotonic_ns(&real_offset_ns);
+    return mono + (uint64_t)real_offset_ns;
+}
+
+uint64_t clock_monotonic_ns() {
+    if (!tsc_active.load(std::memory_order_acquire)) {
+        return system_ns(CLOCK_MONOTONIC);
+    }
+
+    int64_t real_offset_ns;
+    return tsc_monotonic_ns(&real_offset_ns);
+}
+
+uint64_t tsc_cycles() {
+    if (!tsc_active.load(std::memory_order_acquire)) {
+        return 0;
+    }
+    return read_tsc();
+}
+
+uint64_t tsc_cycles_to_ns(uint64_t cycles) {
+    return scale(cycles, calibration.mult.load(std::memory_order_relaxed));
+}
+
+const char* clock_source_name() {
+    return tsc_active.load(std::memory_order_acquire) ? "tsc" : "clock_gettime";
+}
+
+// CPUID invariant TSC bit, and the
+// kernel still trusting it (it moves
+// off "tsc" when the CPUs disagree)
+static bool invariant_tsc() {
+#if HAVE_TSC
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(0x80000000, &eax, &ebx, &ecx, &edx) || eax < 0x80000007) {
+        return false;
+    }
+    __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx);
+    if (!(edx & (1u << 8))) {
+        return false;
+    }
+
+    FILE* f = std::fopen("/sys/devices/system/clocksource/clocksource0/current_clocksource", "r");
+    if (!f) {
+        return true;
+    }
+    char source[32] = {0};
+    bool tsc = std::fgets(source, sizeof(source), f) && std::strncmp(source, "tsc", 3) == 0;
+    std::fclose(f);
+    return tsc;
+#else
+    return false;
+#endif
+}
+
+struct ClockSample {
+    uint64_t tsc;
+    uint64_t mono_ns;
+    int64_t real_offset_ns;
+};
+
+// Tightest of a few counter reads
+// around the system clocks, counter
+// taken as the midpoint
+static ClockSample take_sample() {
+    ClockSample best;
+    uint64_t best_width = ~0ULL;
+
+    for (int i = 0; i < 5; i++) {
+        uint64_t before = read_tsc();
+        uint64_t mono = system_ns(CLOCK_MONOTONIC);
+        uint64_t real = system_ns(CLOCK_REALTIME);
+        uint64_t after = read_tsc();
+
+        if (after - before < best_width) {
+            best_width = after - before;
+            best.tsc = before + (after - before) / 2;
+            best.mono_ns = mono;
+            best.real_offset_ns = (int64_t)(real - mono);
+        }
+    }
+    return best;
+}
+
+static uint64_t rate_between(const ClockSample& from, const ClockSample& to) {
+    uint64_t cycles = to.tsc - from.tsc;
+    uint64_t ns = to.mono_ns - from.mono_ns;
+    if (cycles == 0) {
+        return 0;
+    }
+    return (uint64_t)(((unsigned __int128)ns << 32) / cycles);
+}
+
+ClockCalibrator::ClockCalibrator()
+: interval_ms(1000),
+  running(false) {}
+
+ClockCalibrator::~ClockCalibrator() {
+    stop();
+}
+
+bool ClockCalibrator::start(uint32_t calibrate_interval_ms) {
+    if (!invariant_tsc() || calibrator_owned.exchange(true)) {
+        return false;
+    }
+
+    interval_ms = calibrate_interval_ms < MIN_INTERVAL_MS ? MIN_INTERVAL_MS : calibrate_interval_ms;
+
+    ClockSample first = take_sample();
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    ClockSample second = take_sample();
+
+    uint64_t mult = rate_between(first, second);
+    if (mult == 0) {
+        calibrator_owned.store(false);
+        return false;
+    }
+
+    store_calibration(second.tsc, second.mono_ns, mult, second.real_offset_ns);
+    tsc_active.store(true, std::memory_order_release);
+
+    running.store(true);
+    worker = std::thread(&ClockCalibrator::calibrate_loop, this);
+    return true;
+}
+
+void ClockCalibrator::stop() {
+    if (!running.exchange(false)) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex);
+        wake.notify_all();
+    }
+    if (worker.joinable()) {
+        worker.join();
+    }
+
+    // Readers go back to the system
+    // clock, the last scale stays
+    // for cycle conversions
+    tsc_active.store(false, std::memory_order_release);
+    calibrator_owned.store(false);
+}
+
+double ClockCalibrator::tsc_ghz() const {
+    uint64_t mult = calibration.mult.load(std::memory_order_relaxed);
+    return mult == 0 ? 0.0 : 4294967296.0 / (double)mult;
+}
+
+// Rate from the whole run so far
+// (error shrinks as it grows), then
+// aimed so the TSC clock meets the
+// system one an interval from now:
+// no jumps, NTP slew followed
+void ClockCalibrator::calibrate_loop() {
+    ClockSample origin;
+    {
+        uint64_t base_tsc, base_ns, mult;
+        int64_t real_offset_ns;
+        load_calibration(&base_tsc, &base_ns, &mult, &real_offset_ns);
+        origin.tsc = base_tsc;
+        origin.mono_ns = base_ns;
+        origin.real_offset_ns = real_offset_ns;
+    }
+
+    const uint64_t interval_ns = (uint64_t)interval_ms * 1000000ULL;
+
+    std::unique_lock<std::mutex> lock(wake_mutex);
+    while (running.load()) {
+        wake.wait_for(lock, std::chrono::milliseconds(interval_ms));
+        if (!running.load()) {
+            break;
+        }
+
+        ClockSample now = take_sample();
+        uint64_t rate = rate_between(origin, now);
+        if (rate == 0) {
+            continue;
+        }
+
+        // Only this thread stores, the
+        // values can be read directly
+        uint64_t predicted = monotonic_at(now.tsc,
+                                          calibration.base_tsc.load(std::memory_order_relaxed),
+                                          calibration.base_ns.load(std::memory_order_relaxed),
+                                          calibration.mult.load(std::memory_order_relaxed));
+        int64_t error_ns = (int64_t)(now.mono_ns - predicted);
+
+        if (error_ns > MAX_SLEW_NS || error_ns < -MAX_SLEW_NS) {
+            store_calibration(now.tsc, now.mono_ns, rate, now.real_offset_ns);
+            continue;
+        }
+
+        uint64_t interval_cycles = (uint64_t)(((unsigned __int128)interval_ns << 32) / rate);
+        uint64_t mult = (uint64_t)(((unsigned __int128)(interval_ns + error_ns) << 32) / interval_cycles);
+        store_calibration(now.tsc, predicted, mult, now.real_offset_ns);
+    }
+}
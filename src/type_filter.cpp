@@ -0,0 +1,162 @@
+#include "type_filter.h"
+
+#include <cstring>
+#include <immintrin.h>
+
+// Vector kernels are built per function
+// (target attribute) so the binary still
+// runs on CPUs without them.
+
+static void mask_scalar(const uint8_t* types, uint32_t count,
+                        const bool* allowed, uint8_t* pass) {
+    for (uint32_t i = 0; i < count; i++) {
+        pass[i] = allowed[types[i]] ? 1 : 0;
+    }
+}
+
+// PCMPESTRM "equal any": each type byte
+// against up to 16 allowed types at once.
+__attribute__((target("sse4.2")))
+static void mask_sse42(const uint8_t* types, uint32_t count,
+                       const uint8_t* set, int set_size,
+                       const bool* allowed, uint8_t* pass) {
+
+    const __m128i needles = _mm_loadu_si128((const __m128i*)set);
+    const __m128i ones = _mm_set1_epi8(1);
+
+    uint32_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128i block = _mm_loadu_si128((const __m128i*)(types + i));
+        __m128i hits = _mm_cmpestrm(needles, set_size, block, 16,
+                                    _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY | _SIDD_UNIT_MASK);
+        _mm_storeu_si128((__m128i*)(pass + i), _mm_and_si128(hits, ones));
+    }
+
+    mask_scalar(types + i, count - i, allowed, pass + i);
+}
+
+// 32 types per step, one compare
+// per allowed type.
+__attribute__((target("avx2")))
+static void mask_avx2(const uint8_t* types, uint32_t count,
+                      const uint8_t* set, int set_size,
+                      const bool* allowed, uint8_t* pass) {
+
+    __m256i needles[16];
+    for (int k = 0; k < set_size; k++) {
+        needles[k] = _mm256_set1_epi8((char)set[k]);
+    }
+    const __m256i ones = _mm256_set1_epi8(1);
+
+    uint32_t i = 0;
+    for (; i + 32 <= count; i += 32) {
+        __m256i block = _mm256_loadu_si256((const __m256i*)(types + i));
+        __m256i hits = _mm256_setzero_si256();
+
+        for (int k = 0; k < set_size; k++) {
+            hits = _mm256_or_si256(hits, _mm256_cmpeq_epi8(block, needles[k]));
+        }
+        _mm256_storeu_si256((__m256i*)(pass + i), _mm256_and_si256(hits, ones));
+    }
+
+    mask_scalar(types + i, count - i, allowed, pass + i);
+}
+
+static FilterKernel best_kernel() {
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx2")) {
+        return FILTER_KERNEL_AVX2;
+    }
+    if (__builtin_cpu_supports("sse4.2")) {
+        return FILTER_KERNEL_SSE42;
+    }
+    return FILTER_KERNEL_SCALAR;
+}
+
+TypeFilter::TypeFilter()
+: active(FILTER_KERNEL_SCALAR),
+  pass_all(true),
+  set_size(0) {
+    std::memset(allowed, 1, sizeof(allowed));
+    std::memset(set, 0, sizeof(set));
+    reset_counts();
+}
+
+void TypeFilter::init(const bool* allowed_types, FilterKernel requested) {
+    pass_all = (allowed_types == 0);
+    set_size = 0;
+    std::memset(set, 0, sizeof(set));
+
+    for (int t = 0; t < 256; t++) {
+        allowed[t] = pass_all || allowed_types[t];
+
+        if (!pass_all && allowed_types[t]) {
+            if (set_size < 16) {
+                set[set_size] = (uint8_t)t;
+            }
+            set_size++;
+        }
+    }
+
+    FilterKernel best = best_kernel();
+    if (requested == FILTER_KERNEL_AUTO || requested > best) {
+        requested = best;
+    }
+
+    // Vector compares only pay off
+    // for a short allowed list
+    if (set_size > 16) {
+        requested = FILTER_KERNEL_SCALAR;
+    }
+
+    active = requested;
+}
+
+uint32_t TypeFilter::run(const uint8_t* types, uint32_t count, uint8_t* pass) {
+    if (!types || !pass || count == 0) {
+        return 0;
+    }
+
+    if (pass_all) {
+        std::memset(pass, 1, count);
+    } else if (active == FILTER_KERNEL_AVX2) {
+        mask_avx2(types, count, set, set_size, allowed, pass);
+    } else if (active == FILTER_KERNEL_SSE42) {
+        mask_sse42(types, count, set, set_size, allowed, pass);
+    } else {
+        mask_scalar(types, count, allowed, pass);
+    }
+
+    uint32_t passed = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        counts[types[i]]++;
+        passed += pass[i];
+    }
+    return passed;
+}
+
+bool TypeFilter::pass_one(uint8_t type) {
+    counts[type]++;
+    return allowed[type];
+}
+
+uint64_t TypeFilter::count(uint8_t type) const {
+    return counts[type];
+}
+
+void TypeFilter::reset_counts() {
+    std::memset(counts, 0, sizeof(counts));
+}
+
+FilterKernel TypeFilter::kernel() const {
+    return active;
+}
+
+const char* TypeFilter::kernel_name() const {
+    switch (active) {
+        case FILTER_KERNEL_AVX2: return "avx2";
+        case FILTER_KERNEL_SSE42: return "sse4.2";
+        default: return "scalar";
+    }
+}